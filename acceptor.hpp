@@ -3,6 +3,8 @@
 #include "inet_address.hpp"
 #include "event_loop.hpp"
 #include "socket.hpp"
+#include <fcntl.h>
+#include <memory>
 
 
 MUDUO_STUDY_BEGIN_NAMESPACE
@@ -12,52 +14,101 @@ class Acceptor
 public:
     MUDUO_STUDY_NONCOPYABLE(Acceptor)
     using NewConnectionCallback = std::move_only_function<void(int sockfd, const InetAddress&)>;
+    // Per wakeup, so a connection storm can't starve the loop's other
+    // channels.
+    static constexpr int kMaxAcceptsPerRead = 64;
 
     Acceptor(EventLoop* loop, const InetAddress& listen_addr, bool reuse_port) :
         loop_{loop},
-        accept_socket_{::socket(listen_addr.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)},
-        accept_channel_{loop, accept_socket_.fd()},
-        listening_{false}
+        accept_socket_{std::make_shared<Socket>(::socket(listen_addr.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP))},
+        accept_channel_{loop, accept_socket_->fd()},
+        listening_{false},
+        exclusive_{false},
+        idle_fd_{::open("/dev/null", O_RDONLY | O_CLOEXEC)}
     {
-        if (accept_socket_.fd() == -1) {
+        if (accept_socket_->fd() == -1) {
             MUDUO_STUDY_LOG_SYSFATAL("socket() failed!");
         }
-        accept_socket_.set_reuse_addr(true);
-        accept_socket_.set_reuse_port(reuse_port);
-        accept_socket_.BindAddress(listen_addr);
+        accept_socket_->set_reuse_addr(true);
+        accept_socket_->set_reuse_port(reuse_port);
+        accept_socket_->BindAddress(listen_addr);
+        accept_channel_.set_read_callback([this](auto){ this->HandleRead(); });
+    }
+    // Accepts from loop on the listening socket of other.
+    Acceptor(EventLoop* loop, const Acceptor& other) :
+        loop_{loop},
+        accept_socket_{other.accept_socket_},
+        accept_channel_{loop, accept_socket_->fd()},
+        listening_{false},
+        exclusive_{false},
+        idle_fd_{::open("/dev/null", O_RDONLY | O_CLOEXEC)}
+    {
         accept_channel_.set_read_callback([this](auto){ this->HandleRead(); });
     }
     ~Acceptor() {
         accept_channel_.DisableAll();
         accept_channel_.Remove();
+        ::close(idle_fd_);
     }
 
     auto listening() const noexcept { return listening_; }
     void set_new_connection_callback(NewConnectionCallback cb) { new_connection_callback_ = std::move(cb); }
+    // With EPOLLEXCLUSIVE, a connection wakes one of the loops waiting on
+    // a shared socket rather than all of them. Set before Listen().
+    void set_exclusive(bool on) {
+        assert(!listening_);
+        exclusive_ = on;
+    }
 
     void Listen() {
         loop_->AssertInLoopThread();
         listening_ = true;
-        accept_socket_.Listen();
-        accept_channel_.EnableReading();
+        // Again for a shared socket, which only updates the backlog.
+        accept_socket_->Listen();
+        if (exclusive_) {
+            accept_channel_.EnableReadingExclusive();
+        }
+        else {
+            accept_channel_.EnableReading();
+        }
     }
 private:
     void HandleRead() {
         loop_->AssertInLoopThread();
-        InetAddress peer_addr;
-        auto connfd = accept_socket_.Accept(&peer_addr);
-        if (new_connection_callback_)
-            new_connection_callback_(connfd, peer_addr);
-        else
-            ::close(connfd);
+        for (int i = 0; i < kMaxAcceptsPerRead; i++) {
+            InetAddress peer_addr;
+            auto connfd = accept_socket_->Accept(&peer_addr);
+            if (!connfd.has_value()) {
+                auto err = connfd.error();
+                if (err == EINTR || err == ECONNABORTED) continue;
+                if (err == EAGAIN || err == EWOULDBLOCK) break;
+                MUDUO_STUDY_LOG_ERROR2(err, "accept4() failed!");
+                if (err == EMFILE) {
+                    // Accepted and closed through the spare fd, level
+                    // triggered readiness would spin otherwise.
+                    ::close(idle_fd_);
+                    idle_fd_ = ::accept(accept_socket_->fd(), nullptr, nullptr);
+                    ::close(idle_fd_);
+                    idle_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+                }
+                break;
+            }
+            if (new_connection_callback_)
+                new_connection_callback_(connfd.value(), peer_addr);
+            else
+                ::close(connfd.value());
+        }
     }
 
     EventLoop* loop_;
-    Socket accept_socket_;
+    // Shared by the acceptors of several loops.
+    std::shared_ptr<Socket> accept_socket_;
     Channel accept_channel_;
     NewConnectionCallback new_connection_callback_;
     bool listening_;
+    bool exclusive_;
+    int idle_fd_;
 };
 
 
-MUDUO_STUDY_END_NAMESPACE
\ No newline at end of file
+MUDUO_STUDY_END_NAMESPACE
@@ -0,0 +1,297 @@
+#pragma once
+#include "core.hpp"
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Files named basename.YYYYmmdd-HHMMSS.host.pid.log, a new one once
+// roll_size bytes were written or a roll_interval boundary (UTC) passed.
+// More rolls within the same second get .1, .2, ... before .log. Used by
+// a single thread.
+class LogFile
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(LogFile)
+    static constexpr size_t kDefaultRollSize = 64 * 1024 * 1024;
+    static constexpr auto kDefaultRollInterval = std::chrono::seconds{24h};
+
+    explicit LogFile(std::string_view basename,
+                     size_t roll_size = kDefaultRollSize,
+                     std::chrono::seconds roll_interval = kDefaultRollInterval) :
+        basename_{basename},
+        roll_size_{roll_size},
+        roll_interval_{roll_interval.count()},
+        file_{nullptr},
+        written_{0},
+        period_start_{0},
+        last_roll_{0},
+        roll_seq_{0} {}
+    ~LogFile() {
+        if (file_) ::fclose(file_);
+    }
+
+    auto written_bytes() const noexcept { return written_; }
+
+    void Append(std::string_view data) {
+        auto now = ::time(nullptr);
+        if (!file_ || now / roll_interval_ * roll_interval_ != period_start_ ||
+            (written_ > 0 && written_ + data.size() > roll_size_)) {
+            Roll(now);
+        }
+        if (!file_) return;
+        auto n = ::fwrite_unlocked(data.data(), 1, data.size(), file_);
+        if (n != data.size()) {
+            // Not through Logger, which may be writing here.
+            fprintf(stderr, "LogFile::Append %s: %s\n", file_name_.c_str(), strerror(errno));
+            clearerr(file_);
+        }
+        written_ += n;
+    }
+    void Flush() {
+        if (file_) ::fflush(file_);
+    }
+
+private:
+    static constexpr size_t kFileBufferSize = 64 * 1024;
+
+    void Roll(time_t now) {
+        if (file_) ::fclose(file_);
+        file_name_ = FileName(now);
+        file_ = ::fopen(file_name_.c_str(), "ae");
+        if (!file_) {
+            fprintf(stderr, "LogFile::Roll fopen %s: %s\n", file_name_.c_str(), strerror(errno));
+        }
+        else {
+            ::setvbuf(file_, nullptr, _IOFBF, kFileBufferSize);
+        }
+        written_ = 0;
+        period_start_ = now / roll_interval_ * roll_interval_;
+    }
+    std::string FileName(time_t now) {
+        roll_seq_ = now == last_roll_ ? roll_seq_ + 1 : 0;
+        last_roll_ = now;
+        tm tm_time;
+        ::gmtime_r(&now, &tm_time);
+        char time_buf[32];
+        ::strftime(time_buf, sizeof(time_buf), ".%Y%m%d-%H%M%S.", &tm_time);
+        char host[256] = "unknownhost";
+        ::gethostname(host, sizeof(host) - 1);
+        if (roll_seq_ > 0) {
+            return std::format("{}{}{}.{}.{}.log", basename_, time_buf, host, ::getpid(), roll_seq_);
+        }
+        return std::format("{}{}{}.{}.log", basename_, time_buf, host, ::getpid());
+    }
+
+    const std::string basename_;
+    const size_t roll_size_;
+    const time_t roll_interval_;
+    std::FILE* file_;
+    std::string file_name_;
+    size_t written_;
+    time_t period_start_;
+    time_t last_roll_;
+    int roll_seq_;
+};
+
+// Double buffered logging to a LogFile: callers copy their line into the
+// current front buffer under a short lock, full buffers are handed to a
+// writer thread which writes and flushes them at least every
+// flush_interval. A caller never waits for the disk, when max_buffers are
+// already queued the line is dropped and counted instead.
+//
+// stream() plugs it into Logger per level:
+//   AsyncLogging log{"server"};
+//   log.Start();
+//   Logger::set_ostream(Logger::kInfo, log.stream());
+class AsyncLogging
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(AsyncLogging)
+    static constexpr size_t kDefaultBufferSize = 4 * 1024 * 1024;
+    static constexpr size_t kDefaultMaxBuffers = 16;
+    static constexpr auto kDefaultFlushInterval = 3s;
+
+    explicit AsyncLogging(std::string_view basename,
+                          size_t roll_size = LogFile::kDefaultRollSize,
+                          std::chrono::milliseconds flush_interval = kDefaultFlushInterval,
+                          size_t buffer_size = kDefaultBufferSize,
+                          size_t max_buffers = kDefaultMaxBuffers) :
+        file_{basename, roll_size},
+        flush_interval_{flush_interval},
+        buffer_size_{buffer_size},
+        max_buffers_{max_buffers},
+        current_{NewBuffer()},
+        running_{false},
+        dropped_{0},
+        total_dropped_{0},
+        flush_requested_{0},
+        flush_done_{0},
+        streambuf_{this},
+        stream_{&streambuf_} {}
+    ~AsyncLogging() {
+        Stop();
+    }
+
+    // Thread safe, each message must reach it in one write, as Logger does.
+    std::ostream& stream() noexcept { return stream_; }
+    auto dropped() const noexcept { return total_dropped_.load(std::memory_order_relaxed); }
+
+    void Start() {
+        std::scoped_lock lock{mutex_};
+        if (running_) return;
+        running_ = true;
+        thread_ = std::jthread([this]{ ThreadFunc(); });
+    }
+    // Writes out everything appended so far.
+    void Stop() {
+        {
+            std::scoped_lock lock{mutex_};
+            if (!running_) return;
+            running_ = false;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    void Append(std::string_view line) {
+        std::scoped_lock lock{mutex_};
+        if (current_.size + line.size() > buffer_size_) {
+            if (full_.size() >= max_buffers_ || line.size() > buffer_size_) {
+                ++dropped_;
+                total_dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            full_.push_back(std::move(current_));
+            current_ = TakeFreeBuffer();
+            cv_.notify_one();
+        }
+        memcpy(current_.data.get() + current_.size, line.data(), line.size());
+        current_.size += line.size();
+    }
+    // Blocks until what was appended before is written and flushed, for
+    // fatal errors. Returns at once if the writer isn't running.
+    void Flush() {
+        std::unique_lock lock{mutex_};
+        if (!running_) return;
+        auto ticket = ++flush_requested_;
+        cv_.notify_one();
+        flushed_cv_.wait(lock, [&]{ return flush_done_ >= ticket; });
+    }
+
+private:
+    struct LogBuffer {
+        std::unique_ptr<char[]> data;
+        size_t size = 0;
+    };
+
+    class StreamBuf : public std::streambuf
+    {
+    public:
+        explicit StreamBuf(AsyncLogging* owner) : owner_{owner} {}
+
+    protected:
+        std::streamsize xsputn(const char* s, std::streamsize n) override {
+            owner_->Append({s, static_cast<size_t>(n)});
+            return n;
+        }
+        int_type overflow(int_type c) override {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                char ch = traits_type::to_char_type(c);
+                owner_->Append({&ch, 1});
+            }
+            return traits_type::not_eof(c);
+        }
+        int sync() override {
+            owner_->Flush();
+            return 0;
+        }
+
+    private:
+        AsyncLogging* owner_;
+    };
+
+    LogBuffer NewBuffer() const {
+        return {std::make_unique_for_overwrite<char[]>(buffer_size_), 0};
+    }
+    LogBuffer TakeFreeBuffer() {
+        if (free_.empty()) {
+            return NewBuffer();
+        }
+        auto buffer = std::move(free_.back());
+        free_.pop_back();
+        return buffer;
+    }
+
+    void ThreadFunc() {
+        std::vector<LogBuffer> to_write;
+        bool running = true;
+        while (running) {
+            size_t dropped;
+            uint64_t flush_ticket;
+            {
+                std::unique_lock lock{mutex_};
+                if (full_.empty() && running_ && flush_requested_ == flush_done_) {
+                    cv_.wait_for(lock, flush_interval_);
+                }
+                if (current_.size > 0) {
+                    full_.push_back(std::move(current_));
+                    current_ = TakeFreeBuffer();
+                }
+                to_write.swap(full_);
+                dropped = std::exchange(dropped_, 0);
+                flush_ticket = flush_requested_;
+                running = running_;
+            }
+            if (dropped > 0) {
+                file_.Append(std::format("[Warning] AsyncLogging dropped {} messages, the writer fell behind\n", dropped));
+            }
+            for (auto& buffer : to_write) {
+                file_.Append({buffer.data.get(), buffer.size});
+            }
+            file_.Flush();
+            {
+                std::scoped_lock lock{mutex_};
+                // Two spares cover a burst, the rest is given back.
+                for (auto& buffer : to_write) {
+                    if (free_.size() >= 2) break;
+                    buffer.size = 0;
+                    free_.push_back(std::move(buffer));
+                }
+                flush_done_ = flush_ticket;
+            }
+            to_write.clear();
+            flushed_cv_.notify_all();
+        }
+    }
+
+    LogFile file_;
+    const std::chrono::milliseconds flush_interval_;
+    const size_t buffer_size_;
+    const size_t max_buffers_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable flushed_cv_;
+    LogBuffer current_;
+    std::vector<LogBuffer> full_;
+    std::vector<LogBuffer> free_;
+    bool running_;
+    size_t dropped_;
+    std::atomic_uint64_t total_dropped_;
+    uint64_t flush_requested_;
+    uint64_t flush_done_;
+    std::jthread thread_;
+    StreamBuf streambuf_;
+    std::ostream stream_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
@@ -0,0 +1,79 @@
+// Accept rate under a reconnect storm: client threads connect and reset
+// blocking sockets back to back, the server counts the connections it
+// established. Compares the single acceptor on the base loop (option 0)
+// with per-loop acceptors, SO_REUSEPORT (2) or EPOLLEXCLUSIVE (3). Prints
+// one JSON object.
+//
+//   accept_bench [seconds=5] [server_threads=4] [client_threads=2] [option=2]
+#include "bench_common.hpp"
+#include "tcp_server.hpp"
+#include <sys/socket.h>
+#include <atomic>
+
+using namespace muduo_study;
+
+namespace {
+
+constexpr uint16_t kPort = 19882;
+
+// Reset rather than closed, TIME_WAIT would use up the local ports.
+bool ConnectAndReset() {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    InetAddress addr{"127.0.0.1", kPort};
+    bool ok = ::connect(fd, reinterpret_cast<const sockaddr*>(addr.sockaddr()), sizeof(sockaddr_in)) == 0;
+    linger reset{1, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    ::close(fd);
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int seconds = bench::Arg(argc, argv, 1, 5);
+    int server_threads = bench::Arg(argc, argv, 2, 4);
+    int client_threads = bench::Arg(argc, argv, 3, 2);
+    auto option = static_cast<TcpServer::Option>(bench::Arg(argc, argv, 4, TcpServer::kReusePortPerLoop));
+
+    // Every connection logs, and so do the resets.
+    std::ostream discard{nullptr};
+    Logger::set_ostream(Logger::kInfo, discard);
+    Logger::set_ostream(Logger::kError, discard);
+    EventLoop loop;
+    TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "accept", option};
+    server.set_thread_num(server_threads);
+    std::atomic_uint64_t accepted{0};
+    server.set_connection_callback([&](const TcpConnectionPtr conn){
+        if (conn->connected()) accepted.fetch_add(1, std::memory_order_relaxed);
+    });
+    server.Start();
+
+    std::jthread driver([&]{
+        std::atomic_bool stop{false};
+        std::atomic_uint64_t failed{0};
+        {
+            std::vector<std::jthread> clients;
+            for (int i = 0; i < client_threads; i++) {
+                clients.emplace_back([&]{
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        if (!ConnectAndReset()) failed.fetch_add(1, std::memory_order_relaxed);
+                    }
+                });
+            }
+            std::this_thread::sleep_for(std::chrono::seconds(seconds));
+            stop = true;
+        }
+        loop.Quit();
+        bench::Json{}
+            .Add("benchmark", "accept")
+            .Add("option", static_cast<int>(option))
+            .Add("server_threads", server_threads)
+            .Add("client_threads", client_threads)
+            .Add("seconds", seconds)
+            .Add("accepted", accepted.load())
+            .Add("failed_connects", failed.load())
+            .Add("accepts_per_sec", static_cast<double>(accepted.load()) / seconds)
+            .Print();
+    });
+    loop.Loop();
+}
@@ -0,0 +1,60 @@
+// Counts heap allocations by replacing the global operator new. The
+// replacement must be defined once per program, include this from the
+// benchmark's single translation unit only.
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace bench {
+
+inline std::atomic_uint64_t alloc_count{0};
+
+// Every thread's allocations, read before and after the measured code.
+inline uint64_t AllocCount() {
+    return alloc_count.load(std::memory_order_relaxed);
+}
+
+namespace details {
+inline void* CountedAlloc(std::size_t size, std::size_t align) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    size = size == 0 ? 1 : size;
+    void* p = align <= alignof(std::max_align_t)
+        ? std::malloc(size)
+        : std::aligned_alloc(align, (size + align - 1) / align * align);
+    return p;
+}
+} // namespace details
+
+} // namespace bench
+
+void* operator new(std::size_t size) {
+    if (auto p = bench::details::CountedAlloc(size, alignof(std::max_align_t))) return p;
+    throw std::bad_alloc{};
+}
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+void* operator new(std::size_t size, std::align_val_t align) {
+    if (auto p = bench::details::CountedAlloc(size, static_cast<std::size_t>(align))) return p;
+    throw std::bad_alloc{};
+}
+void* operator new[](std::size_t size, std::align_val_t align) {
+    return ::operator new(size, align);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return bench::details::CountedAlloc(size, alignof(std::max_align_t));
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return bench::details::CountedAlloc(size, alignof(std::max_align_t));
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
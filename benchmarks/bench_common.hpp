@@ -0,0 +1,138 @@
+// Shared by the network benchmarks: positional arguments, percentiles,
+// one-line JSON results and client loops on threads of their own.
+#pragma once
+#include "event_loop.hpp"
+#include <sys/resource.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <latch>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+inline long Arg(int argc, char* argv[], int index, long value) {
+    return argc > index ? atol(argv[index]) : value;
+}
+
+// Each connection costs two fds when both sides run in process.
+inline void RaiseFdLimit() {
+    rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+// p in [0, 1], sorted must not be empty.
+template<typename T>
+T Percentile(const std::vector<T>& sorted, double p) {
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+}
+
+// Flat JSON object written in insertion order, nested objects through
+// Begin()/End(). Keys are plain identifiers, strings are not escaped.
+class Json
+{
+public:
+    Json() : out_{"{"}, first_{true} {}
+
+    Json& Add(std::string_view key, std::string_view value) {
+        Key(key);
+        out_ += '"';
+        out_ += value;
+        out_ += '"';
+        return *this;
+    }
+    Json& Add(std::string_view key, const char* value) { return Add(key, std::string_view{value}); }
+    Json& Add(std::string_view key, double value) {
+        Key(key);
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.3f", value);
+        out_ += buf;
+        return *this;
+    }
+    Json& Add(std::string_view key, std::integral auto value) {
+        Key(key);
+        out_ += std::to_string(value);
+        return *this;
+    }
+    Json& Begin(std::string_view key) {
+        Key(key);
+        out_ += '{';
+        first_ = true;
+        return *this;
+    }
+    Json& End() {
+        out_ += '}';
+        first_ = false;
+        return *this;
+    }
+    // One line on stdout, so results can be appended to a file per commit.
+    void Print() const {
+        printf("%s}\n", out_.c_str());
+        fflush(stdout);
+    }
+
+private:
+    void Key(std::string_view key) {
+        if (!first_) out_ += ", ";
+        first_ = false;
+        out_ += '"';
+        out_ += key;
+        out_ += "\": ";
+    }
+
+    std::string out_;
+    bool first_;
+};
+
+// n threads each running a loop with its own Session, built by
+// make(loop, index) in that thread and destroyed there once the loop quit,
+// so TcpClient and friends are torn down on their own loop.
+template<typename Session>
+class ClientThreads
+{
+public:
+    template<typename Make>
+    ClientThreads(int n, Make make) :
+        loops_(n),
+        sessions_(n)
+    {
+        std::latch started{n};
+        for (int i = 0; i < n; i++) {
+            threads_.emplace_back([this, i, &make, &started]{
+                muduo_study::EventLoop loop;
+                auto session = make(&loop, i);
+                loops_[i] = &loop;
+                sessions_[i] = session.get();
+                started.count_down();
+                loop.Loop();
+            });
+        }
+        started.wait();
+    }
+    ~ClientThreads() { Stop(); }
+
+    // Until Stop(). Sessions belong to their loop's thread, only what they
+    // made thread safe can be read from outside.
+    auto& loops() { return loops_; }
+    auto& sessions() { return sessions_; }
+
+    void Stop() {
+        for (auto loop : loops_) {
+            if (loop) loop->Quit();
+        }
+        threads_.clear();
+        std::ranges::fill(loops_, nullptr);
+        std::ranges::fill(sessions_, nullptr);
+    }
+
+private:
+    std::vector<muduo_study::EventLoop*> loops_;
+    std::vector<Session*> sessions_;
+    std::vector<std::jthread> threads_;
+};
+
+} // namespace bench
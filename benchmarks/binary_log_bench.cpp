@@ -0,0 +1,78 @@
+// ns per log call, synchronous Logger::Output against BinaryLogging, with
+// 1 up to max_threads threads logging at once. Both write to a stream that
+// discards, so the synchronous number is the formatting alone, no I/O.
+// Calls are made in bursts that fit the rings, the writer catches up
+// between bursts, untimed, and drain_ns_per_call is what that took.
+// Prints one JSON object per mode and thread count.
+//
+//   binary_log_bench [bursts=100] [max_threads=4]
+#include "bench_common.hpp"
+#include <barrier>
+
+using namespace muduo_study;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kBurst = 8192;
+
+class DiscardBuf : public std::streambuf
+{
+protected:
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+};
+
+void Run(std::string_view mode, BinaryLogging* logging, int threads, int bursts) {
+    std::atomic_int64_t log_ns{0};
+    int64_t drain_ns = 0;
+    std::barrier burst_done{threads, [&]() noexcept {
+        auto start = Clock::now();
+        if (logging) logging->Flush();
+        drain_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }};
+    std::vector<std::jthread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]{
+            std::string peer = std::format("127.0.0.{}:34567", t + 1);
+            for (int b = 0; b < bursts; b++) {
+                auto start = Clock::now();
+                for (size_t i = 0; i < kBurst; i++) {
+                    MUDUO_STUDY_LOG_INFO("new connection [{}#{}] from {}", "server", i, peer);
+                }
+                log_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+                burst_done.arrive_and_wait();
+            }
+        });
+    }
+    workers.clear();
+    auto calls = static_cast<double>(kBurst) * bursts * threads;
+    bench::Json json;
+    json.Add("benchmark", "binary_log")
+        .Add("mode", mode)
+        .Add("threads", threads)
+        .Add("calls", static_cast<uint64_t>(calls))
+        .Add("ns_per_call", log_ns.load() / calls);
+    if (logging) {
+        json.Add("drain_ns_per_call", drain_ns / calls)
+            .Add("dropped", logging->dropped());
+    }
+    json.Print();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int bursts = bench::Arg(argc, argv, 1, 100);
+    int max_threads = bench::Arg(argc, argv, 2, 4);
+    DiscardBuf discard_buf;
+    std::ostream discard{&discard_buf};
+    Logger::set_ostream(discard);
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        Run("sync", nullptr, threads, bursts);
+        BinaryLogging logging;
+        logging.Start();
+        Run("binary", &logging, threads, bursts);
+    }
+}
@@ -0,0 +1,95 @@
+// Delimiter search kernels walking every line of a 32MiB buffer, the way
+// LineCodec does, for a few line length distributions. string_view::find
+// is the plain library baseline.
+#include "byte_search.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+
+using namespace muduo_study;
+
+namespace {
+
+constexpr size_t kCorpusSize = 32 << 20;
+constexpr int kRounds = 10;
+
+volatile size_t sink;
+
+// Lines of lognormal length, median and spread picked per protocol.
+std::string MakeCorpus(double median, double sigma, size_t max_len) {
+    std::mt19937 rng{7};
+    std::lognormal_distribution<double> length{std::log(median), sigma};
+    std::string corpus;
+    corpus.reserve(kCorpusSize + max_len + 2);
+    while (corpus.size() < kCorpusSize) {
+        auto len = std::min(static_cast<size_t>(length(rng)), max_len);
+        for (size_t i = 0; i < len; i++) {
+            corpus.push_back(static_cast<char>(' ' + rng() % 95));
+        }
+        corpus += "\r\n";
+    }
+    return corpus;
+}
+
+template<typename F>
+double GiBPerSec(const std::string& corpus, F&& find) {
+    size_t lines = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; round++) {
+        auto p = corpus.data();
+        auto end = corpus.data() + corpus.size();
+        while (auto eol = find(p, end)) {
+            ++lines;
+            p = eol + 2;
+        }
+    }
+    sink = lines;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(corpus.size()) * kRounds / elapsed.count() / (1 << 30);
+}
+
+const char* FindCRLFStd(const char* begin, const char* end) {
+    std::string_view view{begin, static_cast<size_t>(end - begin)};
+    auto pos = view.find("\r\n");
+    return pos == view.npos ? nullptr : begin + pos;
+}
+
+} // namespace
+
+int main() {
+    struct Profile {
+        const char* name;
+        double median;
+        double sigma;
+        size_t max_len;
+    };
+    // RESP style commands, HTTP header lines, chat/log lines with a long tail.
+    Profile profiles[] = {
+        {"commands", 12, 0.5, 256},
+        {"http headers", 40, 0.6, 1024},
+        {"mixed", 80, 1.2, 8192},
+    };
+    printf("CRLF search throughput in GiB/s:\n");
+    printf("%-14s %8s %8s %8s %8s %8s\n", "lines", "std", "scalar", "sse2", "avx2", "dispatch");
+    for (auto& profile : profiles) {
+        auto corpus = MakeCorpus(profile.median, profile.sigma, profile.max_len);
+        printf("%-14s %8.2f %8.2f", profile.name,
+            GiBPerSec(corpus, FindCRLFStd),
+            GiBPerSec(corpus, details::FindCRLFScalar));
+#if defined(__x86_64__)
+        printf(" %8.2f", GiBPerSec(corpus, details::FindCRLFSse2));
+        if (__builtin_cpu_supports("avx2")) {
+            printf(" %8.2f", GiBPerSec(corpus, details::FindCRLFAvx2));
+        }
+        else {
+            printf(" %8s", "-");
+        }
+#else
+        printf(" %8s %8s", "-", "-");
+#endif
+        printf(" %8.2f\n", GiBPerSec(corpus, [](auto begin, auto end){ return FindCRLF(begin, end); }));
+    }
+}
@@ -0,0 +1,83 @@
+// Compares Poller's flat ChannelTable with the unordered_map it replaced on
+// the lookups UpdateChannel/RemoveChannel do, with 500k registered fds.
+#include "event_loop.hpp"
+#include <unordered_map>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+
+using namespace muduo_study;
+
+namespace {
+
+constexpr int kNumFds = 500000;
+
+template<typename F>
+double NsPerOp(size_t ops, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ops;
+}
+
+struct MapTable {
+    std::unordered_map<int, Channel*> map;
+
+    Channel* find(int fd) const {
+        auto it = map.find(fd);
+        return it == map.end() ? nullptr : it->second;
+    }
+    void insert(int fd, Channel* channel) { map[fd] = channel; }
+    size_t erase(int fd) { return map.erase(fd); }
+};
+
+volatile uintptr_t sink;
+
+template<typename Table>
+void Run(const char* name, const std::vector<std::unique_ptr<Channel>>& channels, const std::vector<int>& order) {
+    Table table;
+    auto insert = NsPerOp(order.size(), [&]{
+        for (auto fd : order) table.insert(fd, channels[fd].get());
+    });
+    // UpdateChannel on a registered fd: one lookup and a compare.
+    auto update = NsPerOp(order.size() * 4, [&]{
+        uintptr_t acc = 0;
+        for (int round = 0; round < 4; round++) {
+            for (auto fd : order) acc += table.find(fd) == channels[fd].get();
+        }
+        sink = acc;
+    });
+    // RemoveChannel: lookup, then erase, then the fd is registered again as
+    // a new connection would reuse it.
+    auto remove = NsPerOp(order.size(), [&]{
+        uintptr_t acc = 0;
+        for (auto fd : order) {
+            acc += table.find(fd) == channels[fd].get();
+            acc += table.erase(fd);
+            table.insert(fd, channels[fd].get());
+        }
+        sink = acc;
+    });
+    printf("%-14s insert %6.1f ns  update %6.1f ns  remove+readd %6.1f ns\n", name, insert, update, remove);
+}
+
+} // namespace
+
+int main() {
+    std::vector<std::unique_ptr<Channel>> channels;
+    channels.reserve(kNumFds);
+    for (int fd = 0; fd < kNumFds; fd++) {
+        channels.emplace_back(new Channel(nullptr, fd));
+    }
+    // Readiness arrives in no particular fd order.
+    std::vector<int> order(kNumFds);
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::shuffle(order, std::mt19937{42});
+
+    printf("%d registered fds, per operation:\n", kNumFds);
+    for (int i = 0; i < 3; i++) {
+        Run<MapTable>("unordered_map", channels, order);
+        Run<ChannelTable>("ChannelTable", channels, order);
+    }
+}
@@ -0,0 +1,152 @@
+// Echo round-trip latency over loopback: every client connection sends a
+// message, waits for all of it to come back and sends the next, so the
+// number of connections is the load. The clients are TcpClients on their
+// own loops. Prints one JSON object with the latency percentiles.
+//
+//   echo_latency_bench [connections=64] [size=64] [seconds=10] [server_threads=0] [client_threads=1]
+#include "bench_common.hpp"
+#include "tcp_client.hpp"
+#include "tcp_server.hpp"
+#include <atomic>
+#include <mutex>
+
+using namespace muduo_study;
+
+namespace {
+
+constexpr uint16_t kPort = 19882;
+constexpr auto kWarmup = 1s;
+
+using Clock = std::chrono::steady_clock;
+
+// Filled by each client thread on its way out.
+struct Results {
+    std::mutex mutex;
+    std::vector<uint32_t> latencies_ns;
+};
+
+// The connections of one client thread.
+class Session
+{
+public:
+    Session(EventLoop* loop, int connections, size_t size, std::atomic_int* connected,
+            const std::atomic_bool* measuring, Results* results) :
+        message_(size, 'x'),
+        measuring_{measuring},
+        results_{results},
+        sent_(connections)
+    {
+        latencies_ns_.reserve(1 << 20);
+        for (int i = 0; i < connections; i++) {
+            auto& client = clients_.emplace_back(std::make_unique<TcpClient>(loop, InetAddress{"127.0.0.1", kPort}, "echo"));
+            client->set_connection_callback([this, i, connected](const TcpConnectionPtr conn){
+                if (!conn->connected()) return;
+                conn->set_tcp_no_dealy(true);
+                connected->fetch_add(1);
+                SendNext(conn, i);
+            });
+            client->set_message_callback([this, i](const TcpConnectionPtr conn, Buffer* buf, time_point){
+                if (buf->readable_bytes() < message_.size()) return;
+                auto now = Clock::now();
+                buf->Retrieve(message_.size());
+                if (measuring_->load(std::memory_order_relaxed)) {
+                    latencies_ns_.push_back(static_cast<uint32_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(now - sent_[i]).count()));
+                }
+                SendNext(conn, i);
+            });
+            client->Connect();
+        }
+    }
+
+    ~Session() {
+        std::scoped_lock lock{results_->mutex};
+        results_->latencies_ns.insert(results_->latencies_ns.end(), latencies_ns_.begin(), latencies_ns_.end());
+    }
+
+private:
+    void SendNext(const TcpConnectionPtr& conn, int i) {
+        sent_[i] = Clock::now();
+        conn->Send(std::span<const char>(message_));
+    }
+
+    std::string message_;
+    const std::atomic_bool* measuring_;
+    Results* results_;
+    std::vector<Clock::time_point> sent_;
+    std::vector<uint32_t> latencies_ns_;
+    std::vector<std::unique_ptr<TcpClient>> clients_;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int connections = bench::Arg(argc, argv, 1, 64);
+    size_t size = bench::Arg(argc, argv, 2, 64);
+    int seconds = bench::Arg(argc, argv, 3, 10);
+    int server_threads = bench::Arg(argc, argv, 4, 0);
+    int client_threads = bench::Arg(argc, argv, 5, 1);
+    bench::RaiseFdLimit();
+
+    // Connection logs would dominate. The server's threads keep serving
+    // until it is destroyed and log the resets of the closing clients.
+    std::ostream discard{nullptr};
+    Logger::set_ostream(Logger::kInfo, discard);
+    Logger::set_ostream(Logger::kError, discard);
+    EventLoop loop;
+    TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "echo"};
+    server.set_thread_num(server_threads);
+    server.set_connection_callback([](const TcpConnectionPtr conn){
+        if (conn->connected()) conn->set_tcp_no_dealy(true);
+    });
+    server.set_message_callback([](const TcpConnectionPtr conn, Buffer* buf, time_point){
+        conn->Send(std::span(buf->peek(), buf->readable_bytes()));
+        buf->RetrieveAll();
+    });
+    server.Start();
+
+    std::jthread driver([&]{
+        std::atomic_int connected{0};
+        std::atomic_bool measuring{false};
+        Results results;
+        double elapsed;
+        {
+            bench::ClientThreads<Session> clients{client_threads, [&](EventLoop* client_loop, int i){
+                auto share = connections / client_threads + (i < connections % client_threads);
+                return std::make_unique<Session>(client_loop, share, size, &connected, &measuring, &results);
+            }};
+            while (connected.load() < connections) {
+                std::this_thread::sleep_for(1ms);
+            }
+            std::this_thread::sleep_for(kWarmup);
+            measuring = true;
+            auto start = Clock::now();
+            std::this_thread::sleep_for(std::chrono::seconds(seconds));
+            measuring = false;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            loop.Quit();
+        }
+
+        auto& latencies = results.latencies_ns;
+        std::ranges::sort(latencies);
+        auto us = [&](double p) { return latencies.empty() ? 0.0 : bench::Percentile(latencies, p) / 1000.0; };
+        bench::Json{}
+            .Add("benchmark", "echo_latency")
+            .Add("connections", connections)
+            .Add("message_size", size)
+            .Add("server_threads", server_threads)
+            .Add("client_threads", client_threads)
+            .Add("seconds", elapsed)
+            .Add("requests", latencies.size())
+            .Add("requests_per_sec", latencies.size() / elapsed)
+            .Begin("latency_us")
+                .Add("p50", us(0.5))
+                .Add("p90", us(0.9))
+                .Add("p99", us(0.99))
+                .Add("p999", us(0.999))
+                .Add("max", latencies.empty() ? 0.0 : latencies.back() / 1000.0)
+            .End()
+            .Print();
+    });
+    loop.Loop();
+}
@@ -0,0 +1,181 @@
+// HttpServer under a closed-loop load generator on the same machine: every
+// client connection is keep-alive and sends its next request as soon as
+// the previous response arrived. Prints one JSON object with requests/sec
+// and latency percentiles.
+//
+//   http_bench [connections=10000] [seconds=10] [server_threads=0] [client_threads=2]
+//
+// Each connection costs two fds, raise the limit (ulimit -n) for big runs.
+#include "bench_common.hpp"
+#include "http_server.hpp"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <atomic>
+
+using namespace muduo_study;
+
+namespace {
+
+constexpr uint16_t kPort = 19880;
+constexpr std::string_view kRequest = "GET /hello HTTP/1.1\r\nHost: localhost\r\nUser-Agent: http_bench\r\n\r\n";
+
+using Clock = std::chrono::steady_clock;
+
+int Connect() {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    InetAddress addr{"127.0.0.1", kPort};
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(addr.sockaddr()), sizeof(sockaddr_in)) == -1) {
+        perror("connect");
+        exit(1);
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// One blocking round trip, tells how long a response is.
+size_t ResponseSize() {
+    auto fd = Connect();
+    ::write(fd, kRequest.data(), kRequest.size());
+    std::string response;
+    char buf[4096];
+    while (response.find("\r\n\r\nhello") == response.npos) {
+        auto n = ::read(fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        response.append(buf, n);
+    }
+    ::close(fd);
+    return response.size();
+}
+
+struct ClientResult {
+    std::vector<uint32_t> latencies_us;
+    uint64_t requests = 0;
+    // Closed once the server stopped.
+    std::vector<int> fds;
+};
+
+// Drives its share of connections from one epoll loop until stop is set.
+void RunClient(int connections, size_t response_size, const std::atomic_bool& stop, ClientResult* result) {
+    struct Conn {
+        int fd;
+        size_t received;
+        Clock::time_point sent;
+    };
+    std::vector<Conn> conns(connections);
+    int epfd = ::epoll_create1(EPOLL_CLOEXEC);
+    for (int i = 0; i < connections; i++) {
+        conns[i].fd = Connect();
+        epoll_event ev{EPOLLIN, {.u32 = static_cast<uint32_t>(i)}};
+        ::epoll_ctl(epfd, EPOLL_CTL_ADD, conns[i].fd, &ev);
+    }
+    for (auto& conn : conns) {
+        conn.received = 0;
+        conn.sent = Clock::now();
+        ::write(conn.fd, kRequest.data(), kRequest.size());
+    }
+    std::vector<epoll_event> events(1024);
+    char buf[65536];
+    while (!stop.load(std::memory_order_relaxed)) {
+        auto n = ::epoll_wait(epfd, events.data(), static_cast<int>(events.size()), 100);
+        for (int i = 0; i < n; i++) {
+            auto& conn = conns[events[i].data.u32];
+            auto r = ::read(conn.fd, buf, sizeof(buf));
+            if (r <= 0) {
+                fprintf(stderr, "connection lost\n");
+                exit(1);
+            }
+            conn.received += r;
+            if (conn.received < response_size) continue;
+            auto now = Clock::now();
+            result->latencies_us.push_back(static_cast<uint32_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(now - conn.sent).count()));
+            ++result->requests;
+            conn.received -= response_size;
+            conn.sent = now;
+            ::write(conn.fd, kRequest.data(), kRequest.size());
+        }
+    }
+    for (auto& conn : conns) {
+        result->fds.push_back(conn.fd);
+    }
+    ::close(epfd);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int connections = bench::Arg(argc, argv, 1, 10000);
+    int seconds = bench::Arg(argc, argv, 2, 10);
+    int server_threads = bench::Arg(argc, argv, 3, 0);
+    int client_threads = bench::Arg(argc, argv, 4, 2);
+
+    bench::RaiseFdLimit();
+    rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    auto max_connections = static_cast<int>((limit.rlim_cur - 64) / 2);
+    if (connections > max_connections) {
+        fprintf(stderr, "fd limit %lu allows %d connections\n", limit.rlim_cur, max_connections);
+        connections = max_connections;
+    }
+
+    // Connection logs would dominate. The server's threads keep serving
+    // until it is destroyed and log the resets of the closing clients.
+    std::ostream discard{nullptr};
+    Logger::set_ostream(Logger::kInfo, discard);
+    Logger::set_ostream(Logger::kError, discard);
+    EventLoop loop;
+    HttpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "http_bench"};
+    server.set_thread_num(server_threads);
+    server.set_http_callback([](const HttpRequest&, HttpResponse* resp){
+        resp->set_content_type("text/plain");
+        resp->set_body(std::string_view{"hello"});
+    });
+    server.Start();
+
+    std::atomic_bool stop{false};
+    std::vector<ClientResult> results(client_threads);
+    std::jthread driver([&]{
+        auto response_size = ResponseSize();
+        std::vector<std::jthread> clients;
+        for (int i = 0; i < client_threads; i++) {
+            auto share = connections / client_threads + (i < connections % client_threads);
+            clients.emplace_back(RunClient, share, response_size, std::cref(stop), &results[i]);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        stop = true;
+        clients.clear();
+        loop.Quit();
+    });
+    loop.Loop();
+    driver.join();
+
+    std::vector<uint32_t> latencies;
+    uint64_t requests = 0;
+    for (auto& result : results) {
+        for (auto fd : result.fds) {
+            ::close(fd);
+        }
+        latencies.insert(latencies.end(), result.latencies_us.begin(), result.latencies_us.end());
+        requests += result.requests;
+    }
+    std::ranges::sort(latencies);
+    auto us = [&](double p) { return latencies.empty() ? 0u : bench::Percentile(latencies, p); };
+    bench::Json{}
+        .Add("benchmark", "http")
+        .Add("connections", connections)
+        .Add("server_threads", server_threads)
+        .Add("client_threads", client_threads)
+        .Add("seconds", seconds)
+        .Add("requests", requests)
+        .Add("requests_per_sec", static_cast<double>(requests) / seconds)
+        .Begin("latency_us")
+            .Add("p50", us(0.5))
+            .Add("p90", us(0.9))
+            .Add("p99", us(0.99))
+            .Add("p999", us(0.999))
+            .Add("max", us(1.0))
+        .End()
+        .Print();
+}
@@ -0,0 +1,215 @@
+// In-process microbenchmarks for the primitives under the network paths:
+// Buffer, EventLoop::QueueInLoop, poller updates, Channel dispatch and the
+// Logger. Each case prints one JSON object with ns/op and heap
+// allocations/op, counted over all threads.
+//
+//   micro_bench [filter] [max_producers=hardware threads]
+//
+// Only the cases whose name contains filter are run.
+#include "alloc_counter.hpp"
+#include "bench_common.hpp"
+#include "buffer.hpp"
+#include "event_loop.hpp"
+#include <sys/eventfd.h>
+#include <array>
+#include <random>
+
+using namespace muduo_study;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char* filter = "";
+unsigned max_producers = std::max(1u, std::thread::hardware_concurrency());
+
+// Runs f, which does ops operations, and prints the result. extra adds
+// case specific fields.
+template<typename F, typename Extra = void(*)(bench::Json&)>
+void Run(std::string_view name, size_t ops, F&& f, Extra extra = [](bench::Json&){}) {
+    if (!name.contains(filter)) return;
+    auto allocs = bench::AllocCount();
+    auto start = Clock::now();
+    f();
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    allocs = bench::AllocCount() - allocs;
+    bench::Json json;
+    json.Add("benchmark", "micro")
+        .Add("case", name)
+        .Add("ops", ops)
+        .Add("ns_per_op", elapsed / ops)
+        .Add("allocs_per_op", static_cast<double>(allocs) / ops);
+    extra(json);
+    json.Print();
+}
+
+// Mostly small, sometimes big, like reads off a busy connection.
+std::array<size_t, 256> MixedSizes(uint32_t seed) {
+    std::mt19937 rng{seed};
+    std::array<size_t, 256> sizes;
+    for (auto& size : sizes) {
+        size = rng() % 8 == 0 ? 1024 + rng() % 15360 : 1 + rng() % 512;
+    }
+    return sizes;
+}
+
+void BufferCases() {
+    static char data[16384];
+    constexpr size_t kOps = 10'000'000;
+    auto appends = MixedSizes(1);
+    auto retrieves = MixedSizes(2);
+
+    // The reader lags behind up to 64 KiB, so the readable part moves
+    // around and MakeSpace() has to compact or grow.
+    Run("buffer_append_retrieve_mixed", kOps, [&]{
+        Buffer buf;
+        for (size_t i = 0; i < kOps; i++) {
+            buf.Append(std::span(data, appends[i % appends.size()]));
+            auto readable = buf.readable_bytes();
+            buf.Retrieve(readable > 64 * 1024 ? readable : std::min(readable, retrieves[(i * 7) % retrieves.size()]));
+        }
+    });
+
+    // A fresh buffer per op, growing to 64 KiB, with and without a pool.
+    constexpr size_t kBuffers = 200'000;
+    auto grow = [&](auto make) {
+        return [&, make]{
+            for (size_t i = 0; i < kBuffers; i++) {
+                auto buf = make();
+                for (size_t n = 0; n < 64 * 1024; n += 1024) {
+                    buf.EnsureWritableBytes(1024);
+                    buf.HasWriten(1024);
+                }
+            }
+        };
+    };
+    Run("buffer_make_space_grow", kBuffers, grow([]{ return Buffer{}; }));
+    auto pool = std::make_shared<BufferPool>();
+    Run("buffer_make_space_grow_pooled", kBuffers, grow([pool]{ return Buffer{pool}; }));
+}
+
+void QueueInLoopCases(EventLoop& loop) {
+    constexpr size_t kOpsPerProducer = 1'000'000;
+    for (unsigned producers = 1; producers <= max_producers; producers *= 2) {
+        auto ops = producers * kOpsPerProducer;
+        Run(std::format("queue_in_loop_{}_producers", producers), ops, [&]{
+            size_t done = 0;
+            std::latch start{producers + 1};
+            std::vector<std::jthread> threads;
+            for (unsigned i = 0; i < producers; i++) {
+                threads.emplace_back([&]{
+                    start.arrive_and_wait();
+                    for (size_t n = 0; n < kOpsPerProducer; n++) {
+                        loop.QueueInLoop([&]{
+                            if (++done == ops) loop.Quit();
+                        });
+                    }
+                });
+            }
+            start.arrive_and_wait();
+            loop.Loop();
+        }, [&](bench::Json& json){ json.Add("producers", producers); });
+    }
+}
+
+// Register and unregister n eventfds, flushed by one loop iteration per
+// round the way the loop applies channel updates.
+void PollerCases(EventLoop& loop) {
+    constexpr int kFds = 10000;
+    constexpr int kRounds = 100;
+    std::vector<std::unique_ptr<Channel>> channels;
+    for (int i = 0; i < kFds; i++) {
+        channels.push_back(std::make_unique<Channel>(&loop, ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)));
+    }
+    auto iterate = [&]{
+        loop.QueueInLoop([&]{ loop.Quit(); });
+        loop.Loop();
+    };
+    Run("poller_update_channel", static_cast<size_t>(kFds) * kRounds, [&]{
+        for (int round = 0; round < kRounds; round++) {
+            for (auto& channel : channels) {
+                if (round % 2 == 0) channel->EnableReading();
+                else channel->DisableReading();
+            }
+            iterate();
+        }
+    }, [&](bench::Json& json){ json.Add("fds", kFds); });
+    // Interest flipped back before the flush costs no syscall.
+    Run("poller_update_channel_coalesced", static_cast<size_t>(kFds) * kRounds, [&]{
+        for (int round = 0; round < kRounds; round++) {
+            for (auto& channel : channels) {
+                channel->EnableReading();
+                channel->DisableReading();
+            }
+            iterate();
+        }
+    }, [&](bench::Json& json){ json.Add("fds", kFds); });
+    for (auto& channel : channels) {
+        channel->DisableAll();
+        channel->Remove();
+        ::close(channel->fd());
+    }
+    iterate();
+}
+
+void ChannelCases(EventLoop& loop) {
+    constexpr size_t kOps = 50'000'000;
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    Channel channel{&loop, fd};
+    size_t reads = 0;
+    channel.set_read_callback([&](time_point){ ++reads; });
+    channel.set_revents(EPOLLIN);
+    auto now = std::chrono::system_clock::now();
+    Run("channel_handle_event", kOps, [&]{
+        for (size_t i = 0; i < kOps; i++) {
+            channel.HandleEvent(now);
+        }
+    });
+    // Tied to its owner like a TcpConnection's channel.
+    auto owner = std::make_shared<int>();
+    channel.Tie(owner);
+    Run("channel_handle_event_tied", kOps, [&]{
+        for (size_t i = 0; i < kOps; i++) {
+            channel.HandleEvent(now);
+        }
+    });
+    ::close(fd);
+}
+
+void LoggerCases() {
+    constexpr size_t kOps = 2'000'000;
+    // Still referenced by the Logger afterwards.
+    static std::ostringstream sink;
+    Logger::set_ostream(Logger::kInfo, sink);
+    Logger::set_ostream(Logger::kDebug, sink);
+    Run("logger_info", kOps, [&]{
+        for (size_t i = 0; i < kOps; i++) {
+            MUDUO_STUDY_LOG_INFO("new connection [{}#{}] from {}", "server", i, "127.0.0.1:34567");
+            if (sink.tellp() > (1 << 20)) sink.str({});
+        }
+    });
+    // Below the level, the arguments aren't evaluated either.
+    Logger::set_level(Logger::kInfo);
+    Channel channel{nullptr, -1};
+    Run("logger_debug_disabled", kOps, [&]{
+        for (size_t i = 0; i < kOps; i++) {
+            MUDUO_STUDY_LOG_DEBUG("epoll_ctl({}, {})", i, channel.events_str());
+        }
+    });
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    filter = argc > 1 ? argv[1] : "";
+    max_producers = bench::Arg(argc, argv, 2, max_producers);
+    // The loop's own debug lines would be measured too.
+    std::ostream discard{nullptr};
+    Logger::set_ostream(Logger::kDebug, discard);
+    EventLoop loop;
+    BufferCases();
+    QueueInLoopCases(loop);
+    PollerCases(loop);
+    ChannelCases(loop);
+    LoggerCases();
+}
@@ -0,0 +1,123 @@
+// Ping-pong throughput over loopback, after muduo's pingpong test: every
+// client connection starts with one message and both sides echo whatever
+// arrives, so each connection keeps `size` bytes in flight. The clients
+// are TcpClients on their own loops. Prints one JSON object.
+//
+//   pingpong_bench [connections=100] [size=16384] [seconds=10] [server_threads=0] [client_threads=1]
+#include "bench_common.hpp"
+#include "tcp_client.hpp"
+#include "tcp_server.hpp"
+#include <atomic>
+
+using namespace muduo_study;
+
+namespace {
+
+constexpr uint16_t kPort = 19881;
+
+void Echo(const TcpConnectionPtr& conn, Buffer* buf) {
+    conn->Send(std::span(buf->peek(), buf->readable_bytes()));
+    buf->RetrieveAll();
+}
+
+// The connections of one client thread.
+class Session
+{
+public:
+    Session(EventLoop* loop, int connections, size_t size, std::atomic_int* connected) :
+        message_(size, 'x')
+    {
+        for (int i = 0; i < connections; i++) {
+            auto& client = clients_.emplace_back(std::make_unique<TcpClient>(loop, InetAddress{"127.0.0.1", kPort}, "pingpong"));
+            client->set_connection_callback([this, connected](const TcpConnectionPtr conn){
+                if (!conn->connected()) return;
+                conn->set_tcp_no_dealy(true);
+                connected->fetch_add(1);
+                conn->Send(std::span<const char>(message_));
+            });
+            client->set_message_callback([this](const TcpConnectionPtr conn, Buffer* buf, time_point){
+                bytes_.fetch_add(buf->readable_bytes(), std::memory_order_relaxed);
+                messages_.fetch_add(1, std::memory_order_relaxed);
+                Echo(conn, buf);
+            });
+            client->Connect();
+        }
+    }
+
+    uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+    uint64_t messages() const { return messages_.load(std::memory_order_relaxed); }
+
+private:
+    std::string message_;
+    std::vector<std::unique_ptr<TcpClient>> clients_;
+    std::atomic_uint64_t bytes_{0};
+    std::atomic_uint64_t messages_{0};
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int connections = bench::Arg(argc, argv, 1, 100);
+    size_t size = bench::Arg(argc, argv, 2, 16384);
+    int seconds = bench::Arg(argc, argv, 3, 10);
+    int server_threads = bench::Arg(argc, argv, 4, 0);
+    int client_threads = bench::Arg(argc, argv, 5, 1);
+    bench::RaiseFdLimit();
+
+    // Connection logs would dominate. The server's threads keep serving
+    // until it is destroyed and log the resets of the closing clients.
+    std::ostream discard{nullptr};
+    Logger::set_ostream(Logger::kInfo, discard);
+    Logger::set_ostream(Logger::kError, discard);
+    EventLoop loop;
+    TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "pingpong"};
+    server.set_thread_num(server_threads);
+    server.set_connection_callback([](const TcpConnectionPtr conn){
+        if (conn->connected()) conn->set_tcp_no_dealy(true);
+    });
+    server.set_message_callback([](const TcpConnectionPtr conn, Buffer* buf, time_point){ Echo(conn, buf); });
+    server.Start();
+
+    std::jthread driver([&]{
+        std::atomic_int connected{0};
+        bench::ClientThreads<Session> clients{client_threads, [&](EventLoop* client_loop, int i){
+            auto share = connections / client_threads + (i < connections % client_threads);
+            return std::make_unique<Session>(client_loop, share, size, &connected);
+        }};
+        while (connected.load() < connections) {
+            std::this_thread::sleep_for(1ms);
+        }
+        auto total = [&]{
+            std::pair<uint64_t, uint64_t> sum{};
+            for (auto session : clients.sessions()) {
+                sum.first += session->bytes();
+                sum.second += session->messages();
+            }
+            return sum;
+        };
+        // Counted from after the ramp-up.
+        auto start_time = std::chrono::steady_clock::now();
+        auto start = total();
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        auto end = total();
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        loop.Quit();
+        clients.Stop();
+
+        auto bytes = end.first - start.first;
+        auto messages = end.second - start.second;
+        bench::Json{}
+            .Add("benchmark", "pingpong")
+            .Add("connections", connections)
+            .Add("message_size", size)
+            .Add("server_threads", server_threads)
+            .Add("client_threads", client_threads)
+            .Add("seconds", elapsed)
+            .Add("bytes", bytes)
+            .Add("messages", messages)
+            .Add("mib_per_sec", bytes / elapsed / (1024 * 1024))
+            .Add("messages_per_sec", messages / elapsed)
+            .Print();
+    });
+    loop.Loop();
+}
@@ -0,0 +1,52 @@
+// Compares the growable Buffer with the double-mapped ring on a stream
+// parser's access pattern: append a read's worth of bytes, consume whole
+// frames, leave the partial frame at the end for the next read. The
+// growable buffer has to move that tail to the front every so often, the
+// ring never does.
+#include "buffer.hpp"
+#include <chrono>
+#include <cstdio>
+
+using namespace muduo_study;
+
+namespace {
+
+constexpr size_t kTotalBytes = size_t{2} << 30;
+
+volatile size_t sink;
+
+double GiBPerSec(Buffer& buffer, size_t chunk, size_t frame) {
+    std::string data(chunk, 'x');
+    size_t acc = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < kTotalBytes; done += chunk) {
+        buffer.Append(data);
+        while (buffer.readable_bytes() >= frame) {
+            acc += buffer.peek()[frame - 1];
+            buffer.Retrieve(frame);
+        }
+    }
+    sink = acc;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return kTotalBytes / elapsed.count() / (1 << 30);
+}
+
+} // namespace
+
+int main() {
+    printf("%zu GiB streamed, throughput in GiB/s:\n", kTotalBytes >> 30);
+    for (size_t chunk : {4096, 32768, 65536}) {
+        // Frames that don't divide the chunk leave a tail behind every time.
+        for (size_t frame : {100, 1000, 3000, 12345}) {
+            Buffer flat{chunk * 2};
+            auto ring = Buffer::CreateRing(chunk * 2);
+            if (!ring.has_value()) {
+                fprintf(stderr, "CreateRing failed: %s\n", strerror(ring.error()));
+                return 1;
+            }
+            auto flat_rate = GiBPerSec(flat, chunk, frame);
+            auto ring_rate = GiBPerSec(ring.value(), chunk, frame);
+            printf("chunk %6zu frame %6zu  Buffer %6.2f  ring %6.2f\n", chunk, frame, flat_rate, ring_rate);
+        }
+    }
+}
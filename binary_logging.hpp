@@ -0,0 +1,475 @@
+#pragma once
+#include "logger.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// One per log statement, in static storage. Its address is the format id
+// recorded instead of the text, the format string and the function that
+// decodes the arguments are filled in by the statement's first call.
+struct LogSite
+{
+    using Formatter = void (*)(std::string_view fmt, const char* args, std::string& line);
+
+    constexpr LogSite(const char* file, const char* func, size_t line, Logger::Level level) :
+        file{file},
+        func{func},
+        line{line},
+        level{level},
+        fmt{nullptr},
+        fmt_size{0},
+        formatter{nullptr} {}
+
+    const char* file;
+    const char* func;
+    size_t line;
+    Logger::Level level;
+    // Threads racing on the first call store the same values.
+    std::atomic<const char*> fmt;
+    std::atomic<size_t> fmt_size;
+    std::atomic<Formatter> formatter;
+};
+
+namespace details {
+
+// Copied as length and bytes, decoded as a std::string_view.
+template<typename T>
+concept LogStringArg = std::same_as<T, const char*> || std::same_as<T, char*> ||
+                       std::same_as<T, std::string> || std::same_as<T, std::string_view>;
+// Copied bitwise, so it must not refer to memory that may be gone by the
+// time the record is formatted.
+template<typename T>
+concept LogRawArg = !LogStringArg<T> && std::is_trivially_copyable_v<T>;
+template<typename T>
+concept LogArg = LogStringArg<T> || LogRawArg<T>;
+
+template<LogArg T>
+size_t EncodedSize(const T& arg) {
+    if constexpr (LogStringArg<T>) {
+        return sizeof(uint32_t) + std::string_view{arg}.size();
+    }
+    else {
+        return sizeof(T);
+    }
+}
+
+template<LogArg T>
+char* Encode(char* p, const T& arg) {
+    if constexpr (LogStringArg<T>) {
+        std::string_view str{arg};
+        auto size = static_cast<uint32_t>(str.size());
+        memcpy(p, &size, sizeof(size));
+        memcpy(p + sizeof(size), str.data(), size);
+        return p + sizeof(size) + size;
+    }
+    else {
+        memcpy(p, std::addressof(arg), sizeof(T));
+        return p + sizeof(T);
+    }
+}
+
+template<LogArg T>
+auto Decode(const char*& p) {
+    if constexpr (LogStringArg<T>) {
+        uint32_t size;
+        memcpy(&size, p, sizeof(size));
+        std::string_view str{p + sizeof(size), size};
+        p += sizeof(size) + size;
+        return str;
+    }
+    else {
+        std::array<char, sizeof(T)> bytes;
+        memcpy(bytes.data(), p, sizeof(T));
+        p += sizeof(T);
+        return std::bit_cast<T>(bytes);
+    }
+}
+
+template<typename... Args>
+void FormatRecord(std::string_view fmt, const char* p, std::string& line) {
+    // Braced, so the arguments are decoded left to right.
+    std::tuple<decltype(Decode<Args>(p))...> values{Decode<Args>(p)...};
+    std::apply([&](auto&... args) {
+        std::vformat_to(std::back_inserter(line), fmt, std::make_format_args(args...));
+    }, values);
+}
+
+} // namespace details
+
+// Single producer single consumer ring of records, each contiguous and 8
+// byte aligned. A record that doesn't fit before the end starts over at
+// the beginning, behind a zero size marker.
+class LogRing
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(LogRing)
+
+    // capacity is a power of two.
+    explicit LogRing(size_t capacity) :
+        data_{std::make_unique_for_overwrite<char[]>(capacity)},
+        capacity_{capacity},
+        head_{0},
+        tail_{0},
+        cached_head_{0},
+        dropped_{0},
+        closed_{false} {
+        assert((capacity & (capacity - 1)) == 0);
+    }
+
+    // Producer. size is a multiple of 8 and the record begins with it as
+    // a uint32_t, fill writes it. False when the ring is full.
+    template<typename F>
+    bool TryWrite(size_t size, F&& fill) {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        auto offset = tail & (capacity_ - 1);
+        auto skip = offset + size > capacity_ ? capacity_ - offset : 0;
+        if (tail + skip + size - cached_head_ > capacity_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail + skip + size - cached_head_ > capacity_) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        if (skip > 0) {
+            uint32_t marker = 0;
+            memcpy(data_.get() + offset, &marker, sizeof(marker));
+            offset = 0;
+        }
+        fill(data_.get() + offset);
+        tail_.store(tail + skip + size, std::memory_order_release);
+        return true;
+    }
+    // The writing thread exited.
+    void Close() noexcept { closed_.store(true, std::memory_order_release); }
+
+    // Consumer. Calls f on every record written so far, returns how many.
+    template<typename F>
+    size_t Drain(F&& f) {
+        auto head = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_acquire);
+        size_t n = 0;
+        while (head != tail) {
+            auto offset = head & (capacity_ - 1);
+            uint32_t size;
+            memcpy(&size, data_.get() + offset, sizeof(size));
+            if (size == 0) {
+                head += capacity_ - offset;
+                continue;
+            }
+            f(data_.get() + offset);
+            head += size;
+            ++n;
+            // Gives the space back to the producer as soon as possible.
+            head_.store(head, std::memory_order_release);
+        }
+        head_.store(head, std::memory_order_release);
+        return n;
+    }
+    bool closed() const noexcept { return closed_.load(std::memory_order_acquire); }
+    size_t TakeDropped() noexcept { return dropped_.exchange(0, std::memory_order_relaxed); }
+
+private:
+    const std::unique_ptr<char[]> data_;
+    const size_t capacity_;
+    // Apart, the producer and the consumer would share a cache line.
+    alignas(64) std::atomic_size_t head_;
+    alignas(64) std::atomic_size_t tail_;
+    size_t cached_head_;
+    std::atomic_size_t dropped_;
+    std::atomic_bool closed_;
+};
+
+// NanoLog style deferred formatting behind the usual macros. Built with
+// -DMUDUO_STUDY_LOG_BINARY, a log statement copies only its LogSite
+// address, the time, errno and the raw argument bytes into a ring of its
+// own thread, no locks and no formatting. A background thread turns the
+// records into the same lines Logger writes, to the streams set with
+// Logger::set_ostream(). Lines of one thread stay in order.
+//
+//   BinaryLogging log;
+//   log.Start();
+//
+// Until Start() and after Stop() the statements write synchronously, so do
+// Fatal ones, after the records before them were written. Arguments that
+// are neither strings nor trivially copyable are formatted by the caller
+// and recorded as a string. A full ring drops the record and counts it.
+// The format string must be a literal, it is read long after the call.
+class BinaryLogging
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(BinaryLogging)
+    static constexpr size_t kDefaultRingSize = 1024 * 1024;
+    static constexpr auto kDefaultPollInterval = 1ms;
+
+    // ring_size is per logging thread, a power of two.
+    explicit BinaryLogging(size_t ring_size = kDefaultRingSize,
+                           std::chrono::milliseconds poll_interval = kDefaultPollInterval) :
+        ring_size_{ring_size},
+        poll_interval_{poll_interval},
+        generation_{0},
+        running_{false},
+        total_dropped_{0},
+        flush_requested_{0},
+        flush_done_{0} {}
+    ~BinaryLogging() {
+        Stop();
+    }
+
+    auto dropped() const noexcept { return total_dropped_.load(std::memory_order_relaxed); }
+
+    // One instance at a time takes over the statements.
+    void Start() {
+        std::scoped_lock lock{mutex_};
+        if (running_) return;
+        // Rings of an earlier run are not reused. Set before the statements
+        // can see this instance.
+        generation_ = next_generation_.fetch_add(1, std::memory_order_relaxed) + 1;
+        BinaryLogging* expected = nullptr;
+        if (!active_.compare_exchange_strong(expected, this, std::memory_order_acq_rel)) {
+            MUDUO_STUDY_LOG_FATAL("BinaryLogging::Start another instance is running");
+        }
+        running_ = true;
+        thread_ = std::jthread([this]{ ThreadFunc(); });
+    }
+    // Writes out every record so far, later statements are synchronous.
+    void Stop() {
+        {
+            std::scoped_lock lock{mutex_};
+            if (!running_ || active_.load(std::memory_order_relaxed) != this) return;
+            active_.store(nullptr);
+        }
+        // Statements that still saw this instance finish their records
+        // first, the writer drains them before it exits.
+        WaitForProducers();
+        {
+            std::scoped_lock lock{mutex_};
+            running_ = false;
+        }
+        cv_.notify_one();
+        thread_.join();
+        rings_.clear();
+    }
+    // Blocks until the records written before are formatted and the
+    // streams flushed. Returns at once if the writer isn't running.
+    void Flush() {
+        std::unique_lock lock{mutex_};
+        if (!running_) return;
+        auto ticket = ++flush_requested_;
+        cv_.notify_one();
+        flushed_cv_.wait(lock, [&]{ return flush_done_ >= ticket; });
+    }
+
+    // Called by the log macros.
+    template<typename... Args>
+    static void Log(LogSite& site, int saved_errno, std::string_view fmt, Args&&... args) {
+        {
+            InFlight in_flight;
+            auto logging = active_.load();
+            if (logging && site.level != Logger::kFatal) {
+                if constexpr ((details::LogArg<std::decay_t<Args>> && ...)) {
+                    logging->Append(site, saved_errno, fmt, args...);
+                }
+                else {
+                    logging->Append(site, saved_errno, "{}", std::vformat(fmt, std::make_format_args(args...)));
+                }
+                return;
+            }
+            if (logging) logging->Flush();
+        }
+        Logger{site.file, site.func, site.line, site.level, saved_errno}.Output(fmt, std::forward<Args>(args)...);
+    }
+
+private:
+    struct RecordHeader {
+        uint32_t size;
+        int32_t saved_errno;
+        const LogSite* site;
+        int64_t micros;
+    };
+
+    // Per logging thread. Closes the ring when its thread exits, the
+    // writer drops it once empty. epoch is odd while a statement runs,
+    // only its own thread writes it, so statements of different threads
+    // share no cache line.
+    struct ThreadRing {
+        ThreadRing() : generation{0}, epoch{0}, depth{0} {
+            std::scoped_lock lock{threads_mutex_};
+            threads_.push_back(this);
+        }
+        ~ThreadRing() {
+            if (ring) ring->Close();
+            std::scoped_lock lock{threads_mutex_};
+            std::erase(threads_, this);
+        }
+        std::shared_ptr<LogRing> ring;
+        uint64_t generation;
+        std::atomic_uint64_t epoch;
+        // Statements nested in an argument's formatting.
+        int depth;
+    };
+    // Made odd before active_ is read, and Stop() checks every thread's
+    // epoch after clearing it. Both sides are seq_cst, either the
+    // statement sees nullptr or Stop() sees it running.
+    struct InFlight {
+        InFlight() : thread{thread_ring_} {
+            if (thread.depth++ == 0) {
+                thread.epoch.store(thread.epoch.load(std::memory_order_relaxed) + 1);
+            }
+        }
+        ~InFlight() {
+            if (--thread.depth == 0) {
+                thread.epoch.store(thread.epoch.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+        }
+        ThreadRing& thread;
+    };
+
+    // Waits for the statements running right now, one thread at a time.
+    // Any change of an odd epoch means that statement is done, the next
+    // one already sees active_ cleared, so this never waits on a thread
+    // that keeps logging. A thread can't exit mid statement, holding the
+    // lock keeps the others registered.
+    static void WaitForProducers() {
+        std::scoped_lock lock{threads_mutex_};
+        for (auto thread : threads_) {
+            auto epoch = thread->epoch.load();
+            if (epoch % 2 == 0) continue;
+            while (thread->epoch.load(std::memory_order_acquire) == epoch) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    template<typename... Args>
+    void Append(LogSite& site, int saved_errno, std::string_view fmt, Args&&... args) {
+        if (!site.formatter.load(std::memory_order_acquire)) {
+            site.fmt.store(fmt.data(), std::memory_order_relaxed);
+            site.fmt_size.store(fmt.size(), std::memory_order_relaxed);
+            site.formatter.store(&details::FormatRecord<std::decay_t<Args>...>, std::memory_order_release);
+        }
+        auto size = sizeof(RecordHeader) + (details::EncodedSize<std::decay_t<Args>>(args) + ... + 0);
+        size = (size + 7) & ~size_t{7};
+        if (size > ring_size_) return;
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        ThisThreadRing().TryWrite(size, [&](char* p) {
+            RecordHeader header{static_cast<uint32_t>(size), saved_errno, &site, micros};
+            memcpy(p, &header, sizeof(header));
+            p += sizeof(header);
+            ((p = details::Encode<std::decay_t<Args>>(p, args)), ...);
+        });
+    }
+
+    LogRing& ThisThreadRing() {
+        auto& local = thread_ring_;
+        if (local.generation != generation_) [[unlikely]] {
+            if (local.ring) local.ring->Close();
+            local.ring = std::make_shared<LogRing>(ring_size_);
+            local.generation = generation_;
+            std::scoped_lock lock{mutex_};
+            rings_.push_back(local.ring);
+        }
+        return *local.ring;
+    }
+
+    void ThreadFunc() {
+        std::vector<std::shared_ptr<LogRing>> rings;
+        std::vector<LogRing*> retired;
+        std::vector<std::ostream*> dirty;
+        std::string line;
+        line.reserve(512);
+        bool running = true;
+        while (running) {
+            uint64_t flush_ticket;
+            {
+                std::scoped_lock lock{mutex_};
+                rings.assign(rings_.begin(), rings_.end());
+                flush_ticket = flush_requested_;
+                running = running_;
+            }
+            size_t n = 0;
+            size_t dropped = 0;
+            for (auto& ring : rings) {
+                // Closed before the drain, nothing can follow.
+                if (ring->closed()) retired.push_back(ring.get());
+                n += ring->Drain([&](const char* record) { Write(record, line, dirty); });
+                dropped += ring->TakeDropped();
+            }
+            if (!retired.empty()) {
+                std::scoped_lock lock{mutex_};
+                std::erase_if(rings_, [&](auto& ring) {
+                    return std::ranges::find(retired, ring.get()) != retired.end();
+                });
+                retired.clear();
+            }
+            if (dropped > 0) {
+                total_dropped_.fetch_add(dropped, std::memory_order_relaxed);
+                Logger{__FILE__, __func__, __LINE__, Logger::kWarning}.Output(
+                    "BinaryLogging dropped {} messages, the writer fell behind", dropped);
+            }
+            // Kept until idle, flushing every pass would cost a write per
+            // few records.
+            if (n == 0 || flush_ticket != flush_done_ || !running) {
+                for (auto out : dirty) out->flush();
+                dirty.clear();
+            }
+            {
+                std::unique_lock lock{mutex_};
+                flush_done_ = flush_ticket;
+                flushed_cv_.notify_all();
+                if (n == 0 && running_) {
+                    cv_.wait_for(lock, poll_interval_, [&]{
+                        return !running_ || flush_requested_ != flush_ticket;
+                    });
+                }
+            }
+        }
+    }
+
+    static void Write(const char* record, std::string& line, std::vector<std::ostream*>& dirty) {
+        RecordHeader header;
+        memcpy(&header, record, sizeof(header));
+        auto& site = *header.site;
+        std::string_view fmt{site.fmt.load(std::memory_order_relaxed), site.fmt_size.load(std::memory_order_relaxed)};
+        Logger logger{site.file, site.func, site.line, site.level, header.saved_errno};
+        line.clear();
+        logger.AppendPrefix(line, header.micros);
+        site.formatter.load(std::memory_order_acquire)(fmt, record + sizeof(header), line);
+        logger.AppendSuffix(line);
+        auto& out = Logger::out_manager_[site.level].second.get();
+        out.write(line.data(), static_cast<std::streamsize>(line.size()));
+        if (std::ranges::find(dirty, &out) == dirty.end()) {
+            dirty.push_back(&out);
+        }
+    }
+
+    static inline std::atomic<BinaryLogging*> active_{nullptr};
+    static inline std::atomic_uint64_t next_generation_{0};
+    static inline std::mutex threads_mutex_;
+    static inline std::vector<ThreadRing*> threads_;
+    static inline thread_local ThreadRing thread_ring_;
+
+    const size_t ring_size_;
+    const std::chrono::milliseconds poll_interval_;
+    uint64_t generation_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable flushed_cv_;
+    std::vector<std::shared_ptr<LogRing>> rings_;
+    bool running_;
+    std::atomic_uint64_t total_dropped_;
+    uint64_t flush_requested_;
+    uint64_t flush_done_;
+    std::jthread thread_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
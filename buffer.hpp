@@ -1,29 +1,141 @@
 #pragma once
-#include "core.hpp"
+#include "logger.hpp"
+#include "buffer_pool.hpp"
+#include "byte_search.hpp"
 #include <span>
 #include <ranges>
+#include <algorithm>
+#include <utility>
+#include <bit>
 #include <sys/uio.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 MUDUO_STUDY_BEGIN_NAMESPACE
 
+// int8_t to int64_t and their unsigned versions, what Buffer reads and
+// writes in network byte order.
+template<typename T>
+concept NetworkInteger = std::integral<T> && !std::same_as<T, bool> && sizeof(T) <= 8;
+
+template<NetworkInteger T>
+inline T HostToNetwork(T x) noexcept {
+    if constexpr (std::endian::native == std::endian::little) {
+        return std::byteswap(x);
+    }
+    else {
+        return x;
+    }
+}
+template<NetworkInteger T>
+inline T NetworkToHost(T x) noexcept {
+    return HostToNetwork(x);
+}
+
+// Storage is allocated on first write, not up front. A Buffer given a
+// BufferPool takes its storage from there and hands it back as soon as it
+// is drained, so an idle connection holds no buffer memory at all. Either
+// way a buffer that ballooned for one large message gives that storage up
+// once drained. Retrieve(len) never moves the storage, pointers from
+// peek() stay valid until the next write, RetrieveAll() or Shrink().
+//
+// CreateRing() makes a ring buffer instead: a memfd mapped twice back to
+// back, so the readable bytes are contiguous for peek() even when they wrap
+// and MakeSpace() never has to move them to the front. The mapping is kept
+// for the buffer's lifetime, it only pays off on busy streams.
 class Buffer
 {
 public:
+    MUDUO_STUDY_NONCOPYABLE(Buffer)
     static constexpr size_t kCheapPrepend = 8;
     static constexpr size_t kInitialSize = 1024;
+    // Capacities from here on are freed by RetrieveAll() even without a pool.
+    static constexpr size_t kShrinkThreshold = 64 * 1024;
 
     explicit Buffer(size_t initial_size = kInitialSize) :
-        buffer_(kCheapPrepend + kInitialSize),
+        Buffer{nullptr, initial_size} {}
+    explicit Buffer(std::shared_ptr<BufferPool> pool, size_t initial_size = kInitialSize) :
+        pool_{std::move(pool)},
+        data_{no_storage_},
+        capacity_{kCheapPrepend},
+        initial_size_{initial_size},
         reader_index_{kCheapPrepend},
-        writer_index_{kCheapPrepend}
+        writer_index_{kCheapPrepend},
+        ring_size_{0}
     {}
+    Buffer(Buffer&& other) noexcept :
+        pool_{std::move(other.pool_)},
+        data_{std::exchange(other.data_, other.no_storage_)},
+        capacity_{std::exchange(other.capacity_, kCheapPrepend)},
+        initial_size_{other.initial_size_},
+        reader_index_{std::exchange(other.reader_index_, kCheapPrepend)},
+        writer_index_{std::exchange(other.writer_index_, kCheapPrepend)},
+        ring_size_{std::exchange(other.ring_size_, 0)}
+    {
+        if (data_ == other.no_storage_) {
+            data_ = no_storage_;
+        }
+    }
+    Buffer& operator=(Buffer&& other) noexcept {
+        if (this != &other) {
+            FreeStorage();
+            pool_ = std::move(other.pool_);
+            data_ = other.has_storage() ? std::exchange(other.data_, other.no_storage_) : no_storage_;
+            capacity_ = std::exchange(other.capacity_, kCheapPrepend);
+            initial_size_ = other.initial_size_;
+            reader_index_ = std::exchange(other.reader_index_, kCheapPrepend);
+            writer_index_ = std::exchange(other.writer_index_, kCheapPrepend);
+            ring_size_ = std::exchange(other.ring_size_, 0);
+        }
+        return *this;
+    }
+    ~Buffer() {
+        FreeStorage();
+    }
+
+    // Ring capacity is min_size rounded up to whole pages. Fails with the
+    // errno of memfd_create/ftruncate/mmap.
+    static auto CreateRing(size_t min_size) -> std::expected<Buffer, int> {
+        auto map = MapRing(min_size);
+        if (!map.has_value()) {
+            return std::unexpected(map.error());
+        }
+        Buffer buffer;
+        buffer.data_ = map->data;
+        buffer.capacity_ = buffer.ring_size_ = map->size;
+        buffer.reader_index_ = buffer.writer_index_ = 0;
+        return buffer;
+    }
 
     auto readable_bytes() const noexcept { return writer_index_ - reader_index_; }
-    auto writable_bytes() const noexcept { return buffer_.size() - writer_index_; }
-    auto prependable_bytes() const noexcept { return reader_index_; }
-    auto peek() const noexcept { return &buffer_[reader_index_]; }
-    auto begin_write() noexcept { return &buffer_[writer_index_]; }
-    auto begin_write() const noexcept { return &buffer_[writer_index_]; }
+    auto writable_bytes() const noexcept {
+        return ring_size_ ? ring_size_ - readable_bytes() : capacity_ - writer_index_;
+    }
+    // A ring can prepend into its free space, wrapping backwards.
+    auto prependable_bytes() const noexcept { return ring_size_ ? writable_bytes() : reader_index_; }
+    auto capacity() const noexcept { return has_storage() ? capacity_ : 0; }
+    bool is_ring() const noexcept { return ring_size_ != 0; }
+    bool has_storage() const noexcept { return data_ != no_storage_; }
+    auto peek() const noexcept { return static_cast<const char*>(data_ + reader_index_); }
+    auto begin_write() noexcept { return data_ + writer_index_; }
+    auto begin_write() const noexcept { return static_cast<const char*>(data_ + writer_index_); }
+
+    // Search the readable bytes from start on, nullptr if not found.
+    const char* FindCRLF() const noexcept { return FindCRLF(peek()); }
+    const char* FindCRLF(const char* start) const noexcept {
+        assert(peek() <= start && start <= begin_write());
+        return MUDUO_STUDY FindCRLF(start, begin_write());
+    }
+    const char* FindEOL() const noexcept { return FindEOL(peek()); }
+    const char* FindEOL(const char* start) const noexcept {
+        assert(peek() <= start && start <= begin_write());
+        return MUDUO_STUDY FindEOL(start, begin_write());
+    }
+    const char* FindByte(char c, const char* start) const noexcept {
+        assert(peek() <= start && start <= begin_write());
+        return MUDUO_STUDY FindByte(start, begin_write(), c);
+    }
+    const char* FindByte(char c) const noexcept { return FindByte(c, peek()); }
 
     void HasWriten(size_t len) {
         assert(len <= writable_bytes());
@@ -34,13 +146,37 @@ public:
         assert(len <= readable_bytes());
         if (len < readable_bytes()) {
             reader_index_ += len;
+            // Both indices move back into the first mapping together.
+            if (ring_size_ && reader_index_ >= ring_size_) {
+                reader_index_ -= ring_size_;
+                writer_index_ -= ring_size_;
+            }
         }
         else {
             RetrieveAll();
         }
     }
     void RetrieveAll() {
+        if (ring_size_) {
+            reader_index_ = writer_index_ = 0;
+            return;
+        }
         reader_index_ = writer_index_ = kCheapPrepend;
+        if (pool_ || capacity_ >= kShrinkThreshold) {
+            FreeStorage();
+        }
+    }
+    // Moves the readable bytes into storage just big enough for them plus
+    // reserve, or drops the storage altogether when there is nothing left.
+    // Rings keep their mapping.
+    void Shrink(size_t reserve) {
+        if (ring_size_) return;
+        if (readable_bytes() == 0 && reserve == 0) {
+            reader_index_ = writer_index_ = kCheapPrepend;
+            FreeStorage();
+            return;
+        }
+        Reallocate(kCheapPrepend + readable_bytes() + reserve);
     }
 
     std::string RetrieveAllAsString() {
@@ -67,15 +203,62 @@ public:
         HasWriten(data.size());
     }
 
+    // Writes in front of the readable bytes, e.g. a length header once the
+    // body is known. Up to kCheapPrepend bytes always fit.
+    void Prepend(std::span<const char> data) {
+        assert(data.size() <= prependable_bytes());
+        if (!has_storage()) {
+            Reallocate(kCheapPrepend + initial_size_);
+        }
+        if (ring_size_ && reader_index_ < data.size()) {
+            reader_index_ += ring_size_;
+            writer_index_ += ring_size_;
+        }
+        reader_index_ -= data.size();
+        std::ranges::copy(data, data_ + reader_index_);
+    }
+
+    // Integers in network byte order. PeekInt reads offset bytes past
+    // peek(), there have to be sizeof(T) readable bytes from there.
+    template<NetworkInteger T>
+    void AppendInt(T x) {
+        x = HostToNetwork(x);
+        Append(std::span(reinterpret_cast<const char*>(&x), sizeof(x)));
+    }
+    template<NetworkInteger T>
+    void PrependInt(T x) {
+        x = HostToNetwork(x);
+        Prepend(std::span(reinterpret_cast<const char*>(&x), sizeof(x)));
+    }
+    template<NetworkInteger T>
+    T PeekInt(size_t offset = 0) const {
+        assert(readable_bytes() >= offset + sizeof(T));
+        T x;
+        std::copy(peek() + offset, peek() + offset + sizeof(T), reinterpret_cast<char*>(&x));
+        return NetworkToHost(x);
+    }
+    template<NetworkInteger T>
+    T ReadInt() {
+        auto x = PeekInt<T>();
+        Retrieve(sizeof(T));
+        return x;
+    }
+
     auto ReadFd(int fd) -> std::expected<ssize_t, int> {
         std::array<char, 65536> extrabuf;
+        return ReadFd(fd, extrabuf);
+    }
+    // Reads into the writable space and, once that is full, into scratch,
+    // whose bytes are then appended. Reserve enough with
+    // EnsureWritableBytes() beforehand and scratch is rarely touched.
+    auto ReadFd(int fd, std::span<char> scratch) -> std::expected<ssize_t, int> {
         iovec vec[2];
         auto writable = writable_bytes();
         vec[0].iov_base = begin_write();
         vec[0].iov_len = writable;
-        vec[1].iov_base = extrabuf.data();
-        vec[1].iov_len = extrabuf.size();
-        auto iovcnt = (writable < extrabuf.size()) ? 2 : 1;
+        vec[1].iov_base = scratch.data();
+        vec[1].iov_len = scratch.size();
+        auto iovcnt = (writable < scratch.size()) ? 2 : 1;
         auto n = readv(fd, vec, iovcnt);
         if (n == -1) {
             return std::unexpected(errno);
@@ -84,8 +267,8 @@ public:
             writer_index_ += n;
         }
         else {
-            writer_index_ = buffer_.size();
-            Append(extrabuf);
+            writer_index_ += writable;
+            Append(scratch.first(n - writable));
         }
         return n;
     }
@@ -95,25 +278,124 @@ public:
     }
 
 private:
+    struct RingMap {
+        char* data;
+        size_t size;
+    };
+
+    // Reserves twice the size, then maps the same memfd pages over both
+    // halves.
+    static auto MapRing(size_t min_size) -> std::expected<RingMap, int> {
+        auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        auto size = (std::max<size_t>(min_size, 1) + page - 1) / page * page;
+        auto fd = ::memfd_create("muduo_study_ring", MFD_CLOEXEC);
+        if (fd == -1) {
+            return std::unexpected(errno);
+        }
+        if (::ftruncate(fd, size) == -1) {
+            auto e = errno;
+            ::close(fd);
+            return std::unexpected(e);
+        }
+        auto base = static_cast<char*>(::mmap(nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (base == MAP_FAILED) {
+            auto e = errno;
+            ::close(fd);
+            return std::unexpected(e);
+        }
+        for (auto half : {base, base + size}) {
+            if (::mmap(half, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+                auto e = errno;
+                ::munmap(base, size * 2);
+                ::close(fd);
+                return std::unexpected(e);
+            }
+        }
+        // The mappings keep the memory alive.
+        ::close(fd);
+        return RingMap{base, size};
+    }
+
+    // A full ring grows into a bigger one, the only time its bytes move.
+    void GrowRing(size_t len) {
+        auto readable = readable_bytes();
+        auto map = MapRing(std::max(readable + len, ring_size_ * 2));
+        if (!map.has_value()) {
+            errno = map.error();
+            MUDUO_STUDY_LOG_SYSFATAL("Buffer ring mapping failed!");
+        }
+        std::copy(peek(), peek() + readable, map->data);
+        ::munmap(data_, ring_size_ * 2);
+        data_ = map->data;
+        capacity_ = ring_size_ = map->size;
+        reader_index_ = 0;
+        writer_index_ = readable;
+    }
+
     void MakeSpace(size_t len) {
-        if (writable_bytes() + prependable_bytes() < len + kCheapPrepend) {
-            buffer_.resize(writer_index_ + len);
+        if (ring_size_) {
+            GrowRing(len);
+            return;
+        }
+        if (!has_storage() || writable_bytes() + prependable_bytes() < len + kCheapPrepend) {
+            // Grow geometrically, a vector would too.
+            Reallocate(std::max({kCheapPrepend + readable_bytes() + len,
+                                 has_storage() ? capacity_ * 2 : 0,
+                                 kCheapPrepend + initial_size_}));
         }
         else {
             assert(kCheapPrepend < reader_index_);
             auto readable = readable_bytes();
-            std::copy(buffer_.begin() + reader_index_,
-                    buffer_.begin() + writer_index_,
-                    buffer_.begin() + kCheapPrepend);
+            std::copy(data_ + reader_index_,
+                    data_ + writer_index_,
+                    data_ + kCheapPrepend);
             reader_index_ = kCheapPrepend;
             writer_index_ = reader_index_ + readable;
             assert(readable == readable_bytes());
         }
     }
+    void Reallocate(size_t capacity) {
+        auto readable = readable_bytes();
+        assert(capacity >= kCheapPrepend + readable);
+        auto block = pool_ ? pool_->Acquire(capacity) : BufferPool::Block{new char[capacity], capacity};
+        std::copy(peek(), peek() + readable, block.data + kCheapPrepend);
+        FreeStorage();
+        data_ = block.data;
+        capacity_ = block.size;
+        reader_index_ = kCheapPrepend;
+        writer_index_ = reader_index_ + readable;
+    }
+    // Only valid once nothing readable is left, or right before the
+    // storage is replaced.
+    void FreeStorage() {
+        if (!has_storage()) return;
+        if (ring_size_) {
+            ::munmap(data_, ring_size_ * 2);
+            ring_size_ = 0;
+        }
+        else if (pool_) {
+            pool_->Release({data_, capacity_});
+        }
+        else {
+            delete[] data_;
+        }
+        data_ = no_storage_;
+        capacity_ = kCheapPrepend;
+        reader_index_ = std::min(reader_index_, kCheapPrepend);
+        writer_index_ = std::min(writer_index_, kCheapPrepend);
+    }
 
-    std::vector<char> buffer_;
+    std::shared_ptr<BufferPool> pool_;
+    // Points at no_storage_ until the first write, so peek()/begin_write()
+    // are always valid pointers and writable_bytes() is 0.
+    char* data_;
+    size_t capacity_;
+    size_t initial_size_;
     size_t reader_index_;
     size_t writer_index_;
+    // Non-zero in ring mode, data_ then spans twice this many bytes.
+    size_t ring_size_;
+    char no_storage_[kCheapPrepend];
 };
 
 MUDUO_STUDY_END_NAMESPACE
\ No newline at end of file
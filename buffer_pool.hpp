@@ -0,0 +1,150 @@
+#pragma once
+#include "core.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <vector>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Size-class free lists for buffer storage, one pool per EventLoop. Blocks
+// are power-of-two sized from 1KiB to 1MiB, bigger requests bypass the pool.
+// Only the owner thread touches the free lists, a block acquired or
+// released from any other thread (say the last TcpConnectionPtr dropped in a
+// worker) goes straight to the heap, so there is no locking. Buffers hold a
+// shared_ptr, the pool outlives every block it handed out.
+class BufferPool
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(BufferPool)
+    static constexpr size_t kMinBlockShift = 10;
+    static constexpr size_t kMaxBlockShift = 20;
+    static constexpr size_t kNumClasses = kMaxBlockShift - kMinBlockShift + 1;
+    static constexpr size_t kDefaultMaxCachedBytes = 64 * 1024 * 1024;
+
+    struct Block {
+        char* data = nullptr;
+        size_t size = 0;
+    };
+    // Occupancy of one size class. in_use counts blocks handed out and not
+    // returned yet, cached the ones parked in the free list.
+    struct ClassStats {
+        size_t block_size = 0;
+        size_t in_use = 0;
+        size_t cached = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+    struct Stats {
+        std::array<ClassStats, kNumClasses> classes;
+        size_t in_use_bytes = 0;
+        size_t cached_bytes = 0;
+    };
+
+    explicit BufferPool(size_t max_cached_bytes = kDefaultMaxCachedBytes) :
+        thread_id_{std::this_thread::get_id()},
+        max_cached_bytes_{max_cached_bytes},
+        cached_bytes_{0} {}
+    ~BufferPool() {
+        for (auto& size_class : classes_) {
+            for (auto data : size_class.free) {
+                delete[] data;
+            }
+        }
+    }
+
+    // The block is at least min_size bytes, uninitialized.
+    Block Acquire(size_t min_size) {
+        auto index = ClassIndex(min_size);
+        if (index == kNumClasses) {
+            return {new char[min_size], min_size};
+        }
+        auto& size_class = classes_[index];
+        auto size = ClassSize(index);
+        size_class.in_use.fetch_add(1, std::memory_order_relaxed);
+        if (IsOwnerThread() && !size_class.free.empty()) {
+            auto data = size_class.free.back();
+            size_class.free.pop_back();
+            cached_bytes_ -= size;
+            ++size_class.hits;
+            return {data, size};
+        }
+        if (IsOwnerThread()) {
+            ++size_class.misses;
+        }
+        return {new char[size], size};
+    }
+    void Release(Block block) {
+        if (!block.data) return;
+        auto index = ClassIndex(block.size);
+        if (index == kNumClasses) {
+            delete[] block.data;
+            return;
+        }
+        assert(block.size == ClassSize(index));
+        auto& size_class = classes_[index];
+        size_class.in_use.fetch_sub(1, std::memory_order_relaxed);
+        if (IsOwnerThread() && cached_bytes_ + block.size <= max_cached_bytes_) {
+            size_class.free.push_back(block.data);
+            cached_bytes_ += block.size;
+            return;
+        }
+        delete[] block.data;
+    }
+
+    // Owner thread only.
+    Stats stats() const {
+        Stats stats;
+        for (size_t i = 0; i < kNumClasses; i++) {
+            auto& size_class = classes_[i];
+            auto& out = stats.classes[i];
+            out.block_size = ClassSize(i);
+            out.in_use = size_class.in_use.load(std::memory_order_relaxed);
+            out.cached = size_class.free.size();
+            out.hits = size_class.hits;
+            out.misses = size_class.misses;
+            stats.in_use_bytes += out.in_use * out.block_size;
+            stats.cached_bytes += out.cached * out.block_size;
+        }
+        return stats;
+    }
+    auto max_cached_bytes() const noexcept { return max_cached_bytes_; }
+    // Owner thread only, shrinking drops the surplus right away.
+    void set_max_cached_bytes(size_t bytes) {
+        max_cached_bytes_ = bytes;
+        for (auto& size_class : classes_) {
+            while (cached_bytes_ > max_cached_bytes_ && !size_class.free.empty()) {
+                delete[] size_class.free.back();
+                size_class.free.pop_back();
+                cached_bytes_ -= ClassSize(&size_class - classes_.data());
+            }
+        }
+    }
+
+    // kNumClasses when size is too big to be pooled.
+    static size_t ClassIndex(size_t size) noexcept {
+        auto shift = std::max<size_t>(std::bit_width(std::max<size_t>(size, 1) - 1), kMinBlockShift);
+        return shift > kMaxBlockShift ? kNumClasses : shift - kMinBlockShift;
+    }
+    static size_t ClassSize(size_t index) noexcept {
+        return size_t{1} << (index + kMinBlockShift);
+    }
+
+private:
+    struct SizeClass {
+        std::vector<char*> free;
+        std::atomic_size_t in_use{0};
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    bool IsOwnerThread() const noexcept { return thread_id_ == std::this_thread::get_id(); }
+
+    const std::jthread::id thread_id_;
+    size_t max_cached_bytes_;
+    size_t cached_bytes_;
+    std::array<SizeClass, kNumClasses> classes_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
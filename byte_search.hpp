@@ -0,0 +1,117 @@
+#pragma once
+#include "core.hpp"
+#include <bit>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Delimiter search for the text protocol codecs. On x86-64 the SSE2
+// kernels are the baseline and AVX2 ones are picked at runtime when the
+// CPU has it, elsewhere the scalar loops run. Every function returns the
+// first match in [begin, end), or nullptr.
+namespace details {
+
+// libc's memchr, vectorized on most targets anyway.
+inline const char* FindByteScalar(const char* begin, const char* end, char c) noexcept {
+    return static_cast<const char*>(std::memchr(begin, c, end - begin));
+}
+inline const char* FindCRLFScalar(const char* begin, const char* end) noexcept {
+    for (auto p = begin; end - p >= 2; p++) {
+        if (p[0] == '\r' && p[1] == '\n') return p;
+    }
+    return nullptr;
+}
+
+#if defined(__x86_64__)
+inline const char* FindByteSse2(const char* begin, const char* end, char c) noexcept {
+    auto needle = _mm_set1_epi8(c);
+    auto p = begin;
+    for (; end - p >= 16; p += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+        if (mask) return p + std::countr_zero(mask);
+    }
+    for (; p != end; p++) {
+        if (*p == c) return p;
+    }
+    return nullptr;
+}
+// Matches \r at p with \n at p + 1 by comparing two overlapping loads, so
+// a pair split across blocks is still found.
+inline const char* FindCRLFSse2(const char* begin, const char* end) noexcept {
+    auto cr = _mm_set1_epi8('\r');
+    auto lf = _mm_set1_epi8('\n');
+    auto p = begin;
+    for (; end - p >= 17; p += 16) {
+        auto v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        auto v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1));
+        auto hits = _mm_and_si128(_mm_cmpeq_epi8(v0, cr), _mm_cmpeq_epi8(v1, lf));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+        if (mask) return p + std::countr_zero(mask);
+    }
+    return FindCRLFScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+inline const char* FindByteAvx2(const char* begin, const char* end, char c) noexcept {
+    auto needle = _mm256_set1_epi8(c);
+    auto p = begin;
+    for (; end - p >= 32; p += 32) {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+        if (mask) return p + std::countr_zero(mask);
+    }
+    return FindByteSse2(p, end, c);
+}
+__attribute__((target("avx2")))
+inline const char* FindCRLFAvx2(const char* begin, const char* end) noexcept {
+    auto cr = _mm256_set1_epi8('\r');
+    auto lf = _mm256_set1_epi8('\n');
+    auto p = begin;
+    for (; end - p >= 33; p += 32) {
+        auto v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        auto v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 1));
+        auto hits = _mm256_and_si256(_mm256_cmpeq_epi8(v0, cr), _mm256_cmpeq_epi8(v1, lf));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+        if (mask) return p + std::countr_zero(mask);
+    }
+    return FindCRLFSse2(p, end);
+}
+#endif
+
+struct ByteSearchKernels {
+    const char* (*find_byte)(const char*, const char*, char) noexcept;
+    const char* (*find_crlf)(const char*, const char*) noexcept;
+};
+
+// Picked once per process.
+inline const ByteSearchKernels& byte_search_kernels() noexcept {
+    static const ByteSearchKernels kernels = []{
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("avx2")) {
+            return ByteSearchKernels{FindByteAvx2, FindCRLFAvx2};
+        }
+        return ByteSearchKernels{FindByteSse2, FindCRLFSse2};
+#else
+        return ByteSearchKernels{FindByteScalar, FindCRLFScalar};
+#endif
+    }();
+    return kernels;
+}
+
+} // namespace details
+
+inline const char* FindByte(const char* begin, const char* end, char c) noexcept {
+    return details::byte_search_kernels().find_byte(begin, end, c);
+}
+inline const char* FindCRLF(const char* begin, const char* end) noexcept {
+    return details::byte_search_kernels().find_crlf(begin, end);
+}
+inline const char* FindEOL(const char* begin, const char* end) noexcept {
+    return FindByte(begin, end, '\n');
+}
+
+MUDUO_STUDY_END_NAMESPACE
@@ -1,6 +1,7 @@
 #pragma once
 #include "core.hpp"
 #include "buffer.hpp"
+#include <functional>
 
 MUDUO_STUDY_BEGIN_NAMESPACE
 
@@ -10,6 +11,8 @@ using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
 using TimerCallback = std::move_only_function<void()>;
 using CloseCallback = std::move_only_function<void (const TcpConnectionPtr)>;
 using HighWaterMarkCallback = std::move_only_function<void (const TcpConnectionPtr, size_t)>;
+// Runs once the connection no longer references the sent memory.
+using SendReleaseCallback = std::move_only_function<void()>;
 
 using ConnectionCallback = std::function<void (const TcpConnectionPtr)>;
 using WriteCompleteCallback = std::function<void (const TcpConnectionPtr)>;
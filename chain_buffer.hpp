@@ -0,0 +1,306 @@
+#pragma once
+#include "core.hpp"
+#include "buffer_pool.hpp"
+#include <span>
+#include <array>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Output queue made of refcounted slices instead of one contiguous vector.
+// Owned strings and shared blobs are queued by reference, only small or
+// borrowed data is copied, into fixed size blocks that never move. Slices
+// stay where they are until retrieved, so the queue can be flushed with one
+// writev() (or handed to the kernel as an iovec array) and appending never
+// memmoves what is already queued.
+//
+// With a BufferPool the copy blocks come from the pool and go back as soon
+// as the queue drains, an idle connection keeps none.
+//
+// File regions can be queued in between, they are sent with sendfile(2)
+// (splice(2) through a pipe where sendfile is refused) straight from the
+// page cache, costing O(1) memory whatever their size.
+class ChainBuffer
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(ChainBuffer)
+    static constexpr size_t kBlockSize = 4096;
+    // Owned data smaller than this is cheaper to copy than to refcount.
+    static constexpr size_t kMinReferenceSize = 256;
+    static constexpr int kMaxIovecs = IOV_MAX;
+
+    explicit ChainBuffer(std::shared_ptr<BufferPool> pool = nullptr) :
+        pool_{std::move(pool)},
+        block_used_{0},
+        block_capacity_{0},
+        readable_bytes_{0},
+        pipe_{-1, -1},
+        pipe_bytes_{0},
+        use_splice_{false} {}
+    ~ChainBuffer() {
+        ClosePipe();
+    }
+
+    auto readable_bytes() const noexcept { return readable_bytes_; }
+    auto slice_count() const noexcept { return slices_.size(); }
+    bool empty() const noexcept { return readable_bytes_ == 0; }
+    bool front_is_file() const noexcept { return !slices_.empty() && slices_.front().file; }
+
+    // Copies, small appends are coalesced into the current block.
+    void Append(std::span<const char> data) {
+        if (data.empty()) return;
+        if (!AppendToBlock(data)) {
+            NewBlock(data.size());
+            AppendToBlock(data);
+        }
+    }
+    // Takes ownership and queues data[offset:] without copying the bytes.
+    // Only binds to rvalues, lvalues go to the copying overload.
+    template<typename Owned>
+        requires std::same_as<Owned, std::string> || std::same_as<Owned, std::vector<char>>
+    void Append(Owned&& data, size_t offset = 0) {
+        assert(offset <= data.size());
+        if (data.size() - offset < kMinReferenceSize) {
+            Append(std::span<const char>(data).subspan(offset));
+            return;
+        }
+        auto owner = std::make_shared<const Owned>(std::move(data));
+        AppendRef(std::span(*owner).subspan(offset), owner);
+    }
+    void Append(std::shared_ptr<const std::string> blob, size_t offset = 0) {
+        assert(offset <= blob->size());
+        AppendRef(std::span(*blob).subspan(offset), blob);
+    }
+    // data must stay valid and unchanged as long as owner is alive.
+    void AppendRef(std::span<const char> data, std::shared_ptr<const void> owner) {
+        if (data.empty()) return;
+        slices_.push_back(Slice{.data = data.data(), .size = data.size(), .owner = std::move(owner)});
+        readable_bytes_ += data.size();
+    }
+    // Takes ownership of fd, it is closed once the region has been written
+    // or dropped. The file must not shrink meanwhile.
+    void AppendFile(int fd, off_t offset, size_t length) {
+        auto file = std::make_shared<const FileHandle>(fd);
+        if (length == 0) return;
+        slices_.push_back(Slice{.data = nullptr, .size = length, .file = std::move(file), .file_offset = offset});
+        readable_bytes_ += length;
+    }
+
+    void Retrieve(size_t len) {
+        assert(len <= readable_bytes_);
+        readable_bytes_ -= len;
+        while (len > 0) {
+            auto& front = slices_.front();
+            if (len < front.size) {
+                if (front.file) {
+                    front.file_offset += len;
+                }
+                else {
+                    front.data += len;
+                }
+                front.size -= len;
+                break;
+            }
+            len -= front.size;
+            slices_.pop_front();
+        }
+        if (slices_.empty()) {
+            ReuseBlock();
+        }
+    }
+    void RetrieveAll() {
+        slices_.clear();
+        readable_bytes_ = 0;
+        ReuseBlock();
+        // Whatever sits in the pipe belonged to a dropped region.
+        if (pipe_bytes_ > 0) {
+            ClosePipe();
+        }
+    }
+
+    // Fills iov with the leading memory slices up to the first file region,
+    // returns how many were used.
+    size_t FillIovec(std::span<iovec> iov) const noexcept {
+        size_t n = 0;
+        for (auto& slice : slices_) {
+            if (n == iov.size() || slice.file) break;
+            iov[n].iov_base = const_cast<char*>(slice.data);
+            iov[n].iov_len = slice.size;
+            ++n;
+        }
+        return n;
+    }
+
+    // Bytes a single WriteFd()/SendMsg() can take from the leading memory
+    // slices.
+    size_t front_memory_bytes() const noexcept {
+        size_t bytes = 0;
+        int n = 0;
+        for (auto& slice : slices_) {
+            if (n++ == kMaxIovecs || slice.file) break;
+            bytes += slice.size;
+        }
+        return bytes;
+    }
+    // Adds the owners of the first len bytes to owners, so they can be kept
+    // alive past Retrieve() while the kernel still references the memory.
+    void CollectOwners(size_t len, std::vector<std::shared_ptr<const void>>& owners) const {
+        for (auto& slice : slices_) {
+            if (len == 0) break;
+            assert(!slice.file);
+            owners.push_back(slice.owner);
+            len -= std::min(len, slice.size);
+        }
+    }
+
+    // Like Buffer::WriteFd, the caller retrieves what was written. Writes
+    // either the leading memory slices or from the leading file region.
+    ssize_t WriteFd(int fd) {
+        if (front_is_file()) {
+            return WriteFile(fd);
+        }
+        std::array<iovec, kMaxIovecs> iov;
+        auto iovcnt = FillIovec(iov);
+        if (iovcnt == 1) {
+            return ::write(fd, iov[0].iov_base, iov[0].iov_len);
+        }
+        return ::writev(fd, iov.data(), static_cast<int>(iovcnt));
+    }
+    // The leading memory slices with sendmsg(2), e.g. for MSG_ZEROCOPY.
+    ssize_t SendMsg(int fd, int flags) const {
+        std::array<iovec, kMaxIovecs> iov;
+        msghdr msg;
+        ZeroMemory(msg);
+        msg.msg_iov = iov.data();
+        msg.msg_iovlen = FillIovec(iov);
+        return ::sendmsg(fd, &msg, flags);
+    }
+
+private:
+    struct FileHandle {
+        explicit FileHandle(int fd) : fd{fd} {}
+        ~FileHandle() { ::close(fd); }
+        const int fd;
+    };
+    struct Slice {
+        const char* data;
+        size_t size;
+        // Memory slices have an owner, file regions a file.
+        std::shared_ptr<const void> owner = {};
+        std::shared_ptr<const FileHandle> file = {};
+        off_t file_offset = 0;
+    };
+
+    ssize_t WriteFile(int sockfd) {
+        auto& front = slices_.front();
+        if (!use_splice_) {
+            auto offset = front.file_offset;
+            auto n = ::sendfile(sockfd, front.file->fd, &offset, front.size);
+            if (n == -1 && (errno == EINVAL || errno == ENOSYS)) {
+                use_splice_ = true;
+            }
+            else {
+                return n != 0 ? n : DropTruncatedFile();
+            }
+        }
+        if (pipe_bytes_ == 0) {
+            if (pipe_[0] == -1 && ::pipe2(pipe_, O_NONBLOCK | O_CLOEXEC) == -1) {
+                return -1;
+            }
+            // Bytes in the pipe are read from the file but not yet sent, so
+            // they are only retrieved once they reach the socket.
+            auto offset = front.file_offset;
+            auto n = ::splice(front.file->fd, &offset, pipe_[1], nullptr, front.size,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n <= 0) {
+                return n == 0 ? DropTruncatedFile() : n;
+            }
+            pipe_bytes_ = n;
+        }
+        auto n = ::splice(pipe_[0], nullptr, sockfd, nullptr, pipe_bytes_,
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            pipe_bytes_ -= n;
+        }
+        return n;
+    }
+    // The file ended before the queued length, nothing more will come.
+    ssize_t DropTruncatedFile() {
+        auto size = slices_.front().size;
+        readable_bytes_ -= size;
+        slices_.pop_front();
+        errno = ENODATA;
+        return -1;
+    }
+    void ClosePipe() {
+        if (pipe_[0] != -1) {
+            ::close(pipe_[0]);
+            ::close(pipe_[1]);
+            pipe_[0] = pipe_[1] = -1;
+        }
+        pipe_bytes_ = 0;
+    }
+
+    // Extends the last slice when it ends where the block's free space
+    // starts, the bytes already queued stay untouched.
+    bool AppendToBlock(std::span<const char> data) {
+        if (block_capacity_ - block_used_ < data.size()) return false;
+        auto dest = block_.get() + block_used_;
+        std::ranges::copy(data, dest);
+        block_used_ += data.size();
+        readable_bytes_ += data.size();
+        if (!slices_.empty() && slices_.back().owner.get() == block_.get() &&
+            slices_.back().data + slices_.back().size == dest) {
+            slices_.back().size += data.size();
+        }
+        else {
+            slices_.push_back(Slice{.data = dest, .size = data.size(), .owner = block_});
+        }
+        return true;
+    }
+    void NewBlock(size_t min_size) {
+        auto size = std::max(min_size, kBlockSize);
+        if (pool_) {
+            auto block = pool_->Acquire(size);
+            block_.reset(block.data, [pool=pool_, block](char*){ pool->Release(block); });
+            block_capacity_ = block.size;
+        }
+        else {
+            block_ = std::make_shared_for_overwrite<char[]>(size);
+            block_capacity_ = size;
+        }
+        block_used_ = 0;
+    }
+    // Once nothing refers to the block any more it goes back to the pool, or
+    // without one is written from the start again, so a connection that
+    // keeps up with its peer never reallocates.
+    void ReuseBlock() {
+        if (!block_) return;
+        if (pool_) {
+            block_.reset();
+            block_used_ = block_capacity_ = 0;
+        }
+        else if (block_.use_count() == 1) {
+            block_used_ = 0;
+        }
+    }
+
+    std::shared_ptr<BufferPool> pool_;
+    std::deque<Slice> slices_;
+    std::shared_ptr<char[]> block_;
+    size_t block_used_;
+    size_t block_capacity_;
+    size_t readable_bytes_;
+    int pipe_[2];
+    size_t pipe_bytes_;
+    bool use_splice_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
@@ -15,13 +15,15 @@ public:
     enum Event {
         kNoneEvent = 0,
         kReadEvent = EPOLLIN | EPOLLPRI,
-        kWriteEvent = EPOLLOUT
+        kWriteEvent = EPOLLOUT,
+        kEdgeEvent = EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLRDHUP | EPOLLET
     };
     enum Status {
         kNew,
         kDeleted,
         kAdded
     };
+    static constexpr size_t kNotDirty = static_cast<size_t>(-1);
 
     ChannelImpl(EventLoop* loop, int fd) : 
         loop_{loop},
@@ -30,7 +32,10 @@ public:
         revents_{kNoneEvent},
         status_{kNew},
         event_handling_{false},
-        added_to_loop_{false} {}
+        added_to_loop_{false},
+        edge_triggered_{false},
+        dirty_index_{kNotDirty},
+        registered_events_{kNoneEvent} {}
 
     ~ChannelImpl() {
 
@@ -46,41 +51,69 @@ public:
     void set_error_callback(EventCallback cb) noexcept { error_callback_ = std::move(cb); }
 
     auto fd() const noexcept { return fd_; }
-    auto events() const noexcept { return events_; }
+    // The mask to register with the poller. In edge triggered mode that is
+    // everything as long as there is any interest, see set_edge_triggered().
+    int events() const noexcept {
+        if (edge_triggered_) {
+            return events_ == kNoneEvent ? kNoneEvent : kEdgeEvent;
+        }
+        return events_;
+    }
+    bool edge_triggered() const noexcept { return edge_triggered_; }
     auto revents() const noexcept { return revents_; }
     auto owner_loop() const noexcept { return loop_; }
     auto status() const noexcept { return status_; }
+    // What the poller last registered, maintained by the poller.
+    auto registered_events() const noexcept { return registered_events_; }
+    bool update_pending() const noexcept { return dirty_index_ != kNotDirty; }
+    // Where the loop keeps it among the channels to update, kNotDirty
+    // when no update is pending. Maintained by the loop.
+    auto dirty_index() const noexcept { return dirty_index_; }
     std::string events_str() const noexcept {
-        std::ostringstream oss;
-        if (events_ & EPOLLIN)
-            oss << "EPOLLIN | ";
-        if (events_ & EPOLLPRI)
-            oss << "EPOLLPRI | ";
-        if (events_ & EPOLLOUT)
-            oss << "EPOLLOUT | ";
-        if (events_ & EPOLLHUP)
-            oss << "EPOLLHUP | ";
-        if (events_ & EPOLLRDHUP)
-            oss << "EPOLLRDHUP | ";
-        if (events_ & EPOLLERR)
-            oss << "EPOLLERR | ";
-        auto tmp = oss.str();
-        assert(!tmp.empty());
-        return tmp.substr(0, tmp.size() - 3);
+        std::string str;
+        auto events = this->events();
+        auto add = [&](int event, std::string_view name) {
+            if (!(events & event)) return;
+            if (!str.empty()) str += " | ";
+            str += name;
+        };
+        add(EPOLLIN, "EPOLLIN");
+        add(EPOLLPRI, "EPOLLPRI");
+        add(EPOLLOUT, "EPOLLOUT");
+        add(EPOLLHUP, "EPOLLHUP");
+        add(EPOLLRDHUP, "EPOLLRDHUP");
+        add(EPOLLERR, "EPOLLERR");
+        add(EPOLLET, "EPOLLET");
+        add(EPOLLEXCLUSIVE, "EPOLLEXCLUSIVE");
+        return str.empty() ? "NONE" : str;
     }
     
     void set_revents(int revents) noexcept { revents_ = revents; }
     void set_status(Status status) noexcept { status_ = status; }
+    void set_registered_events(int events) noexcept { registered_events_ = events; }
+    void set_dirty_index(size_t index) noexcept { dirty_index_ = index; }
+    // Edge triggered channels are registered once with kEdgeEvent, Enable/
+    // Disable Reading/Writing then only track interest locally and never
+    // touch the poller, callbacks fire only for what is enabled. The owner
+    // must drain reads/writes to EAGAIN. Set before the first Enable*().
+    void set_edge_triggered(bool on) noexcept {
+        assert(status_ == kNew && events_ == kNoneEvent);
+        edge_triggered_ = on;
+    }
 
-    bool IsNoneEvent() const {return events_ == kNoneEvent; }
+    bool IsNoneEvent() const {return events() == kNoneEvent; }
     bool IsWriting() const {return events_ & kWriteEvent; }
     bool IsReading() const {return events_ & kReadEvent; }
 
-    void EnableReading() { events_ |= kReadEvent; Update(); }
-    void DisableReading() { events_ &= ~kReadEvent; Update(); }
-    void EnableWriting() { events_ |= kWriteEvent; Update(); }
-    void DisableWriting() { events_ &= ~kWriteEvent; Update(); }
-    void DisableAll() { events_ = kNoneEvent; Update(); }
+    void EnableReading() { SetInterest(events_ | kReadEvent); }
+    // EPOLLEXCLUSIVE, for an fd several loops wait on. The kernel takes
+    // it with EPOLLIN but not EPOLLPRI and only when adding, so the
+    // interest must not change until DisableAll().
+    void EnableReadingExclusive() { SetInterest(events_ | EPOLLIN | EPOLLEXCLUSIVE); }
+    void DisableReading() { SetInterest(events_ & ~kReadEvent); }
+    void EnableWriting() { SetInterest(events_ | kWriteEvent); }
+    void DisableWriting() { SetInterest(events_ & ~kWriteEvent); }
+    void DisableAll() { SetInterest(kNoneEvent); }
 
     void Remove() {
         added_to_loop_ = false;
@@ -99,6 +132,13 @@ public:
     }
 
 private:
+    void SetInterest(int interest) {
+        auto old_events = events();
+        events_ = interest;
+        if (!edge_triggered_ || events() != old_events) {
+            Update();
+        }
+    }
     void Update() {
         added_to_loop_ = true;
         loop_->UpdateChannel(this);
@@ -113,10 +153,10 @@ private:
             if (error_callback_) error_callback_();
         }
         if (revents_ & (EPOLLIN | EPOLLPRI | EPOLLRDHUP)) {
-            if (read_callback_) read_callback_(receive_time);
+            if (read_callback_ && (!edge_triggered_ || IsReading())) read_callback_(receive_time);
         }
         if (revents_ & EPOLLOUT) {
-            if (write_callback_) write_callback_();
+            if (write_callback_ && (!edge_triggered_ || IsWriting())) write_callback_();
         }
         event_handling_ = false;
     }
@@ -130,6 +170,9 @@ private:
     std::weak_ptr<void> tie_;
     bool event_handling_;
     bool added_to_loop_;
+    bool edge_triggered_;
+    size_t dirty_index_;
+    int registered_events_;
     ReadEventCallback read_callback_;
     EventCallback write_callback_;
     EventCallback close_callback_;
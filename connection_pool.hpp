@@ -0,0 +1,264 @@
+#pragma once
+#include "core.hpp"
+#include "callbacks.hpp"
+#include "connector.hpp"
+#include "tcp_client.hpp"
+#include "tcp_connection.hpp"
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Warm outgoing connections to a set of backends, owned by one loop and
+// used only from its thread. Acquire() leases a connected TcpConnection,
+// which the caller drives with its own message callback and gives back
+// with Release(); the next request then goes out without a connect. Idle
+// connections are kept most recently used first, the ones above min_idle
+// that sat unused for idle_timeout are closed.
+class ConnectionPool
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(ConnectionPool)
+    // Gets nullptr when the backend can't be reached.
+    using LeaseCallback = std::move_only_function<void(TcpConnectionPtr)>;
+
+    struct Options {
+        // Kept connected per backend, reconnected with backoff when lost.
+        size_t min_idle = 1;
+        // Per backend, leased, idle and connecting together.
+        size_t max_connections = 16;
+        std::chrono::milliseconds idle_timeout = 60s;
+    };
+
+    ConnectionPool(EventLoop* loop, std::string_view name) :
+        ConnectionPool(loop, name, Options{}) {}
+    ConnectionPool(EventLoop* loop, std::string_view name, Options options) :
+        loop_{loop},
+        name_{name},
+        options_{options},
+        next_connid_{1}
+    {
+        assert(options_.min_idle <= options_.max_connections);
+        idle_timer_ = loop_->RunEvery(options_.idle_timeout, [this](){ CloseExpired(); });
+    }
+    // Leased connections are closed as well.
+    ~ConnectionPool() {
+        loop_->AssertInLoopThread();
+        loop_->Cancel(idle_timer_);
+        for (auto& [key, backend] : backends_) {
+            loop_->Cancel(backend.refill_timer);
+            for (auto& connector : backend.connectors) {
+                connector->Stop();
+            }
+            for (auto& conn : backend.connections) {
+                conn->ConnectDestroyed();
+            }
+        }
+    }
+
+    auto loop() const noexcept { return loop_; }
+    const auto& name() const noexcept { return name_; }
+    size_t idle_count(const InetAddress& addr) const {
+        auto it = backends_.find(addr.ip_port());
+        return it == backends_.end() ? 0 : it->second.idle.size();
+    }
+    size_t connection_count(const InetAddress& addr) const {
+        auto it = backends_.find(addr.ip_port());
+        return it == backends_.end() ? 0 : it->second.connections.size();
+    }
+
+    // Starts warming min_idle connections, Acquire() adds unknown
+    // backends on first use.
+    void AddBackend(const InetAddress& addr) {
+        loop_->AssertInLoopThread();
+        FillUp(GetBackend(addr));
+    }
+
+    // Calls back right away with an idle connection, otherwise once one is
+    // released or connected.
+    void Acquire(const InetAddress& addr, LeaseCallback cb) {
+        loop_->AssertInLoopThread();
+        auto& backend = GetBackend(addr);
+        if (backend.refilling) {
+            // Down, and not tried again before the refill timer.
+            loop_->QueueInLoop([cb=std::move(cb)]() mutable { cb(nullptr); });
+            return;
+        }
+        while (!backend.idle.empty()) {
+            auto conn = std::move(backend.idle.back().conn);
+            backend.idle.pop_back();
+            if (conn->connected()) {
+                cb(std::move(conn));
+                return;
+            }
+        }
+        backend.waiters.push_back(std::move(cb));
+        if (backend.connectors.size() < backend.waiters.size()) {
+            FillUp(backend);
+        }
+    }
+
+    // Gives a leased connection back, its callbacks are reset. That waits
+    // for the current callback to return, it is usually the message
+    // callback being replaced. A connection that is closing is just
+    // dropped.
+    void Release(const TcpConnectionPtr& conn) {
+        loop_->AssertInLoopThread();
+        loop_->QueueInLoop([this, alive=std::weak_ptr(alive_), conn](){
+            if (alive.lock()) {
+                ReleaseInLoop(conn);
+            }
+        });
+    }
+
+private:
+    struct Idle {
+        TcpConnectionPtr conn;
+        time_point since;
+    };
+    struct Backend {
+        explicit Backend(const InetAddress& a) : addr{a} {}
+        InetAddress addr;
+        std::vector<TcpConnectionPtr> connections;
+        // Most recently released at the back.
+        std::vector<Idle> idle;
+        std::vector<std::shared_ptr<Connector>> connectors;
+        std::deque<LeaseCallback> waiters;
+        // Set while a connector that gave up waits for the next FillUp(),
+        // the delay doubles like the connectors' own.
+        bool refilling = false;
+        TimerId refill_timer;
+        std::chrono::milliseconds refill_delay = Connector::kInitRetryDelay;
+    };
+
+    void ReleaseInLoop(const TcpConnectionPtr& conn) {
+        auto it = backends_.find(conn->peer_addr().ip_port());
+        if (it == backends_.end() || !conn->connected()) return;
+        conn->set_message_callback(details::DefaultMessageCallback);
+        conn->set_write_complete_callback([](const TcpConnectionPtr){});
+        Hand(it->second, conn);
+    }
+    Backend& GetBackend(const InetAddress& addr) {
+        auto key = addr.ip_port();
+        auto it = backends_.find(key);
+        if (it == backends_.end()) {
+            it = backends_.emplace(std::move(key), Backend{addr}).first;
+        }
+        return it->second;
+    }
+    size_t Total(const Backend& backend) const {
+        return backend.connections.size() + backend.connectors.size();
+    }
+    // min_idle, or one per lease and waiter, within max_connections.
+    size_t Wanted(const Backend& backend) const {
+        auto leased = backend.connections.size() - backend.idle.size();
+        return std::min(std::max(options_.min_idle, leased + backend.waiters.size()), options_.max_connections);
+    }
+    // A connect may fail right away, which drops the waiters and so
+    // changes what is wanted, or stops the filling until the refill timer.
+    void FillUp(Backend& backend) {
+        while (!backend.refilling && Total(backend) < Wanted(backend)) {
+            auto connector = std::make_shared<Connector>(loop_, backend.addr);
+            auto raw = connector.get();
+            connector->set_new_connection_callback([this, &backend, raw](int sockfd){
+                NewConnection(backend, raw, sockfd);
+            });
+            connector->set_error_callback([this, &backend, raw](int err, bool retrying){
+                ConnectFailed(backend, raw, err, retrying);
+            });
+            backend.connectors.push_back(connector);
+            connector->Start();
+        }
+    }
+    // The connector is still running the callback, it goes away later.
+    void RemoveConnector(Backend& backend, Connector* connector) {
+        auto it = std::ranges::find(backend.connectors, connector, &std::shared_ptr<Connector>::get);
+        assert(it != backend.connectors.end());
+        loop_->QueueInLoop([c=std::move(*it)](){});
+        backend.connectors.erase(it);
+    }
+    void NewConnection(Backend& backend, Connector* connector, int sockfd) {
+        RemoveConnector(backend, connector);
+        backend.refill_delay = Connector::kInitRetryDelay;
+        auto conn_name = std::format("{}:{}#{}", name_, backend.addr.ip_port(), next_connid_);
+        ++next_connid_;
+        auto conn = details::NewClientConnection(loop_, sockfd, conn_name);
+        if (!conn) {
+            FillUp(backend);
+            return;
+        }
+        conn->set_close_callback([this, &backend](const TcpConnectionPtr c){ RemoveConnection(backend, c); });
+        backend.connections.push_back(conn);
+        conn->ConnectEstablished();
+        Hand(backend, conn);
+    }
+    // Waiters fail fast while the backend is down, the connector keeps
+    // trying if it is needed for min_idle. One that gave up is dropped,
+    // FillUp() starts a new one after a delay.
+    void ConnectFailed(Backend& backend, Connector* connector, int err, bool retrying) {
+        MUDUO_STUDY_LOG_WARNING("ConnectionPool [{}] connecting to {} failed: {}",
+            name_, backend.addr.ip_port(), std::strerror(err));
+        if (!retrying || Total(backend) > options_.min_idle) {
+            connector->Stop();
+            RemoveConnector(backend, connector);
+        }
+        if (!retrying && !backend.refilling) {
+            backend.refilling = true;
+            backend.refill_timer = loop_->RunAfter(backend.refill_delay, [this, &backend](){
+                backend.refilling = false;
+                FillUp(backend);
+            });
+            backend.refill_delay = std::min<std::chrono::milliseconds>(backend.refill_delay * 2, Connector::kMaxRetryDelay);
+        }
+        // Not from inside Acquire(), a caller retrying right away would
+        // recurse.
+        loop_->QueueInLoop([waiters=std::exchange(backend.waiters, {})]() mutable {
+            for (auto& waiter : waiters) {
+                waiter(nullptr);
+            }
+        });
+    }
+    void Hand(Backend& backend, const TcpConnectionPtr& conn) {
+        if (!backend.waiters.empty()) {
+            auto waiter = std::move(backend.waiters.front());
+            backend.waiters.pop_front();
+            waiter(conn);
+        }
+        else {
+            backend.idle.push_back({conn, std::chrono::system_clock::now()});
+        }
+    }
+    void RemoveConnection(Backend& backend, const TcpConnectionPtr& conn) {
+        loop_->AssertInLoopThread();
+        std::erase(backend.connections, conn);
+        std::erase_if(backend.idle, [&](const Idle& idle){ return idle.conn == conn; });
+        loop_->QueueInLoop([conn](){ conn->ConnectDestroyed(); });
+        FillUp(backend);
+    }
+    // Oldest first, down to min_idle.
+    void CloseExpired() {
+        auto deadline = std::chrono::system_clock::now() - options_.idle_timeout;
+        for (auto& [key, backend] : backends_) {
+            auto expired = std::ranges::find_if(backend.idle, [&](const Idle& idle){ return idle.since > deadline; });
+            auto n = std::min<size_t>(expired - backend.idle.begin(),
+                                      backend.connections.size() - std::min(backend.connections.size(), options_.min_idle));
+            for (size_t i = 0; i < n; i++) {
+                backend.idle[i].conn->ForceClose();
+            }
+            backend.idle.erase(backend.idle.begin(), backend.idle.begin() + n);
+        }
+    }
+
+    EventLoop* loop_;
+    const std::string name_;
+    Options options_;
+    int next_connid_;
+    TimerId idle_timer_;
+    // Queued releases check it, the pool may be gone by then.
+    std::shared_ptr<bool> alive_ = std::make_shared<bool>(true);
+    // Node based, the callbacks hold on to their backend.
+    std::unordered_map<std::string, Backend> backends_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
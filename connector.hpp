@@ -0,0 +1,189 @@
+#pragma once
+#include "core.hpp"
+#include "inet_address.hpp"
+#include "event_loop.hpp"
+#include "socket.hpp"
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Non-blocking connect() driven by the loop. A failed attempt is retried
+// after a delay that doubles up to kMaxRetryDelay, unless the error says
+// another try won't help. The connected fd is
+// handed to the new connection callback, which owns it from then on.
+// Start()/Stop() may be called from any thread, everything else runs in
+// the loop thread.
+class Connector : public std::enable_shared_from_this<Connector>
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(Connector)
+    using NewConnectionCallback = std::move_only_function<void(int sockfd)>;
+    // Told about every failed attempt, with its errno, before the retry.
+    // retrying is false when the connector gave up, it does nothing more
+    // until Restart().
+    using ErrorCallback = std::move_only_function<void(int err, bool retrying)>;
+    static constexpr auto kInitRetryDelay = 500ms;
+    static constexpr auto kMaxRetryDelay = 30s;
+
+    Connector(EventLoop* loop, const InetAddress& server_addr) :
+        loop_{loop},
+        server_addr_{server_addr},
+        connect_{false},
+        state_{kDisconnected},
+        retry_delay_{kInitRetryDelay} {}
+    ~Connector() {
+        assert(!channel_);
+    }
+
+    const auto& server_addr() const noexcept { return server_addr_; }
+    void set_new_connection_callback(NewConnectionCallback cb) { new_connection_callback_ = std::move(cb); }
+    void set_error_callback(ErrorCallback cb) { error_callback_ = std::move(cb); }
+
+    void Start() {
+        connect_ = true;
+        loop_->RunInLoop([self=shared_from_this()](){ self->StartInLoop(); });
+    }
+    // Starts over with the initial delay, loop thread only.
+    void Restart() {
+        loop_->AssertInLoopThread();
+        state_ = kDisconnected;
+        retry_delay_ = kInitRetryDelay;
+        connect_ = true;
+        StartInLoop();
+    }
+    // Abandons an attempt in flight and any pending retry.
+    void Stop() {
+        connect_ = false;
+        loop_->RunInLoop([self=shared_from_this()](){ self->StopInLoop(); });
+    }
+
+private:
+    enum State { kDisconnected, kConnecting, kConnected };
+
+    void StartInLoop() {
+        loop_->AssertInLoopThread();
+        assert(state_ == kDisconnected);
+        if (connect_) {
+            Connect();
+        }
+    }
+    void StopInLoop() {
+        loop_->AssertInLoopThread();
+        loop_->Cancel(retry_timer_);
+        if (state_ == kConnecting) {
+            state_ = kDisconnected;
+            ::close(RemoveAndResetChannel());
+        }
+    }
+
+    void Connect() {
+        auto sockfd = ::socket(server_addr_.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+        if (sockfd == -1) {
+            auto err = errno;
+            MUDUO_STUDY_LOG_SYSERR("socket() failed!");
+            Retry(-1, err);
+            return;
+        }
+        auto ret = ::connect(sockfd, (const sockaddr*)server_addr_.sockaddr(), sizeof(sockaddr_in));
+        auto err = ret == 0 ? 0 : errno;
+        switch (err) {
+        case 0:
+        case EINPROGRESS:
+        case EINTR:
+        case EISCONN:
+            Connecting(sockfd);
+            break;
+        // Worth another try later.
+        case EAGAIN:
+        case EADDRINUSE:
+        case EADDRNOTAVAIL:
+        case ECONNREFUSED:
+        case ENETUNREACH:
+        case ETIMEDOUT:
+            Retry(sockfd, err);
+            break;
+        default:
+            errno = err;
+            MUDUO_STUDY_LOG_SYSERR("Connector::Connect to {} failed!", server_addr_.ip_port());
+            ::close(sockfd);
+            state_ = kDisconnected;
+            if (error_callback_) {
+                error_callback_(err, false);
+            }
+            break;
+        }
+    }
+    // Writable means connected or failed, SO_ERROR tells which.
+    void Connecting(int sockfd) {
+        state_ = kConnecting;
+        assert(!channel_);
+        channel_ = std::make_unique<Channel>(loop_, sockfd);
+        channel_->set_write_callback([this](){ HandleWrite(); });
+        channel_->set_error_callback([this](){ HandleError(); });
+        channel_->EnableWriting();
+    }
+    void HandleWrite() {
+        if (state_ != kConnecting) return;
+        auto sockfd = RemoveAndResetChannel();
+        auto err = Socket::GetSocketError(sockfd);
+        if (err) {
+            Retry(sockfd, err);
+        }
+        else if (Socket::IsSelfConnect(sockfd)) {
+            MUDUO_STUDY_LOG_WARNING("Connector::HandleWrite self connect to {}", server_addr_.ip_port());
+            Retry(sockfd, ECONNREFUSED);
+        }
+        else {
+            state_ = kConnected;
+            if (connect_ && new_connection_callback_) {
+                new_connection_callback_(sockfd);
+            }
+            else {
+                ::close(sockfd);
+            }
+        }
+    }
+    void HandleError() {
+        if (state_ != kConnecting) return;
+        auto sockfd = RemoveAndResetChannel();
+        Retry(sockfd, Socket::GetSocketError(sockfd));
+    }
+    // The channel is still running its callback, it is destroyed later.
+    int RemoveAndResetChannel() {
+        channel_->DisableAll();
+        channel_->Remove();
+        auto sockfd = channel_->fd();
+        loop_->QueueInLoop([channel=std::shared_ptr<Channel>(std::move(channel_))](){});
+        return sockfd;
+    }
+    void Retry(int sockfd, int err) {
+        if (sockfd != -1) {
+            ::close(sockfd);
+        }
+        state_ = kDisconnected;
+        if (error_callback_) {
+            error_callback_(err, connect_);
+        }
+        if (connect_) {
+            MUDUO_STUDY_LOG_INFO("Connector::Retry connecting to {} in {}ms",
+                server_addr_.ip_port(), retry_delay_.count());
+            retry_timer_ = loop_->RunAfter(retry_delay_, [weak=weak_from_this()](){
+                if (auto self = weak.lock()) {
+                    self->StartInLoop();
+                }
+            });
+            retry_delay_ = std::min<std::chrono::milliseconds>(retry_delay_ * 2, kMaxRetryDelay);
+        }
+    }
+
+    EventLoop* loop_;
+    InetAddress server_addr_;
+    std::atomic_bool connect_;
+    State state_;
+    std::unique_ptr<Channel> channel_;
+    std::chrono::milliseconds retry_delay_;
+    TimerId retry_timer_;
+    NewConnectionCallback new_connection_callback_;
+    ErrorCallback error_callback_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
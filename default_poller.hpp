@@ -1,10 +1,22 @@
 #pragma once
 #include "epoll_poller.hpp"
+#include "io_uring_poller.hpp"
+#include <stdlib.h>
 
 MUDUO_STUDY_BEGIN_NAMESPACE
 
+// MUDUO_STUDY_POLLER=io_uring selects IoUringPoller, anything else (or a
+// kernel without usable io_uring) gets EPollPoller.
 Poller* Poller::NewDefaultPoller(EventLoop * loop) {
+    auto name = ::getenv("MUDUO_STUDY_POLLER");
+    if (name && std::string_view{name} == "io_uring") {
+        auto ring = IoUring::Create();
+        if (ring.has_value()) {
+            return new IoUringPoller(loop, std::move(ring.value()));
+        }
+        MUDUO_STUDY_LOG_WARNING("io_uring unavailable ({}), fall back to epoll", strerror(ring.error()));
+    }
     return new EPollPoller(loop);
 }
 
-MUDUO_STUDY_END_NAMESPACE
\ No newline at end of file
+MUDUO_STUDY_END_NAMESPACE
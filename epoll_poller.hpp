@@ -50,34 +50,33 @@ public:
         auto st = channel->status();
         auto fd = channel->fd();
         if (st == Channel::kNew || st == Channel::kDeleted) {
+            if (channel->IsNoneEvent()) {
+                return;
+            }
             if (st == Channel::kNew) {
-                assert(channels_.find(fd) == channels_.end());
-                channels_[fd] = channel;
+                channels_.insert(fd, channel);
             }
             else {
-                assert(channels_.find(fd) != channels_.end());
-                assert(channels_[fd] == channel);
+                assert(channels_.find(fd) == channel);
             }
             channel->set_status(Channel::kAdded);
             Update(EPOLL_CTL_ADD, channel);
         }
         else {
-            assert(channels_.find(fd) != channels_.end());
-            assert(channels_[fd] == channel);
+            assert(channels_.find(fd) == channel);
             assert(st == Channel::kAdded);
             if (channel->IsNoneEvent()) {
                 Update(EPOLL_CTL_DEL, channel);
                 channel->set_status(Channel::kDeleted);
             }
-            else {
+            else if (channel->events() != channel->registered_events()) {
                 Update(EPOLL_CTL_MOD, channel);
             }
         }
     }
     void RemoveChannel(Channel* channel) override {
         auto fd = channel->fd();
-        assert(channels_.find(fd) != channels_.end());
-        assert(channels_[fd] == channel);
+        assert(channels_.find(fd) == channel);
         assert(channel->IsNoneEvent());
         auto st = channel->status();
         assert(st != Channel::kNew);
@@ -108,13 +107,10 @@ private:
     }
 
     void FillActiveChannels(size_t num_events, ChannelList* active_channels) const {
-        assert(num_events < events_.size());
+        assert(num_events <= events_.size());
         for (size_t i = 0; i < num_events; i++){
             auto channel = static_cast<Channel*>(events_[i].data.ptr);
-#ifndef NDEBUG
-            auto it = channels_.find(channel->fd());
-            assert(it != channels_.end() && it->second == channel);
-#endif
+            assert(channels_.find(channel->fd()) == channel);
             channel->set_revents(events_[i].events);
             active_channels->push_back(channel);
         }
@@ -127,6 +123,8 @@ private:
         event.data.ptr = channel;
         auto fd = channel->fd();
         MUDUO_STUDY_LOG_DEBUG("epoll_ctl({}, {}, {}, {})", epollfd_, OpToStr(op), fd, channel->events_str());
+        ++update_stats_.issued;
+        channel->set_registered_events(op == EPOLL_CTL_DEL ? static_cast<int>(Channel::kNoneEvent) : channel->events());
         if (::epoll_ctl(epollfd_, op, fd, &event) == -1) {
             if (op == EPOLL_CTL_DEL) {
                 MUDUO_STUDY_LOG_SYSERR("epoll_ctl failed! op is {}", OpToStr(op));
@@ -2,9 +2,11 @@
 #include "core.hpp"
 #include "default_poller.hpp"
 #include "logger.hpp"
+#include "timer_queue.hpp"
+#include "mpsc_queue.hpp"
+#include "buffer_pool.hpp"
 #include <sys/eventfd.h>
 #include <atomic>
-#include <mutex>
 
 MUDUO_STUDY_BEGIN_NAMESPACE
 
@@ -23,17 +25,24 @@ public:
     using Functor = std::move_only_function<void()>;
     thread_local static inline EventLoop* Instance = nullptr;
     static constexpr auto kPoolTimeoutMs = 10000ms;
+    static constexpr size_t kMaxFunctorsPerIteration = 1024;
+    static constexpr size_t kReadScratchSize = 64 * 1024;
 
     EventLoop() :
         looping_{false},
         quit_{false},
         event_handling_{false},
-        calling_pending_functors_{false},
+        polling_{false},
+        wakeup_pending_{false},
         iteration_{0},
         thread_id_{std::this_thread::get_id()},
         poller_{Poller::NewDefaultPoller(this)},
+        timer_queue_{new TimerQueue(this)},
         cur_active_channel_{nullptr},
-        wakeup_channel_{new Channel(this, CreateEventfd())}
+        wakeup_channel_{new Channel(this, CreateEventfd())},
+        pending_count_{0},
+        buffer_pool_{std::make_shared<BufferPool>()},
+        read_scratch_{std::make_unique_for_overwrite<char[]>(kReadScratchSize)}
     {
         MUDUO_STUDY_LOG_DEBUG("EventLoop created");
         if (Instance) {
@@ -49,14 +58,17 @@ public:
         wakeup_channel_->DisableAll();
         wakeup_channel_->Remove();
         ::close(wakeup_channel_->fd());
+        while (auto node = pending_functors_.Pop()) {
+            delete node;
+        }
     }
 
     auto poll_return_time() const noexcept {
         return poll_return_time_;
     }
+    // Approximate, producers may be mid-push.
     auto queue_size() const noexcept {
-        std::scoped_lock lock{mutex_};
-        return pending_functors_.size();
+        return pending_count_.load(std::memory_order_relaxed);
     }
 
     void Loop() {
@@ -67,7 +79,14 @@ public:
         MUDUO_STUDY_LOG_DEBUG("EventLoop({:016x}) Starting!", (intptr_t)this);
         while (!quit_) {
             active_channels_.clear();
-            poll_return_time_ = poller_->Poll(kPoolTimeoutMs, &active_channels_);
+            FlushChannelUpdates();
+            // Producers only write the eventfd while polling_ is set, so
+            // recheck the queue after publishing it and don't block if a
+            // post raced in or the last batch was cut short.
+            polling_.store(true);
+            auto timeout = pending_count_.load() > 0 ? 0ms : kPoolTimeoutMs;
+            poll_return_time_ = poller_->Poll(timeout, &active_channels_);
+            polling_.store(false, std::memory_order_relaxed);
             ++iteration_;
             event_handling_ = true;
             for (auto channel : active_channels_) {
@@ -96,15 +115,17 @@ public:
         }
     }
     void QueueInLoop(Functor cb) {
-        {
-            std::scoped_lock lock{mutex_};
-            pending_functors_.push_back(std::move(cb));
-        }
-        if (!IsInLoopThread() || calling_pending_functors_) {
+        pending_count_.fetch_add(1);
+        pending_functors_.Push(new PendingFunctor{std::move(cb)});
+        if (polling_.load()) {
             Wakeup();
         }
     }
+    // Coalesced: at most one eventfd write until the loop drains it.
     void Wakeup() {
+        if (wakeup_pending_.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
         uint64_t one = 1;
         auto n = ::write(wakeup_channel_->fd(), &one, sizeof(one));
         if (n != sizeof(one)) {
@@ -113,10 +134,31 @@ public:
     }
     bool IsInLoopThread() const { return thread_id_ == std::this_thread::get_id(); }
 
+    TimerId RunAt(time_point time, TimerCallback cb) {
+        return timer_queue_->AddTimer(std::move(cb), time, {});
+    }
+    TimerId RunAfter(std::chrono::nanoseconds delay, TimerCallback cb) {
+        return RunAt(std::chrono::system_clock::now() + delay, std::move(cb));
+    }
+    TimerId RunEvery(std::chrono::nanoseconds interval, TimerCallback cb) {
+        assert(interval.count() > 0);
+        return timer_queue_->AddTimer(std::move(cb), std::chrono::system_clock::now() + interval, interval);
+    }
+    void Cancel(TimerId timer_id) {
+        timer_queue_->Cancel(timer_id);
+    }
+
+    // Deferred: the channel is only marked dirty and the poller sees its
+    // net interest once, right before the next Poll, so enable-then-disable
+    // within one iteration costs nothing.
     void UpdateChannel(Channel* channel) {
         assert(channel->owner_loop() == this);
         AssertInLoopThread();
-        poller_->UpdateChannel(channel);
+        poller_->CountUpdateRequest();
+        if (!channel->update_pending()) {
+            channel->set_dirty_index(dirty_channels_.size());
+            dirty_channels_.push_back(channel);
+        }
     }
     void RemoveChannel(Channel* channel) {
         assert(channel->owner_loop() == this);
@@ -125,7 +167,29 @@ public:
             assert(cur_active_channel_ == channel ||
                 std::ranges::find(active_channels_, channel) == active_channels_.end());
         }
-        poller_->RemoveChannel(channel);
+        if (channel->update_pending()) {
+            // Swapped with the last one, the order of updates doesn't matter.
+            auto index = channel->dirty_index();
+            auto last = dirty_channels_.back();
+            dirty_channels_[index] = last;
+            last->set_dirty_index(index);
+            dirty_channels_.pop_back();
+            channel->set_dirty_index(Channel::kNotDirty);
+        }
+        poller_->CountUpdateRequest();
+        if (channel->status() != Channel::kNew) {
+            poller_->RemoveChannel(channel);
+        }
+    }
+    auto update_stats() const noexcept { return poller_->update_stats(); }
+    // Storage for this loop's connection buffers, see BufferPool.
+    const auto& buffer_pool() const noexcept { return buffer_pool_; }
+    // Overflow area for Buffer::ReadFd, shared by every connection of the
+    // loop since only one reads at a time. Loop thread only.
+    std::span<char> read_scratch() noexcept { return {read_scratch_.get(), kReadScratchSize}; }
+    // nullptr unless the loop runs on IoUringPoller.
+    IoUringPoller* io_uring_poller() {
+        return dynamic_cast<IoUringPoller*>(poller_.get());
     }
     bool HasChannel(Channel* channel) {
         assert(channel->owner_loop() == this);
@@ -141,23 +205,35 @@ public:
     }
 
 private:
+    struct PendingFunctor : MpscNode {
+        explicit PendingFunctor(Functor f) : functor{std::move(f)} {}
+        Functor functor;
+    };
+
+    // Bounded so a flood of posts cannot starve I/O, whatever is left is
+    // picked up after a non-blocking Poll.
     void DoPendingFunctors() {
-        std::vector<Functor> functors;
-        calling_pending_functors_ = true;
-        {
-            std::scoped_lock lock{mutex_};
-            functors.swap(functors);
+        for (size_t i = 0; i < kMaxFunctorsPerIteration; i++) {
+            std::unique_ptr<PendingFunctor> node{pending_functors_.Pop()};
+            if (!node) break;
+            pending_count_.fetch_sub(1, std::memory_order_relaxed);
+            node->functor();
         }
-        for (decltype(auto) functor : functors) {
-            functor();
+    }
+
+    void FlushChannelUpdates() {
+        for (auto channel : dirty_channels_) {
+            channel->set_dirty_index(Channel::kNotDirty);
+            poller_->UpdateChannel(channel);
         }
-        calling_pending_functors_ = false;
+        dirty_channels_.clear();
     }
 
     void HandleRead() {
         uint64_t one = 1;
         auto n = ::read(wakeup_channel_->fd(), &one, sizeof(one));
-        if (n != sizeof(one)) {
+        wakeup_pending_.store(false, std::memory_order_release);
+        if (n != sizeof(one) && !(n == -1 && errno == EAGAIN)) {
             MUDUO_STUDY_LOG_ERROR("read: {} bytes instead of 8!", n);
         }
     }
@@ -165,19 +241,24 @@ private:
     std::atomic_bool looping_;
     std::atomic_bool quit_;
     std::atomic_bool event_handling_;
-    std::atomic_bool calling_pending_functors_;
+    std::atomic_bool polling_;
+    std::atomic_bool wakeup_pending_;
 
     int64_t iteration_;
     std::jthread::id thread_id_;
     time_point poll_return_time_;
 
     std::unique_ptr<Poller> poller_;
+    ChannelList dirty_channels_;
+    std::unique_ptr<TimerQueue> timer_queue_;
     ChannelList active_channels_;
     Channel* cur_active_channel_;
     std::unique_ptr<Channel> wakeup_channel_;
 
-    mutable std::mutex mutex_;
-    std::vector<Functor> pending_functors_;
+    MpscQueue<PendingFunctor> pending_functors_;
+    std::atomic_size_t pending_count_;
+    std::shared_ptr<BufferPool> buffer_pool_;
+    std::unique_ptr<char[]> read_scratch_;
 };
 
 
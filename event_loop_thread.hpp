@@ -14,7 +14,6 @@ public:
 
     explicit EventLoopThread(ThreadInitCallBack cb = ThreadInitCallBack()) :
         loop_{nullptr},
-        exiting_{false},
         thread_{},
         mutex_{},
         cv_{},
@@ -22,15 +21,20 @@ public:
         {}
 
     ~EventLoopThread() {
-        exiting_ = true;
-        if (loop_) {
-            loop_->Quit();
+        {
+            std::scoped_lock sl{mutex_};
+            if (loop_) {
+                // Queued, so it isn't lost if Loop() hasn't started yet.
+                loop_->QueueInLoop([loop = loop_]{ loop->Quit(); });
+            }
         }
+        // Here, the thread still uses mutex_ once the loop returned.
+        if (thread_.joinable()) thread_.join();
     }
 
     EventLoop* StartLoop() {
         assert(!thread_.joinable());
-        thread_ = std::jthread([this](){ this->StartLoop(); });
+        thread_ = std::jthread([this](){ this->ThreadFunc(); });
         {
             std::unique_lock lock{mutex_};
             while (!loop_) {
@@ -55,7 +59,6 @@ private:
     }
 
     EventLoop* loop_;
-    bool exiting_;
     std::jthread thread_;
     std::mutex mutex_;
     std::condition_variable cv_;
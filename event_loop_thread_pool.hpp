@@ -1,19 +1,50 @@
 #pragma once
 #include "core.hpp"
 #include "event_loop_thread.hpp"
+#include "inet_address.hpp"
+#include <algorithm>
 
 MUDUO_STUDY_BEGIN_NAMESPACE
 
+namespace details {
+// splitmix64's finalizer, spreads close inputs over the whole range.
+inline uint64_t Mix64(uint64_t x) noexcept {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+} // namespace details
+
 class EventLoopThreadPool
 {
 public:
     MUDUO_STUDY_NONCOPYABLE(EventLoopThreadPool)
 
+    // How GetNextLoop() picks the loop of a new connection.
+    enum Strategy {
+        kRoundRobin,
+        // Fewest live connections, counted through ConnectionOpened() and
+        // ConnectionClosed(). For connections of very different lifetimes.
+        kLeastConnections,
+        // Fewest functors waiting in the loop's queue, the busiest loop
+        // right now.
+        kLeastQueued,
+        // Same peer IP, same loop, while the number of loops doesn't
+        // change. Keeps per client state warm in one thread's caches.
+        kConsistentHash
+    };
+    // Points per loop on the hash ring, more spread the peers more evenly.
+    static constexpr size_t kVirtualNodes = 160;
+
     explicit EventLoopThreadPool(EventLoop* basic_loop, const std::string_view name) :
         basic_loop_{basic_loop},
         started_(false),
         num_threads_{0},
         next_{0},
+        strategy_{kRoundRobin},
         name_{name}
         {}
     ~EventLoopThreadPool() = default;
@@ -21,6 +52,8 @@ public:
     void set_thread_num(size_t num) {
         num_threads_ = num;
     }
+    void set_strategy(Strategy strategy) { strategy_ = strategy; }
+    auto strategy() const { return strategy_; }
     auto next_loop() {
         basic_loop_->AssertInLoopThread();
         assert(started_);
@@ -36,28 +69,111 @@ public:
     }
     auto all_loops() { return loops_; }
     auto started() { return started_; }
+    // Live connections on the loop, as reported to the pool.
+    size_t connections(EventLoop* loop) const {
+        auto index = IndexOf(loop);
+        return index < connections_.size() ? connections_[index] : 0;
+    }
 
     void Start(ThreadInitCallBack cb) {
         assert(!started_);
         basic_loop_->AssertInLoopThread();
         started_ = true;
         for (size_t i = 0; i < num_threads_; i++) {
-            threads_.push_back(std::make_unique<EventLoopThread>(std::move(cb)));
+            threads_.push_back(std::make_unique<EventLoopThread>(cb));
+            loops_.push_back(threads_.back()->StartLoop());
         }
+        connections_.assign(loops_.size(), 0);
+        BuildHashRing();
         if (num_threads_ == 0 && cb) {
             cb(basic_loop_);
         }
     }
 
+    // The loop for a new connection from peer_addr, by strategy(). The
+    // basic loop when there are no threads.
+    EventLoop* GetNextLoop(const InetAddress& peer_addr) {
+        basic_loop_->AssertInLoopThread();
+        assert(started_);
+        if (loops_.empty()) return basic_loop_;
+        switch (strategy_)
+        {
+        case kLeastConnections:
+            return LeastBy([this](size_t i) { return connections_[i]; });
+        case kLeastQueued:
+            return LeastBy([this](size_t i) { return loops_[i]->queue_size(); });
+        case kConsistentHash:
+            return LoopForHash(details::Mix64(peer_addr.sockaddr()->sin_addr.s_addr));
+        default:
+            return next_loop();
+        }
+    }
+    // Same hash, same loop, for other keys than the peer.
+    EventLoop* LoopForHash(uint64_t hash) const {
+        if (loops_.empty()) return basic_loop_;
+        auto it = std::ranges::lower_bound(hash_ring_, hash, {}, &HashPoint::hash);
+        if (it == hash_ring_.end()) it = hash_ring_.begin();
+        return loops_[it->index];
+    }
+
+    // Called in the basic loop by the owner of the connections, counts
+    // for kLeastConnections.
+    void ConnectionOpened(EventLoop* loop) {
+        basic_loop_->AssertInLoopThread();
+        if (auto index = IndexOf(loop); index < connections_.size()) {
+            ++connections_[index];
+        }
+    }
+    void ConnectionClosed(EventLoop* loop) {
+        basic_loop_->AssertInLoopThread();
+        if (auto index = IndexOf(loop); index < connections_.size()) {
+            assert(connections_[index] > 0);
+            --connections_[index];
+        }
+    }
+
 private:
+    struct HashPoint {
+        uint64_t hash;
+        size_t index;
+    };
+
+    size_t IndexOf(EventLoop* loop) const {
+        return static_cast<size_t>(std::ranges::find(loops_, loop) - loops_.begin());
+    }
+    // Ties go round robin, so an idle pool still spreads connections.
+    template<typename F>
+    EventLoop* LeastBy(F load) {
+        auto best = next_;
+        for (size_t n = 1; n < loops_.size(); n++) {
+            auto i = (next_ + n) % loops_.size();
+            if (load(i) < load(best)) best = i;
+        }
+        next_ = (next_ + 1) % loops_.size();
+        return loops_[best];
+    }
+    void BuildHashRing() {
+        hash_ring_.clear();
+        for (size_t i = 0; i < loops_.size(); i++) {
+            for (size_t v = 0; v < kVirtualNodes; v++) {
+                hash_ring_.push_back({details::Mix64(i * kVirtualNodes + v + 1), i});
+            }
+        }
+        std::ranges::sort(hash_ring_, {}, &HashPoint::hash);
+    }
+
     EventLoop* basic_loop_;
     bool started_;
     size_t num_threads_;
     size_t next_;
+    Strategy strategy_;
     std::string name_;
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop*> loops_;
+    // Indexed like loops_.
+    std::vector<size_t> connections_;
+    std::vector<HashPoint> hash_ring_;
 };
 
 
-MUDUO_STUDY_END_NAMESPACE
\ No newline at end of file
+MUDUO_STUDY_END_NAMESPACE
@@ -0,0 +1,307 @@
+#pragma once
+#include "buffer.hpp"
+#include "http_request.hpp"
+#include <charconv>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Incremental HTTP/1.x request parser working in place over a connection's
+// input buffer. Parse() picks up where the previous call stopped, lines are
+// never rescanned and nothing is retrieved until a whole request is there,
+// so the request's fields can point into the buffer. After handling the
+// request, Consume() retrieves it and gets ready for the next one, which
+// may already be waiting in the buffer (pipelining).
+class HttpContext
+{
+public:
+    enum ParseResult { kIncomplete, kComplete, kError };
+    static constexpr size_t kMaxHeaderBytes = 64 * 1024;
+    static constexpr size_t kDefaultMaxBodyBytes = 64 * 1024 * 1024;
+
+    explicit HttpContext(size_t max_body_bytes = kDefaultMaxBodyBytes) :
+        state_{kRequestLine},
+        pos_{0},
+        scanned_{0},
+        chunk_remaining_{0},
+        // Offsets into the buffer are 32-bit.
+        max_body_bytes_{std::min<size_t>(max_body_bytes, UINT32_MAX - kMaxHeaderBytes)},
+        has_content_length_{false},
+        error_status_{0} {}
+
+    const HttpRequest& request() const noexcept { return request_; }
+    // The status to answer with after kError: 400, 413, 431, 501 or 505.
+    auto error_status() const noexcept { return error_status_; }
+
+    ParseResult Parse(const Buffer& buf) {
+        auto data = buf.peek();
+        auto readable = buf.readable_bytes();
+        while (true) {
+            switch (state_) {
+            case kRequestLine:
+            case kHeaders:
+            case kChunkSize:
+            case kTrailers: {
+                auto line = NextLine(data, readable);
+                if (!line) {
+                    if (readable - pos_ > kMaxHeaderBytes) {
+                        Reject(431);
+                        return kError;
+                    }
+                    return kIncomplete;
+                }
+                if (!HandleLine(data, *line)) {
+                    return kError;
+                }
+                break;
+            }
+            case kBody:
+                if (readable - pos_ < request_.content_length_) {
+                    return kIncomplete;
+                }
+                request_.body_field_ = MakeField(pos_, request_.content_length_);
+                pos_ += request_.content_length_;
+                state_ = kDone;
+                break;
+            case kChunkData:
+                if (readable - pos_ < chunk_remaining_ + 2) {
+                    return kIncomplete;
+                }
+                if (data[pos_ + chunk_remaining_] != '\r' || data[pos_ + chunk_remaining_ + 1] != '\n') {
+                    Reject(400);
+                    return kError;
+                }
+                request_.chunked_body_.append(data + pos_, chunk_remaining_);
+                pos_ += chunk_remaining_ + 2;
+                scanned_ = pos_;
+                state_ = kChunkSize;
+                break;
+            case kDone:
+                request_.base_ = data;
+                return kComplete;
+            }
+        }
+    }
+    // Retrieves the request just handled.
+    void Consume(Buffer* buf) {
+        assert(state_ == kDone);
+        buf->Retrieve(pos_);
+        state_ = kRequestLine;
+        pos_ = scanned_ = 0;
+        has_content_length_ = false;
+        request_.Reset();
+    }
+
+private:
+    enum State { kRequestLine, kHeaders, kBody, kChunkSize, kChunkData, kTrailers, kDone };
+
+    struct Line {
+        size_t offset;
+        size_t size;
+    };
+
+    // The next CRLF terminated line, resuming the search where the last
+    // unsuccessful one ended.
+    std::optional<Line> NextLine(const char* data, size_t readable) {
+        auto from = std::max(pos_, scanned_);
+        auto eol = FindCRLF(data + from, data + readable);
+        if (!eol) {
+            // A trailing \r may be the first half of a \r\n.
+            scanned_ = std::max(pos_, readable > 0 ? readable - 1 : 0);
+            return std::nullopt;
+        }
+        Line line{pos_, static_cast<size_t>(eol - data) - pos_};
+        pos_ = scanned_ = eol - data + 2;
+        return line;
+    }
+
+    bool HandleLine(const char* data, Line line) {
+        std::string_view text{data + line.offset, line.size};
+        switch (state_) {
+        case kRequestLine:
+            // Empty lines ahead of a request are to be ignored, but they
+            // stay in the buffer until the request is consumed, so they
+            // count against the header limit.
+            if (pos_ > kMaxHeaderBytes) return Reject(400);
+            if (text.empty()) return true;
+            if (!ParseRequestLine(text, line.offset)) return false;
+            state_ = kHeaders;
+            return true;
+        case kHeaders:
+            if (pos_ > kMaxHeaderBytes) return Reject(431);
+            if (text.empty()) {
+                return EndOfHeaders();
+            }
+            return ParseHeader(text, line.offset);
+        case kChunkSize: {
+            // Chunk extensions after ';' are ignored.
+            auto digits = text.substr(0, text.find(';'));
+            while (!digits.empty() && (digits.back() == ' ' || digits.back() == '\t')) {
+                digits.remove_suffix(1);
+            }
+            size_t size = 0;
+            auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), size, 16);
+            if (digits.empty() || ec != std::errc{} || ptr != digits.data() + digits.size()) {
+                return Reject(400);
+            }
+            if (size > max_body_bytes_ - request_.chunked_body_.size()) {
+                return Reject(413);
+            }
+            chunk_remaining_ = size;
+            state_ = size == 0 ? kTrailers : kChunkData;
+            return true;
+        }
+        case kTrailers:
+            if (text.empty()) {
+                state_ = kDone;
+            }
+            return true;
+        default:
+            assert(false);
+            return false;
+        }
+    }
+
+    bool ParseRequestLine(std::string_view text, size_t offset) {
+        auto method_end = text.find(' ');
+        if (method_end == text.npos || method_end == 0) return Reject(400);
+        auto target_end = text.find(' ', method_end + 1);
+        if (target_end == text.npos || target_end == method_end + 1) return Reject(400);
+        auto method = text.substr(0, method_end);
+        auto target = text.substr(method_end + 1, target_end - method_end - 1);
+        auto version = text.substr(target_end + 1);
+
+        request_.method_ = ParseMethod(method);
+        if (request_.method_ == HttpRequest::kInvalid) return Reject(400);
+        if (version == "HTTP/1.1") {
+            request_.version_ = HttpRequest::kHttp11;
+            request_.keep_alive_ = true;
+        }
+        else if (version == "HTTP/1.0") {
+            request_.version_ = HttpRequest::kHttp10;
+        }
+        else {
+            return Reject(version.starts_with("HTTP/") ? 505 : 400);
+        }
+        request_.method_field_ = MakeField(offset, method.size());
+        auto target_offset = offset + method_end + 1;
+        auto question = target.find('?');
+        if (question == target.npos) {
+            request_.path_field_ = MakeField(target_offset, target.size());
+        }
+        else {
+            request_.path_field_ = MakeField(target_offset, question);
+            request_.query_field_ = MakeField(target_offset + question + 1, target.size() - question - 1);
+        }
+        return true;
+    }
+
+    bool ParseHeader(std::string_view text, size_t offset) {
+        auto colon = text.find(':');
+        if (colon == text.npos || colon == 0) return Reject(400);
+        auto name = text.substr(0, colon);
+        if (name.find_first_of(" \t") != name.npos) return Reject(400);
+        // Optional whitespace around the value isn't part of it.
+        auto value_begin = text.find_first_not_of(" \t", colon + 1);
+        auto value_end = text.find_last_not_of(" \t");
+        auto value = value_begin == text.npos
+            ? std::string_view{}
+            : text.substr(value_begin, value_end + 1 - value_begin);
+
+        if (HttpFieldEquals(name, "Content-Length")) {
+            size_t length = 0;
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), length);
+            if (value.empty() || ec != std::errc{} || ptr != value.data() + value.size()) {
+                return Reject(400);
+            }
+            if (has_content_length_ && length != request_.content_length_) {
+                return Reject(400);
+            }
+            if (length > max_body_bytes_) return Reject(413);
+            request_.content_length_ = length;
+            has_content_length_ = true;
+        }
+        else if (HttpFieldEquals(name, "Transfer-Encoding")) {
+            // Only chunked is understood, and it has to come last.
+            auto last = value.substr(value.rfind(',') == value.npos ? 0 : value.rfind(',') + 1);
+            last.remove_prefix(std::min(last.find_first_not_of(" \t"), last.size()));
+            if (!HttpFieldEquals(last, "chunked")) return Reject(501);
+            request_.chunked_ = true;
+        }
+        else if (HttpFieldEquals(name, "Connection")) {
+            ForEachToken(value, [&](std::string_view token){
+                if (HttpFieldEquals(token, "close")) {
+                    request_.keep_alive_ = false;
+                }
+                else if (HttpFieldEquals(token, "keep-alive")) {
+                    request_.keep_alive_ = true;
+                }
+            });
+        }
+        auto value_offset = value.empty() ? offset + text.size() : offset + (value.data() - text.data());
+        request_.headers_.push_back({MakeField(offset, name.size()), MakeField(value_offset, value.size())});
+        return true;
+    }
+
+    bool EndOfHeaders() {
+        // Both framings at once is how requests get smuggled past proxies.
+        if (request_.chunked_ && has_content_length_) {
+            return Reject(400);
+        }
+        if (request_.chunked_) {
+            state_ = kChunkSize;
+        }
+        else if (request_.content_length_ > 0) {
+            state_ = kBody;
+        }
+        else {
+            state_ = kDone;
+        }
+        return true;
+    }
+
+    bool Reject(int status) {
+        error_status_ = status;
+        return false;
+    }
+
+    template<typename F>
+    static void ForEachToken(std::string_view list, F&& f) {
+        while (!list.empty()) {
+            auto comma = list.find(',');
+            auto token = list.substr(0, comma);
+            token.remove_prefix(std::min(token.find_first_not_of(" \t"), token.size()));
+            while (!token.empty() && (token.back() == ' ' || token.back() == '\t')) {
+                token.remove_suffix(1);
+            }
+            f(token);
+            if (comma == list.npos) break;
+            list.remove_prefix(comma + 1);
+        }
+    }
+    static HttpRequest::Method ParseMethod(std::string_view method) noexcept {
+        if (method == "GET") return HttpRequest::kGet;
+        if (method == "POST") return HttpRequest::kPost;
+        if (method == "HEAD") return HttpRequest::kHead;
+        if (method == "PUT") return HttpRequest::kPut;
+        if (method == "DELETE") return HttpRequest::kDelete;
+        if (method == "OPTIONS") return HttpRequest::kOptions;
+        if (method == "PATCH") return HttpRequest::kPatch;
+        return HttpRequest::kInvalid;
+    }
+    static HttpRequest::Field MakeField(size_t offset, size_t size) noexcept {
+        return {static_cast<uint32_t>(offset), static_cast<uint32_t>(size)};
+    }
+
+    State state_;
+    // Offset of the next unparsed byte from peek().
+    size_t pos_;
+    // The CRLF search resumes here, bytes before it hold none.
+    size_t scanned_;
+    size_t chunk_remaining_;
+    size_t max_body_bytes_;
+    bool has_content_length_;
+    int error_status_;
+    HttpRequest request_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
@@ -0,0 +1,110 @@
+#pragma once
+#include "core.hpp"
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Case-insensitive, as header names are.
+inline bool HttpFieldEquals(std::string_view a, std::string_view b) noexcept {
+    auto lower = [](char c){ return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c; };
+    return a.size() == b.size() && std::ranges::equal(a, b, [&](char x, char y){
+        return lower(x) == lower(y);
+    });
+}
+
+// A parsed request. Everything but a chunked body is a view into the
+// connection's input buffer, stored as offsets while the request is
+// incomplete (the buffer may move when more data arrives) and only valid
+// while the HttpCallback runs.
+class HttpRequest
+{
+public:
+    enum Method { kInvalid, kGet, kPost, kHead, kPut, kDelete, kOptions, kPatch };
+    enum Version { kUnknown, kHttp10, kHttp11 };
+
+    struct Header {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    HttpRequest() :
+        base_{nullptr},
+        method_{kInvalid},
+        version_{kUnknown},
+        content_length_{0},
+        chunked_{false},
+        keep_alive_{false} {}
+
+    auto method() const noexcept { return method_; }
+    auto version() const noexcept { return version_; }
+    std::string_view method_string() const noexcept { return View(method_field_); }
+    std::string_view path() const noexcept { return View(path_field_); }
+    std::string_view query() const noexcept { return View(query_field_); }
+    std::string_view body() const noexcept {
+        return chunked_ ? std::string_view{chunked_body_} : View(body_field_);
+    }
+    size_t header_count() const noexcept { return headers_.size(); }
+    Header header(size_t i) const noexcept {
+        return {View(headers_[i].name), View(headers_[i].value)};
+    }
+    // First header called name, empty if there is none.
+    std::string_view header(std::string_view name) const noexcept {
+        for (auto& field : headers_) {
+            if (HttpFieldEquals(View(field.name), name)) {
+                return View(field.value);
+            }
+        }
+        return {};
+    }
+    bool chunked() const noexcept { return chunked_; }
+    // Whether the client wants the connection kept open afterwards.
+    bool keep_alive() const noexcept { return keep_alive_; }
+
+private:
+    friend class HttpContext;
+
+    // Offsets from the start of the request in the input buffer.
+    struct Field {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+    };
+    struct HeaderField {
+        Field name;
+        Field value;
+    };
+
+    std::string_view View(Field field) const noexcept {
+        return base_ ? std::string_view{base_ + field.offset, field.size} : std::string_view{};
+    }
+    // Keeps the capacity of headers_ and chunked_body_, a connection stops
+    // allocating once it has seen its largest request.
+    void Reset() {
+        base_ = nullptr;
+        method_ = kInvalid;
+        version_ = kUnknown;
+        method_field_ = path_field_ = query_field_ = body_field_ = Field{};
+        headers_.clear();
+        content_length_ = 0;
+        chunked_ = false;
+        keep_alive_ = false;
+        chunked_body_.clear();
+    }
+
+    const char* base_;
+    Method method_;
+    Version version_;
+    Field method_field_;
+    Field path_field_;
+    Field query_field_;
+    Field body_field_;
+    std::vector<HeaderField> headers_;
+    size_t content_length_;
+    bool chunked_;
+    bool keep_alive_;
+    std::string chunked_body_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
@@ -0,0 +1,219 @@
+#pragma once
+#include "buffer.hpp"
+#include <charconv>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Builds a response straight into the connection's output buffer: the
+// status line and headers are written as they are added, there is no
+// header map. So the status goes first, then headers, then the body, which
+// ends the headers. Either one set_body() or any number of AppendChunk()
+// for a chunked body. Content-Length and Connection are written by the
+// library. HTTP/1.0 has no chunked encoding, there AppendChunk() writes the
+// data as is and the connection closes to end the body.
+class HttpResponse
+{
+public:
+    enum StatusCode {
+        k200Ok = 200,
+        k204NoContent = 204,
+        k301MovedPermanently = 301,
+        k302Found = 302,
+        k304NotModified = 304,
+        k400BadRequest = 400,
+        k404NotFound = 404,
+        k413ContentTooLarge = 413,
+        k431RequestHeaderFieldsTooLarge = 431,
+        k500InternalServerError = 500,
+        k501NotImplemented = 501,
+        k505HttpVersionNotSupported = 505,
+    };
+    // Owned bodies from this size on are queued by reference instead of
+    // being copied behind the headers.
+    static constexpr size_t kMinReferenceBody = 16 * 1024;
+
+    HttpResponse(Buffer* output, bool close_connection, bool http10 = false, bool head = false) :
+        output_{output},
+        status_{k200Ok},
+        reason_{},
+        close_connection_{close_connection},
+        http10_{http10},
+        head_{head},
+        stage_{kStatus} {}
+
+    auto status() const noexcept { return status_; }
+    bool close_connection() const noexcept { return close_connection_; }
+
+    // Before any header. An empty reason takes the standard one.
+    void set_status(int status, std::string_view reason = {}) {
+        assert(stage_ == kStatus);
+        status_ = status;
+        reason_ = reason;
+    }
+    // Before the body.
+    void set_close_connection(bool on) {
+        assert(stage_ < kBody);
+        close_connection_ = on;
+    }
+    void AddHeader(std::string_view name, std::string_view value) {
+        StartHeaders();
+        assert(stage_ == kHeaders);
+        Append(name);
+        Append(": ");
+        Append(value);
+        Append("\r\n");
+    }
+    void set_content_type(std::string_view type) { AddHeader("Content-Type", type); }
+
+    // Copied behind the headers.
+    void set_body(std::string_view body) {
+        EndHeaders(body.size());
+        if (SendsBody()) {
+            Append(body);
+        }
+    }
+    void set_body(std::string&& body) {
+        if (body.size() < kMinReferenceBody) {
+            set_body(std::string_view{body});
+            return;
+        }
+        EndHeaders(body.size());
+        if (SendsBody()) {
+            body_ = std::move(body);
+        }
+    }
+    // Shared, e.g. a cached file, never copied.
+    void set_body(std::shared_ptr<const std::string> body) {
+        EndHeaders(body->size());
+        if (SendsBody()) {
+            body_ = std::move(body);
+        }
+    }
+    void AppendChunk(std::string_view data) {
+        if (stage_ != kChunked) {
+            StartHeaders();
+            assert(stage_ == kHeaders);
+            if (http10_) {
+                close_connection_ = true;
+                AppendConnection();
+                Append("\r\n");
+            }
+            else {
+                AppendConnection();
+                Append("Transfer-Encoding: chunked\r\n\r\n");
+            }
+            stage_ = kChunked;
+        }
+        // An empty chunk would end the body.
+        if (data.empty() || head_) return;
+        if (http10_) {
+            Append(data);
+            return;
+        }
+        AppendNumber(data.size(), 16);
+        Append("\r\n");
+        Append(data);
+        Append("\r\n");
+    }
+
+    static std::string_view ReasonPhrase(int status) noexcept {
+        switch (status) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Content Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Unknown";
+        }
+    }
+
+private:
+    friend class HttpServer;
+    enum Stage { kStatus, kHeaders, kBody, kChunked, kDone };
+    using Body = std::variant<std::monostate, std::string, std::shared_ptr<const std::string>>;
+
+    void StartHeaders() {
+        if (stage_ != kStatus) return;
+        Append(http10_ ? "HTTP/1.0 " : "HTTP/1.1 ");
+        AppendNumber(status_, 10);
+        Append(" ");
+        Append(reason_.empty() ? ReasonPhrase(status_) : std::string_view{reason_});
+        Append("\r\n");
+        stage_ = kHeaders;
+    }
+    void EndHeaders(size_t content_length) {
+        StartHeaders();
+        assert(stage_ == kHeaders);
+        AppendConnection();
+        if (HasBody()) {
+            Append("Content-Length: ");
+            AppendNumber(content_length, 10);
+            Append("\r\n");
+        }
+        Append("\r\n");
+        stage_ = kBody;
+    }
+    // 1xx, 204 and 304 have no body, so nothing to frame either. A body
+    // set anyway is dropped, it would be read as the next response.
+    bool HasBody() const noexcept {
+        return status_ >= 200 && status_ != k204NoContent && status_ != k304NotModified;
+    }
+    bool SendsBody() const noexcept { return !head_ && HasBody(); }
+    // HTTP/1.1 keeps the connection by default, HTTP/1.0 closes it.
+    void AppendConnection() {
+        if (close_connection_ && !http10_) {
+            Append("Connection: close\r\n");
+        }
+        else if (!close_connection_ && http10_) {
+            Append("Connection: keep-alive\r\n");
+        }
+    }
+    // Called once the handler returned, completes what it left open. A
+    // response without a body gets an empty one.
+    void Finish() {
+        if (stage_ == kStatus || stage_ == kHeaders) {
+            EndHeaders(0);
+        }
+        else if (stage_ == kChunked && !head_ && !http10_) {
+            Append("0\r\n\r\n");
+        }
+        stage_ = kDone;
+    }
+    Body TakeBody() { return std::exchange(body_, Body{}); }
+
+    void Append(std::string_view data) { output_->Append(data); }
+    void AppendNumber(size_t n, int base) {
+        char digits[32];
+        auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), n, base);
+        Append({digits, end});
+    }
+
+    Buffer* output_;
+    int status_;
+    std::string reason_;
+    bool close_connection_;
+    bool http10_;
+    bool head_;
+    Stage stage_;
+    Body body_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
@@ -0,0 +1,129 @@
+#pragma once
+#include "tcp_server.hpp"
+#include "http_context.hpp"
+#include "http_request.hpp"
+#include "http_response.hpp"
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+using HttpCallback = std::function<void (const HttpRequest&, HttpResponse*)>;
+
+namespace details {
+inline void DefaultHttpCallback(const HttpRequest&, HttpResponse* resp) {
+    resp->set_status(HttpResponse::k404NotFound);
+    resp->set_close_connection(true);
+}
+}
+
+// HTTP/1.1 over TcpServer with keep-alive and pipelining. The callback runs
+// in the connection's loop for each request in arrival order and fills in
+// the response right there, all responses to the requests of one read are
+// flushed together with a single write.
+class HttpServer
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(HttpServer)
+
+    HttpServer(EventLoop* loop, const InetAddress& listen_addr, std::string_view name,
+               TcpServer::Option opt = TcpServer::kNoReusePort) :
+        server_{loop, listen_addr, name, opt},
+        http_callback_{details::DefaultHttpCallback},
+        max_body_bytes_{HttpContext::kDefaultMaxBodyBytes}
+    {
+        server_.set_connection_callback([this](auto conn){ OnConnection(conn); });
+        server_.set_message_callback([this](auto conn, auto buf, auto receive_time){
+            OnMessage(conn, buf, receive_time);
+        });
+    }
+
+    // For the transport options (threads, io mode, ...), before Start().
+    auto& server() noexcept { return server_; }
+    void set_http_callback(HttpCallback cb) { http_callback_ = std::move(cb); }
+    void set_thread_num(size_t num) { server_.set_thread_num(num); }
+    // Bigger request bodies are answered with 413 and the connection closed.
+    void set_max_body_bytes(size_t bytes) { max_body_bytes_ = bytes; }
+
+    void Start() {
+        server_.Start();
+    }
+
+private:
+    // Per connection, kept in its context.
+    struct Session {
+        Session(std::shared_ptr<BufferPool> pool, size_t max_body_bytes) :
+            context{max_body_bytes},
+            output{std::move(pool)} {}
+        HttpContext context;
+        Buffer output;
+    };
+
+    void OnConnection(const TcpConnectionPtr& conn) {
+        if (conn->connected()) {
+            conn->set_context(std::make_shared<Session>(conn->loop()->buffer_pool(), max_body_bytes_));
+        }
+    }
+
+    void OnMessage(const TcpConnectionPtr& conn, Buffer* buf, time_point) {
+        // Once closing, pipelined requests behind the last response are
+        // dropped.
+        if (!conn->connected()) {
+            buf->RetrieveAll();
+            return;
+        }
+        auto session = std::any_cast<std::shared_ptr<Session>>(conn->mutable_context())->get();
+        auto& context = session->context;
+        bool close = false;
+        while (!close) {
+            auto result = context.Parse(*buf);
+            if (result == HttpContext::kIncomplete) {
+                break;
+            }
+            if (result == HttpContext::kError) {
+                HttpResponse resp(&session->output, true);
+                resp.set_status(context.error_status());
+                resp.Finish();
+                buf->RetrieveAll();
+                close = true;
+                break;
+            }
+            auto& req = context.request();
+            HttpResponse resp(&session->output, !req.keep_alive(),
+                              req.version() == HttpRequest::kHttp10,
+                              req.method() == HttpRequest::kHead);
+            http_callback_(req, &resp);
+            resp.Finish();
+            close = resp.close_connection();
+            // A body queued by reference goes out behind what was built so
+            // far, the order of the responses is kept.
+            auto body = resp.TakeBody();
+            if (!std::holds_alternative<std::monostate>(body)) {
+                Flush(conn, &session->output);
+                std::visit([&](auto&& owned){
+                    if constexpr (!std::is_same_v<std::decay_t<decltype(owned)>, std::monostate>) {
+                        conn->Send(std::move(owned));
+                    }
+                }, std::move(body));
+            }
+            context.Consume(buf);
+        }
+        Flush(conn, &session->output);
+        if (close) {
+            conn->Shutdown();
+        }
+    }
+
+    // Whatever the socket doesn't take right away is copied into the
+    // connection's output queue, so the buffer can be reused at once.
+    static void Flush(const TcpConnectionPtr& conn, Buffer* output) {
+        if (output->readable_bytes() > 0) {
+            conn->Send(std::span(output->peek(), output->readable_bytes()));
+            output->RetrieveAll();
+        }
+    }
+
+    TcpServer server_;
+    HttpCallback http_callback_;
+    size_t max_body_bytes_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
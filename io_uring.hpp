@@ -0,0 +1,307 @@
+#pragma once
+#include "core.hpp"
+#include "logger.hpp"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <memory>
+#include <span>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Minimal io_uring wrapper on top of the raw syscalls, so there is no
+// liburing dependency. Owned and driven by a single EventLoop thread.
+class IoUring
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(IoUring)
+
+    static constexpr unsigned kDefaultEntries = 256;
+
+    // Fails with the errno of io_uring_setup(), or ENOSYS when the kernel
+    // lacks the features we rely on (single mmap, IORING_ENTER_EXT_ARG).
+    static auto Create(unsigned entries = kDefaultEntries) -> std::expected<std::unique_ptr<IoUring>, int> {
+        io_uring_params params;
+        ZeroMemory(params);
+        params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+        int fd = Setup(entries, &params);
+        if (fd == -1 && errno == EINVAL) {
+            ZeroMemory(params);
+            fd = Setup(entries, &params);
+        }
+        if (fd == -1) {
+            return std::unexpected(errno);
+        }
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+            ::close(fd);
+            return std::unexpected(ENOSYS);
+        }
+        std::unique_ptr<IoUring> ring{new IoUring(fd, params)};
+        if (!ring->ring_ptr_ || !ring->sqes_) {
+            return std::unexpected(ENOMEM);
+        }
+        return ring;
+    }
+
+    ~IoUring() {
+        if (sqes_) ::munmap(sqes_, sqes_size_);
+        if (ring_ptr_) ::munmap(ring_ptr_, ring_size_);
+        ::close(ring_fd_);
+    }
+
+    auto fd() const noexcept { return ring_fd_; }
+    auto sq_entries() const noexcept { return sq_entries_; }
+    auto features() const noexcept { return features_; }
+    auto pending_submissions() const noexcept { return sqe_tail_ - sqe_head_; }
+
+    // Never returns nullptr, flushes the queue to the kernel when it is full.
+    io_uring_sqe* GetSqe() {
+        auto head = std::atomic_ref{*sq_head_}.load(std::memory_order_acquire);
+        if (sqe_tail_ - head >= sq_entries_) {
+            Submit();
+            head = std::atomic_ref{*sq_head_}.load(std::memory_order_acquire);
+            assert(sqe_tail_ - head < sq_entries_);
+        }
+        auto sqe = &sqes_[sqe_tail_ & sq_mask_];
+        ZeroMemory(sqe);
+        ++sqe_tail_;
+        return sqe;
+    }
+
+    int Submit() {
+        return Enter(FlushSq(), 0, 0, nullptr);
+    }
+    // Submits and runs, without waiting, the completion work the kernel
+    // defers to io_uring_enter() under IORING_SETUP_DEFER_TASKRUN. A
+    // cancelled request lets go of its file only then.
+    int SubmitAndComplete() {
+        return Enter(FlushSq(), 0, IORING_ENTER_GETEVENTS, nullptr);
+    }
+    // Submits everything queued and waits for at least one completion or
+    // the timeout, in one syscall. Returns -1 with errno ETIME on timeout.
+    int SubmitAndWait(std::chrono::nanoseconds timeout) {
+        auto secs = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        __kernel_timespec ts;
+        ts.tv_sec = secs.count();
+        ts.tv_nsec = (timeout - secs).count();
+        io_uring_getevents_arg arg;
+        ZeroMemory(arg);
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        return Enter(FlushSq(), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg);
+    }
+
+    // Calls fn(const io_uring_cqe&) for every available completion and
+    // returns how many were consumed.
+    template<typename Fn>
+    size_t ForEachCqe(Fn&& fn) {
+        auto head = *cq_head_;
+        auto tail = std::atomic_ref{*cq_tail_}.load(std::memory_order_acquire);
+        size_t n = 0;
+        for (; head != tail; ++head, ++n) {
+            fn(cqes_[head & cq_mask_]);
+        }
+        std::atomic_ref{*cq_head_}.store(head, std::memory_order_release);
+        return n;
+    }
+
+    int Register(unsigned opcode, void* arg, unsigned nr_args) {
+        return static_cast<int>(::syscall(__NR_io_uring_register, ring_fd_, opcode, arg, nr_args));
+    }
+
+private:
+    static int Setup(unsigned entries, io_uring_params* params) {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    IoUring(int fd, const io_uring_params& params) :
+        ring_fd_{fd},
+        features_{params.features},
+        sq_entries_{params.sq_entries},
+        ring_ptr_{nullptr},
+        sqes_{nullptr},
+        sqe_head_{0},
+        sqe_tail_{0}
+    {
+        ring_size_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                              params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        auto ptr = ::mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (ptr == MAP_FAILED) {
+            MUDUO_STUDY_LOG_SYSERR("mmap io_uring rings failed!");
+            return;
+        }
+        ring_ptr_ = static_cast<char*>(ptr);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        ptr = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (ptr == MAP_FAILED) {
+            MUDUO_STUDY_LOG_SYSERR("mmap io_uring sqes failed!");
+            return;
+        }
+        sqes_ = static_cast<io_uring_sqe*>(ptr);
+
+        sq_head_ = reinterpret_cast<unsigned*>(ring_ptr_ + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(ring_ptr_ + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(ring_ptr_ + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(ring_ptr_ + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned*>(ring_ptr_ + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(ring_ptr_ + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(ring_ptr_ + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(ring_ptr_ + params.cq_off.cqes);
+        // Identity mapping, the indirection array is never reordered.
+        for (unsigned i = 0; i < params.sq_entries; i++) {
+            sq_array_[i] = i;
+        }
+    }
+
+    unsigned FlushSq() {
+        auto to_submit = sqe_tail_ - sqe_head_;
+        if (to_submit > 0) {
+            std::atomic_ref{*sq_tail_}.store(sqe_tail_, std::memory_order_release);
+            sqe_head_ = sqe_tail_;
+        }
+        return to_submit;
+    }
+
+    int Enter(unsigned to_submit, unsigned min_complete, unsigned flags, io_uring_getevents_arg* arg) {
+        if (to_submit == 0 && !(flags & IORING_ENTER_GETEVENTS)) {
+            return 0;
+        }
+        return static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags,
+                                          arg, arg ? sizeof(*arg) : 0));
+    }
+
+    const int ring_fd_;
+    const unsigned features_;
+    const unsigned sq_entries_;
+
+    char* ring_ptr_;
+    size_t ring_size_;
+    io_uring_sqe* sqes_;
+    size_t sqes_size_;
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned sq_mask_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+
+    unsigned sqe_head_;
+    unsigned sqe_tail_;
+};
+
+// A ring of equally sized buffers registered with IORING_REGISTER_PBUF_RING.
+// Receives submitted with IOSQE_BUFFER_SELECT and buf_group() pick a buffer
+// themselves, the consumer hands it back with Recycle() once copied out.
+class IoUringBufferRing
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(IoUringBufferRing)
+
+    static constexpr uint16_t kDefaultCount = 256;
+    static constexpr uint32_t kDefaultSize = 16 * 1024;
+
+    static auto Create(IoUring* ring, uint16_t group_id,
+                       uint16_t count = kDefaultCount,
+                       uint32_t buffer_size = kDefaultSize) -> std::expected<std::unique_ptr<IoUringBufferRing>, int>
+    {
+        assert(count > 0 && (count & (count - 1)) == 0);
+        std::unique_ptr<IoUringBufferRing> buf_ring{new IoUringBufferRing(ring, group_id, count, buffer_size)};
+        if (!buf_ring->buf_ring_ || !buf_ring->storage_) {
+            return std::unexpected(ENOMEM);
+        }
+        io_uring_buf_reg reg;
+        ZeroMemory(reg);
+        reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring->buf_ring_);
+        reg.ring_entries = count;
+        reg.bgid = group_id;
+        if (ring->Register(IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+            return std::unexpected(errno);
+        }
+        buf_ring->registered_ = true;
+        for (uint16_t bid = 0; bid < count; bid++) {
+            buf_ring->Add(bid);
+        }
+        buf_ring->Publish();
+        return buf_ring;
+    }
+
+    ~IoUringBufferRing() {
+        if (registered_) {
+            io_uring_buf_reg reg;
+            ZeroMemory(reg);
+            reg.bgid = group_id_;
+            uring_->Register(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        }
+        if (buf_ring_) ::munmap(buf_ring_, ring_size_);
+        if (storage_) ::munmap(storage_, storage_size_);
+    }
+
+    auto buf_group() const noexcept { return group_id_; }
+    auto buffer_size() const noexcept { return buffer_size_; }
+    std::span<const char> buffer(uint16_t bid, size_t len) const {
+        assert(bid < count_ && len <= buffer_size_);
+        return {storage_ + static_cast<size_t>(bid) * buffer_size_, len};
+    }
+
+    void Recycle(uint16_t bid) {
+        Add(bid);
+        Publish();
+    }
+
+private:
+    IoUringBufferRing(IoUring* ring, uint16_t group_id, uint16_t count, uint32_t buffer_size) :
+        uring_{ring},
+        buf_ring_{nullptr},
+        storage_{nullptr},
+        group_id_{group_id},
+        count_{count},
+        buffer_size_{buffer_size},
+        tail_{0},
+        registered_{false}
+    {
+        ring_size_ = count * sizeof(io_uring_buf);
+        auto ptr = ::mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            MUDUO_STUDY_LOG_SYSERR("mmap buffer ring failed!");
+            return;
+        }
+        buf_ring_ = static_cast<io_uring_buf_ring*>(ptr);
+        storage_size_ = static_cast<size_t>(count) * buffer_size;
+        ptr = ::mmap(nullptr, storage_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            MUDUO_STUDY_LOG_SYSERR("mmap buffer ring storage failed!");
+            return;
+        }
+        storage_ = static_cast<char*>(ptr);
+    }
+
+    void Add(uint16_t bid) {
+        // Not buf_ring_->bufs: in C++ the empty struct __DECLARE_FLEX_ARRAY
+        // puts in front of it has size 1, which shifts bufs by 8 bytes.
+        auto& buf = reinterpret_cast<io_uring_buf*>(buf_ring_)[tail_ & (count_ - 1)];
+        buf.addr = reinterpret_cast<uint64_t>(storage_ + static_cast<size_t>(bid) * buffer_size_);
+        buf.len = buffer_size_;
+        buf.bid = bid;
+        ++tail_;
+    }
+    void Publish() {
+        std::atomic_ref{buf_ring_->tail}.store(tail_, std::memory_order_release);
+    }
+
+    IoUring* uring_;
+    io_uring_buf_ring* buf_ring_;
+    size_t ring_size_;
+    char* storage_;
+    size_t storage_size_;
+    const uint16_t group_id_;
+    const uint16_t count_;
+    const uint32_t buffer_size_;
+    uint16_t tail_;
+    bool registered_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
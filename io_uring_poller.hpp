@@ -0,0 +1,315 @@
+#pragma once
+#include "logger.hpp"
+#include "poller.hpp"
+#include "channel.hpp"
+#include "io_uring.hpp"
+#include <poll.h>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Readiness polling through IORING_OP_POLL_ADD. Interest changes only queue
+// SQEs, they reach the kernel together with the next wait in Poll(), so a
+// loop iteration costs one io_uring_enter() no matter how many channels
+// changed.
+//
+// Multishot poll is edge triggered (it only fires on new wakeups), so it is
+// used for channels registered with EPOLLET. Level triggered channels get a
+// one-shot poll which is re-armed lazily after the event was handled, the
+// re-arm rides along with the next submit and costs no extra syscall.
+//
+// Besides readiness, owners of an fd can submit their own operations
+// (recv/send) through PrepareCompletion(), the completions are routed back
+// to the handler registered with AddCompletionHandler().
+class IoUringPoller : public Poller
+{
+public:
+    using CompletionHandler = std::move_only_function<void(uint8_t op, const io_uring_cqe& cqe)>;
+    using CompletionToken = uint64_t;
+    static constexpr uint16_t kRecvBufferGroup = 0;
+
+    IoUringPoller(EventLoop* loop, std::unique_ptr<IoUring> ring) :
+        Poller{loop},
+        ring_{std::move(ring)},
+        next_generation_{1},
+        poll_round_{0},
+        buffer_ring_failed_{false} {}
+
+    ~IoUringPoller() override = default;
+
+    auto ring() noexcept { return ring_.get(); }
+
+    // Shared provided-buffer ring for receives, created on first use.
+    // nullptr when the kernel doesn't support IORING_REGISTER_PBUF_RING.
+    IoUringBufferRing* buffer_ring() {
+        if (!buffer_ring_ && !buffer_ring_failed_) {
+            auto buf_ring = IoUringBufferRing::Create(ring_.get(), kRecvBufferGroup);
+            if (buf_ring.has_value()) {
+                buffer_ring_ = std::move(buf_ring.value());
+            }
+            else {
+                buffer_ring_failed_ = true;
+                errno = buf_ring.error();
+                MUDUO_STUDY_LOG_SYSERR("IORING_REGISTER_PBUF_RING failed!");
+            }
+        }
+        return buffer_ring_.get();
+    }
+
+    // The handler stays registered, and keeps whatever it captured alive,
+    // until RemoveCompletionHandler(). Callers remove it only once all their
+    // operations have completed, the kernel may still be using their memory.
+    CompletionToken AddCompletionHandler(CompletionHandler handler) {
+        uint32_t index;
+        if (free_handlers_.empty()) {
+            index = static_cast<uint32_t>(handlers_.size());
+            assert(index < (1u << 24));
+            handlers_.emplace_back();
+        }
+        else {
+            index = free_handlers_.back();
+            free_handlers_.pop_back();
+        }
+        auto& slot = handlers_[index];
+        slot.handler = std::move(handler);
+        slot.generation = NextGeneration();
+        slot.in_use = true;
+        return kCompletionBit | (static_cast<uint64_t>(slot.generation) << 32) | (index << 8);
+    }
+    void RemoveCompletionHandler(CompletionToken token) {
+        auto index = static_cast<uint32_t>((token >> 8) & 0xffffff);
+        assert(index < handlers_.size());
+        auto& slot = handlers_[index];
+        assert(slot.in_use && slot.generation == static_cast<uint32_t>((token >> 32) & kGenerationMask));
+        slot.in_use = false;
+        slot.generation = 0;
+        free_handlers_.push_back(index);
+        // Destroying the handler may destroy its owner, which is fine unless
+        // the handler is running right now, then HandleCompletion drops it.
+        auto handler = std::move(slot.handler);
+    }
+    io_uring_sqe* PrepareCompletion(CompletionToken token, uint8_t op) {
+        auto sqe = ring_->GetSqe();
+        sqe->user_data = token | op;
+        return sqe;
+    }
+    // The result of the cancellation itself is not reported.
+    void CancelCompletion(CompletionToken token, uint8_t op) {
+        auto sqe = ring_->GetSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = token | op;
+        sqe->user_data = kIgnoredUserData;
+    }
+
+    time_point Poll(std::chrono::milliseconds timeout, ChannelList* active_channels) override {
+        MUDUO_STUDY_LOG_DEBUG("fd total count {}", channels_.size());
+        ArmPending();
+        auto ret = ring_->SubmitAndWait(timeout);
+        auto e = errno;
+        auto now = std::chrono::system_clock::now();
+        if (ret == -1 && e != ETIME && e != EINTR && e != EBUSY) {
+            errno = e;
+            MUDUO_STUDY_LOG_SYSERR("io_uring_enter failed!");
+        }
+        ++poll_round_;
+        auto num_cqes = ring_->ForEachCqe([&](const io_uring_cqe& cqe){
+            HandleCqe(cqe, active_channels);
+        });
+        MUDUO_STUDY_LOG_DEBUG("{} completions, {} active channels", num_cqes, active_channels->size());
+        return now;
+    }
+
+    void UpdateChannel(Channel* channel) override {
+        auto st = channel->status();
+        auto fd = channel->fd();
+        if (st == Channel::kNew || st == Channel::kDeleted) {
+            if (channel->IsNoneEvent()) {
+                return;
+            }
+            if (st == Channel::kNew) {
+                channels_.insert(fd, channel);
+                if (static_cast<size_t>(fd) >= states_.size()) {
+                    states_.resize(channels_.capacity());
+                }
+                states_[fd] = PollState{};
+            }
+            else {
+                assert(channels_.find(fd) == channel);
+            }
+            channel->set_status(Channel::kAdded);
+            QueueArm(fd, states_[fd]);
+            ++update_stats_.issued;
+        }
+        else {
+            assert(channels_.find(fd) == channel);
+            assert(st == Channel::kAdded);
+            auto& state = states_[fd];
+            // One-shot polls waiting for their lazy re-arm pick up the new
+            // mask by themselves.
+            if (channel->IsNoneEvent()) {
+                update_stats_.issued += state.armed;
+                QueueCancel(fd, state);
+                channel->set_status(Channel::kDeleted);
+            }
+            else if (state.armed && state.events != static_cast<uint32_t>(channel->events())) {
+                ++update_stats_.issued;
+                QueueCancel(fd, state);
+                QueueArm(fd, state);
+            }
+        }
+    }
+    void RemoveChannel(Channel* channel) override {
+        auto fd = channel->fd();
+        assert(channels_.find(fd) == channel);
+        assert(channel->IsNoneEvent());
+        auto st = channel->status();
+        assert(st != Channel::kNew);
+        auto& state = states_[fd];
+        update_stats_.issued += state.armed;
+        // Right away, like epoll_ctl(DEL). The fd is usually closed next,
+        // and the poll pins its file until the cancel has completed, which
+        // would be never if the loop has stopped: a listening socket would
+        // stay bound.
+        if (state.armed) {
+            QueueCancel(fd, state);
+            ring_->SubmitAndComplete();
+        }
+        // A late cqe for this fd must not match a reused slot.
+        state.generation = 0;
+        auto n = channels_.erase(fd);
+        assert(n == 1);
+        channel->set_status(Channel::kNew);
+    }
+
+private:
+    static constexpr uint64_t kIgnoredUserData = 0;
+    static constexpr uint64_t kCompletionBit = 1ull << 63;
+    static constexpr uint32_t kGenerationMask = 0x7fffffff;
+
+    struct HandlerSlot {
+        CompletionHandler handler;
+        uint32_t generation = 0;
+        bool in_use = false;
+    };
+
+    struct PollState {
+        uint32_t generation = 0;
+        uint32_t events = 0;
+        uint64_t round = 0;
+        bool armed = false;
+        bool arm_queued = false;
+    };
+
+    static uint64_t MakeUserData(int fd, uint32_t generation) noexcept {
+        return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+    }
+    uint32_t NextGeneration() noexcept {
+        auto generation = next_generation_++ & kGenerationMask;
+        if (generation == 0) {
+            generation = next_generation_++ & kGenerationMask;
+        }
+        return generation;
+    }
+
+    void QueueArm(int fd, PollState& state) {
+        if (!state.arm_queued) {
+            state.arm_queued = true;
+            arm_list_.push_back(fd);
+        }
+    }
+    void QueueCancel(int fd, PollState& state) {
+        if (!state.armed) return;
+        auto sqe = ring_->GetSqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = MakeUserData(fd, state.generation);
+        sqe->user_data = kIgnoredUserData;
+        state.armed = false;
+    }
+    void ArmPending() {
+        for (auto fd : arm_list_) {
+            auto channel = channels_.find(fd);
+            if (!channel) continue;
+            auto& state = states_[fd];
+            state.arm_queued = false;
+            if (state.armed || channel->status() != Channel::kAdded || channel->IsNoneEvent()) {
+                continue;
+            }
+            state.generation = NextGeneration();
+            state.events = static_cast<uint32_t>(channel->events());
+            state.armed = true;
+            channel->set_registered_events(channel->events());
+            auto sqe = ring_->GetSqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = fd;
+            // One shot polls are re-armed per event anyway, an exclusive
+            // acceptor is then woken like a plain one.
+            sqe->poll32_events = state.events & ~(EPOLLET | EPOLLEXCLUSIVE);
+            sqe->len = (state.events & EPOLLET) ? IORING_POLL_ADD_MULTI : 0;
+            sqe->user_data = MakeUserData(fd, state.generation);
+        }
+        arm_list_.clear();
+    }
+
+    void HandleCqe(const io_uring_cqe& cqe, ChannelList* active_channels) {
+        if (cqe.user_data == kIgnoredUserData) return;
+        if (cqe.user_data & kCompletionBit) {
+            HandleCompletion(cqe);
+            return;
+        }
+        auto fd = static_cast<int>(cqe.user_data & 0xffffffff);
+        auto generation = static_cast<uint32_t>(cqe.user_data >> 32);
+        auto channel = channels_.find(fd);
+        if (!channel || states_[fd].generation != generation || !states_[fd].armed) {
+            return;
+        }
+        auto& state = states_[fd];
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            state.armed = false;
+            QueueArm(fd, state);
+        }
+        if (cqe.res == -ECANCELED) return;
+        auto revents = cqe.res < 0 ? static_cast<int>(EPOLLERR) : cqe.res;
+        if (state.round == poll_round_) {
+            channel->set_revents(channel->revents() | revents);
+        }
+        else {
+            state.round = poll_round_;
+            channel->set_revents(revents);
+            active_channels->push_back(channel);
+        }
+    }
+
+    void HandleCompletion(const io_uring_cqe& cqe) {
+        auto index = static_cast<uint32_t>((cqe.user_data >> 8) & 0xffffff);
+        auto generation = static_cast<uint32_t>((cqe.user_data >> 32) & kGenerationMask);
+        if (index >= handlers_.size() || !handlers_[index].in_use || handlers_[index].generation != generation) {
+            // The owner is gone, don't leak the provided buffer.
+            if ((cqe.flags & IORING_CQE_F_BUFFER) && buffer_ring_) {
+                buffer_ring_->Recycle(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+            return;
+        }
+        // The handler may register new handlers (growing handlers_) or remove
+        // itself, so run it from a local and put it back only if still wanted.
+        auto handler = std::move(handlers_[index].handler);
+        handler(static_cast<uint8_t>(cqe.user_data & 0xff), cqe);
+        auto& slot = handlers_[index];
+        if (slot.in_use && slot.generation == generation) {
+            slot.handler = std::move(handler);
+        }
+    }
+
+    std::unique_ptr<IoUring> ring_;
+    // Indexed by fd like channels_, only meaningful while the fd is there.
+    std::vector<PollState> states_;
+    std::vector<int> arm_list_;
+    uint32_t next_generation_;
+    uint64_t poll_round_;
+    std::vector<HandlerSlot> handlers_;
+    std::vector<uint32_t> free_handlers_;
+    std::unique_ptr<IoUringBufferRing> buffer_ring_;
+    bool buffer_ring_failed_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
@@ -0,0 +1,80 @@
+#pragma once
+#include "logger.hpp"
+#include "tcp_connection.hpp"
+#include <array>
+#include <functional>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Frames a byte stream as messages preceded by a 32-bit network order
+// length. OnMessage() goes in as the connection's MessageCallback and hands
+// every complete frame to the frame callback as a view into the input
+// buffer, all frames of one read in a single pass, and retrieves them
+// together afterwards. The view is only valid during the callback.
+class LengthHeaderCodec
+{
+public:
+    using FrameCallback = std::function<void (const TcpConnectionPtr,
+                                              std::string_view frame,
+                                              time_point receive_time)>;
+    using Header = uint32_t;
+    static constexpr size_t kHeaderLen = sizeof(Header);
+    static constexpr size_t kDefaultMaxFrameSize = 64 * 1024 * 1024;
+
+    explicit LengthHeaderCodec(FrameCallback cb, size_t max_frame_size = kDefaultMaxFrameSize) :
+        frame_callback_{std::move(cb)},
+        max_frame_size_{max_frame_size} {}
+
+    // A frame longer than the limit can't be resynchronized, the
+    // connection is shut down. Once shut down, whatever else arrives is
+    // dropped.
+    void OnMessage(const TcpConnectionPtr conn, Buffer* buf, time_point receive_time) {
+        if (!conn->connected()) {
+            buf->RetrieveAll();
+            return;
+        }
+        size_t consumed = 0;
+        auto data = buf->peek();
+        auto readable = buf->readable_bytes();
+        while (readable - consumed >= kHeaderLen && conn->connected()) {
+            auto len = buf->PeekInt<Header>(consumed);
+            if (len > max_frame_size_) {
+                MUDUO_STUDY_LOG_ERROR("LengthHeaderCodec [{}] frame of {} bytes exceeds {}",
+                    conn->name(), len, max_frame_size_);
+                conn->Shutdown();
+                buf->RetrieveAll();
+                return;
+            }
+            if (readable - consumed - kHeaderLen < len) {
+                break;
+            }
+            frame_callback_(conn, {data + consumed + kHeaderLen, len}, receive_time);
+            consumed += kHeaderLen + len;
+        }
+        buf->Retrieve(consumed);
+    }
+
+    // The header and frame go out with one writev(), the frame is copied
+    // only if the socket doesn't take it all.
+    void Send(const TcpConnectionPtr& conn, std::string_view frame) {
+        auto header = HostToNetwork(static_cast<Header>(frame.size()));
+        std::array<iovec, 2> iov{{
+            {&header, kHeaderLen},
+            {const_cast<char*>(frame.data()), frame.size()},
+        }};
+        conn->Send(std::span<const iovec>(iov));
+    }
+    // Writes the header in place into the cheap prepend area of a message
+    // built in a Buffer, then sends and drains it.
+    void Send(const TcpConnectionPtr& conn, Buffer* message) {
+        message->PrependInt(static_cast<Header>(message->readable_bytes()));
+        conn->Send(std::span(message->peek(), message->readable_bytes()));
+        message->RetrieveAll();
+    }
+
+private:
+    FrameCallback frame_callback_;
+    size_t max_frame_size_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
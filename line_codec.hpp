@@ -0,0 +1,80 @@
+#pragma once
+#include "logger.hpp"
+#include "tcp_connection.hpp"
+#include <functional>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Splits a byte stream into lines ending in \r\n (or \n with kLF) and hands
+// each to the line callback as a view into the input buffer, without the
+// delimiter. The view is only valid during the callback. When a line is
+// incomplete the scan resumes where it stopped once more data arrives,
+// bytes already scanned are not looked at again.
+//
+// The scan position belongs to one stream, so each connection needs its
+// own codec, e.g. kept in its context:
+//   conn->set_context(LineCodec{on_line});
+//   std::any_cast<LineCodec>(conn->mutable_context())->OnMessage(conn, buf, t);
+class LineCodec
+{
+public:
+    using LineCallback = std::function<void (const TcpConnectionPtr,
+                                             std::string_view line,
+                                             time_point receive_time)>;
+    enum Delimiter { kCRLF, kLF };
+    static constexpr size_t kDefaultMaxLineLength = 64 * 1024;
+
+    explicit LineCodec(LineCallback cb, Delimiter delimiter = kCRLF,
+                       size_t max_line_length = kDefaultMaxLineLength) :
+        line_callback_{std::move(cb)},
+        delimiter_{delimiter},
+        max_line_length_{max_line_length},
+        scanned_{0} {}
+
+    // A line growing past the limit shuts the connection down. Once shut
+    // down, whatever else arrives is dropped.
+    void OnMessage(const TcpConnectionPtr conn, Buffer* buf, time_point receive_time) {
+        if (!conn->connected()) {
+            buf->RetrieveAll();
+            scanned_ = 0;
+            return;
+        }
+        auto delimiter_len = delimiter_ == kCRLF ? 2 : 1;
+        auto line = buf->peek();
+        auto from = line + std::min(scanned_, buf->readable_bytes());
+        const char* eol;
+        while ((eol = Find(buf, from)) != nullptr) {
+            line_callback_(conn, {line, eol}, receive_time);
+            line = from = eol + delimiter_len;
+            if (!conn->connected()) {
+                buf->RetrieveAll();
+                scanned_ = 0;
+                return;
+            }
+        }
+        size_t rest = buf->begin_write() - line;
+        if (rest > max_line_length_) {
+            MUDUO_STUDY_LOG_ERROR("LineCodec [{}] line exceeds {} bytes", conn->name(), max_line_length_);
+            conn->Shutdown();
+            buf->RetrieveAll();
+            scanned_ = 0;
+            return;
+        }
+        // A trailing \r may be the first half of a \r\n.
+        scanned_ = delimiter_ == kCRLF && rest > 0 ? rest - 1 : rest;
+        buf->Retrieve(line - buf->peek());
+    }
+
+private:
+    const char* Find(const Buffer* buf, const char* from) const noexcept {
+        return delimiter_ == kCRLF ? buf->FindCRLF(from) : buf->FindEOL(from);
+    }
+
+    LineCallback line_callback_;
+    Delimiter delimiter_;
+    size_t max_line_length_;
+    // Leading bytes of the input buffer known to hold no delimiter.
+    size_t scanned_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
@@ -1,15 +1,25 @@
 #pragma once
 #include "core.hpp"
+#include <atomic>
+#include <ctime>
+#include <iterator>
 #include <vector>
 
+// Statements below this level are compiled out, e.g.
+// -DMUDUO_STUDY_LOG_MIN_LEVEL=1 drops Debug. Fatal ones are always kept.
+#ifndef MUDUO_STUDY_LOG_MIN_LEVEL
+#define MUDUO_STUDY_LOG_MIN_LEVEL 0
+#endif
+
 MUDUO_STUDY_BEGIN_NAMESPACE
 
 class Logger
 {
 public:
+    // In order of severity.
     enum Level {
-        kInfo,
         kDebug,
+        kInfo,
         kWarning,
         kError,
         kFatal
@@ -18,6 +28,17 @@ public:
     static void set_ostream(Level lv, std::ostream& out) {
         out_manager_[lv].second = std::ref(out);
     }
+    // Every level, e.g. to an AsyncLogging stream.
+    static void set_ostream(std::ostream& out) {
+        for (auto& item : out_manager_) {
+            item.second = std::ref(out);
+        }
+    }
+    // Statements below it are skipped before their arguments are
+    // evaluated. Debug by default, Info with NDEBUG.
+    static void set_level(Level lv) noexcept { level_.store(lv, std::memory_order_relaxed); }
+    static Level level() noexcept { return level_.load(std::memory_order_relaxed); }
+    static bool Enabled(Level lv) noexcept { return lv >= level() || lv == kFatal; }
 
     Logger(std::string_view filename, std::string_view func_name, size_t line, Level lv, int saved_errno=0) :
         filename_{filename},
@@ -26,44 +47,93 @@ public:
         lv_{lv},
         saved_errno_{saved_errno} {}
 
+    // The whole line is built in a per thread buffer and handed to the
+    // stream with a single write.
     template<typename... Args>
     void Output(std::string_view fmt, Args&&... args) const {
-#ifdef NDEBUG
-        if (lv_ == kDebug) return;
-#endif
-        out_manager_[lv_].second.get() << message(std::vformat(fmt, std::make_format_args(args...)));
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        auto& line = thread_state_.line;
+        line.clear();
+        AppendPrefix(line, micros);
+        std::vformat_to(std::back_inserter(line), fmt, std::make_format_args(args...));
+        AppendSuffix(line);
+        auto& out = out_manager_[lv_].second.get();
+        out.write(line.data(), static_cast<std::streamsize>(line.size()));
         switch (lv_)
         {
         // case kError:
         //     throw std::runtime_error("Error occur!");
         case kFatal:
+            // A buffering stream would lose the reason otherwise.
+            out.flush();
             abort();
         default:
             break;
         }
     }
 
-    std::string message(std::string_view msg) const {
-        if (lv_ == kInfo) {
-            return std::format("[{}] {}\n", out_manager_[lv_].first, msg);
+private:
+    // Formats records logged elsewhere.
+    friend class BinaryLogging;
+
+    // Reused by every statement of the thread, so formatting allocates only
+    // when a line is longer than any before.
+    struct ThreadState {
+        ThreadState() { line.reserve(512); }
+        std::string line;
+        // "YYYY-mm-dd HH:MM:SS." of the second last seen.
+        time_t second = -1;
+        char time[32];
+        size_t time_size = 0;
+    };
+
+    // 2026-01-02 03:04:05.123456Z [Info]
+    void AppendPrefix(std::string& line, int64_t micros) const {
+        auto& state = thread_state_;
+        time_t second = micros / 1000000;
+        if (second != state.second) {
+            tm tm_time;
+            ::gmtime_r(&second, &tm_time);
+            state.time_size = ::strftime(state.time, sizeof(state.time), "%Y-%m-%d %H:%M:%S.", &tm_time);
+            state.second = second;
         }
-        if (saved_errno_ != 0) {
-            return std::format("[{}] {} strerr:{}-{} '{}() at {}:{}'\n",
-                out_manager_[lv_].first, msg,
-                strerror(saved_errno_), saved_errno_,
-                func_name_, filename_, line_);
+        line.append(state.time, state.time_size);
+        char digits[7];
+        auto fraction = micros % 1000000;
+        for (int i = 5; i >= 0; i--) {
+            digits[i] = static_cast<char>('0' + fraction % 10);
+            fraction /= 10;
         }
-        return std::format("[{}] {} '{}() at {}:{}'\n", out_manager_[lv_].first, msg, func_name_, filename_, line_);
+        digits[6] = 'Z';
+        line.append(digits, sizeof(digits));
+        line.append(" [");
+        line.append(out_manager_[lv_].first);
+        line.append("] ");
+    }
+    void AppendSuffix(std::string& line) const {
+        if (lv_ != kInfo) {
+            if (saved_errno_ != 0) {
+                std::format_to(std::back_inserter(line), " strerr:{}-{}", strerror(saved_errno_), saved_errno_);
+            }
+            std::format_to(std::back_inserter(line), " '{}() at {}:{}'", func_name_, filename_, line_);
+        }
+        line.push_back('\n');
     }
 
-private:
     static inline std::vector<std::pair<std::string_view, std::reference_wrapper<std::ostream>>> out_manager_ = {
-        {"Info", std::ref(std::cout)},
         {"Debug", std::ref(std::clog)},
+        {"Info", std::ref(std::cout)},
         {"Warning", std::ref(std::cout)},
         {"Error", std::ref(std::cerr)},
         {"Fatal", std::ref(std::cerr)}
     };
+#ifdef NDEBUG
+    static inline std::atomic<Level> level_{kInfo};
+#else
+    static inline std::atomic<Level> level_{kDebug};
+#endif
+    static inline thread_local ThreadState thread_state_;
 
     std::string_view filename_;
     std::string_view func_name_;
@@ -74,8 +144,30 @@ private:
 
 MUDUO_STUDY_END_NAMESPACE
 
+// The level is checked before the arguments are evaluated, statements
+// below MUDUO_STUDY_LOG_MIN_LEVEL generate no code. With
+// MUDUO_STUDY_LOG_BINARY the statements go through BinaryLogging.
 #ifndef _MUDUO_STUDY_LOG
-#define _MUDUO_STUDY_LOG(lv, saved_errno, ...) muduo_study::Logger{__FILE__, __func__, __LINE__, lv, saved_errno}.Output(__VA_ARGS__)
+#ifdef MUDUO_STUDY_LOG_BINARY
+#define _MUDUO_STUDY_LOG(lv, saved_errno, ...) \
+    do { \
+        if constexpr (lv >= MUDUO_STUDY_LOG_MIN_LEVEL || lv == muduo_study::Logger::kFatal) { \
+            if (muduo_study::Logger::Enabled(lv)) { \
+                static constinit muduo_study::LogSite _muduo_study_site{__FILE__, __func__, __LINE__, lv}; \
+                muduo_study::BinaryLogging::Log(_muduo_study_site, saved_errno, __VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+#else
+#define _MUDUO_STUDY_LOG(lv, saved_errno, ...) \
+    do { \
+        if constexpr (lv >= MUDUO_STUDY_LOG_MIN_LEVEL || lv == muduo_study::Logger::kFatal) { \
+            if (muduo_study::Logger::Enabled(lv)) { \
+                muduo_study::Logger{__FILE__, __func__, __LINE__, lv, saved_errno}.Output(__VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+#endif
 #define MUDUO_STUDY_LOG_INFO(...) _MUDUO_STUDY_LOG(muduo_study::Logger::kInfo, 0, __VA_ARGS__)
 #define MUDUO_STUDY_LOG_DEBUG(...) _MUDUO_STUDY_LOG(muduo_study::Logger::kDebug, 0, __VA_ARGS__)
 #define MUDUO_STUDY_LOG_WARNING(...) _MUDUO_STUDY_LOG(muduo_study::Logger::kWarning, 0, __VA_ARGS__)
@@ -84,4 +176,8 @@ MUDUO_STUDY_END_NAMESPACE
 #define MUDUO_STUDY_LOG_FATAL(...) _MUDUO_STUDY_LOG(muduo_study::Logger::kFatal, 0, __VA_ARGS__)
 #define MUDUO_STUDY_LOG_SYSERR(...) _MUDUO_STUDY_LOG(muduo_study::Logger::kError, errno, __VA_ARGS__)
 #define MUDUO_STUDY_LOG_SYSFATAL(...) _MUDUO_STUDY_LOG(muduo_study::Logger::kFatal, errno, __VA_ARGS__)
-#endif
\ No newline at end of file
+#endif
+
+#ifdef MUDUO_STUDY_LOG_BINARY
+#include "binary_logging.hpp"
+#endif
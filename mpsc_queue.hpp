@@ -0,0 +1,74 @@
+#pragma once
+#include "core.hpp"
+#include <atomic>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+class MpscNode
+{
+public:
+    MpscNode() : next_{nullptr} {}
+
+private:
+    template<typename> friend class MpscQueue;
+
+    std::atomic<MpscNode*> next_;
+};
+
+// Dmitry Vyukov's intrusive multi-producer single-consumer queue.
+// Push is wait-free (one exchange), Pop is lock-free and must only be
+// called from the consumer thread. Pop may return nullptr while a producer
+// is between its exchange and its link store, the caller retries later.
+template<typename T>
+class MpscQueue
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(MpscQueue)
+    static_assert(std::derived_from<T, MpscNode>);
+
+    MpscQueue() :
+        head_{&stub_},
+        tail_{&stub_} {}
+
+    void Push(T* node) noexcept {
+        PushNode(node);
+    }
+
+    T* Pop() noexcept {
+        auto tail = tail_;
+        auto next = tail->next_.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next) return nullptr;
+            tail_ = next;
+            tail = next;
+            next = next->next_.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+        if (tail != head_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        PushNode(&stub_);
+        next = tail->next_.load(std::memory_order_acquire);
+        if (next) {
+            tail_ = next;
+            return static_cast<T*>(tail);
+        }
+        return nullptr;
+    }
+
+private:
+    void PushNode(MpscNode* node) noexcept {
+        node->next_.store(nullptr, std::memory_order_relaxed);
+        auto prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next_.store(node, std::memory_order_release);
+    }
+
+    alignas(64) std::atomic<MpscNode*> head_;
+    alignas(64) MpscNode* tail_;
+    MpscNode stub_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
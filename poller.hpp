@@ -2,16 +2,58 @@
 #include "core.hpp"
 #include "channel.hpp"
 #include <vector>
-#include <unordered_map>
 
 MUDUO_STUDY_BEGIN_NAMESPACE
 
 using ChannelList = std::vector<Channel*>;
-using ChannelMap = std::unordered_map<int, Channel*>;
+
+// fd -> Channel* lookup. The kernel hands out the lowest free fd, so fds are
+// small and dense and a flat vector indexed by fd beats hashing: one indexed
+// load per lookup, no node allocation, nullptr marks a free slot.
+class ChannelTable
+{
+public:
+    Channel* find(int fd) const noexcept {
+        auto index = static_cast<size_t>(fd);
+        return index < slots_.size() ? slots_[index] : nullptr;
+    }
+    void insert(int fd, Channel* channel) {
+        assert(fd >= 0 && channel);
+        auto index = static_cast<size_t>(fd);
+        if (index >= slots_.size()) {
+            slots_.resize(std::max(index + 1, slots_.size() * 2));
+        }
+        assert(!slots_[index]);
+        slots_[index] = channel;
+        ++size_;
+    }
+    size_t erase(int fd) noexcept {
+        auto index = static_cast<size_t>(fd);
+        if (index >= slots_.size() || !slots_[index]) return 0;
+        slots_[index] = nullptr;
+        --size_;
+        return 1;
+    }
+    // Number of registered channels, not the table capacity.
+    auto size() const noexcept { return size_; }
+    auto capacity() const noexcept { return slots_.size(); }
+
+private:
+    std::vector<Channel*> slots_;
+    size_t size_ = 0;
+};
 
 class Poller
 {
 public:
+    // requested counts Channel updates/removals, issued the epoll_ctl()
+    // calls (or SQEs) they turned into after collapsing.
+    struct UpdateStats {
+        uint64_t requested = 0;
+        uint64_t issued = 0;
+        uint64_t elided() const noexcept { return requested > issued ? requested - issued : 0; }
+    };
+
     static Poller* NewDefaultPoller(EventLoop* loop);
 
     Poller(EventLoop* loop) :
@@ -22,12 +64,15 @@ public:
     virtual void UpdateChannel(Channel* channel) = 0;
     virtual void RemoveChannel(Channel* channel) = 0;
     virtual bool HasChannel(Channel* channel) {
-        auto it = channels_.find(channel->fd());
-        return it != channels_.end() && it->second == channel;
+        return channels_.find(channel->fd()) == channel;
     }
 
+    auto update_stats() const noexcept { return update_stats_; }
+    void CountUpdateRequest() noexcept { ++update_stats_.requested; }
+
 protected:
-    ChannelMap channels_;
+    ChannelTable channels_;
+    UpdateStats update_stats_;
 
 private:
     EventLoop* loop_;
@@ -0,0 +1,86 @@
+#pragma once
+#include "core.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+// Guesses how much the next read on a connection will return, so the input
+// buffer can reserve that much up front and the read lands in it directly
+// instead of going through the loop's scratch area. Grows right after a
+// read filled the guess, shrinks only after two reads in a row stayed
+// below half of it, so one short message doesn't undo a bulk transfer.
+// Guesses are powers of two, reserved so the buffer storage matches a
+// BufferPool size class exactly.
+class ReadSizePredictor
+{
+public:
+    static constexpr size_t kMinSize = 2048;
+    static constexpr size_t kInitialSize = 4096;
+    static constexpr size_t kMaxSize = 64 * 1024;
+
+    // Reads are counted by power of two bucket, the last one also takes
+    // everything bigger.
+    static constexpr size_t kNumBuckets = 18;
+    struct Stats {
+        // read syscalls, including the ones that found nothing (would_block).
+        uint64_t reads = 0;
+        uint64_t would_block = 0;
+        uint64_t bytes = 0;
+        // Reads that spilled into the scratch area and were copied again.
+        uint64_t overflows = 0;
+        std::array<uint64_t, kNumBuckets> sizes{};
+
+        double syscalls_per_byte() const noexcept {
+            return bytes ? static_cast<double>(reads) / bytes : 0.0;
+        }
+        // Bucket i counts reads of [2^(i-1), 2^i) bytes, bucket 0 the
+        // empty ones.
+        static size_t Bucket(size_t n) noexcept {
+            return std::min<size_t>(std::bit_width(n), kNumBuckets - 1);
+        }
+    };
+
+    ReadSizePredictor() :
+        guess_{kInitialSize},
+        shrink_pending_{false} {}
+
+    auto guess() const noexcept { return guess_; }
+    const auto& stats() const noexcept { return stats_; }
+
+    // An EAGAIN read costs a syscall but says nothing about sizes.
+    void RecordWouldBlock() noexcept {
+        ++stats_.reads;
+        ++stats_.would_block;
+    }
+    void Record(size_t n, bool overflowed) noexcept {
+        ++stats_.reads;
+        stats_.bytes += n;
+        stats_.overflows += overflowed;
+        ++stats_.sizes[Stats::Bucket(n)];
+        if (n >= guess_) {
+            guess_ = std::min(guess_ * 2, kMaxSize);
+            shrink_pending_ = false;
+        }
+        else if (n <= guess_ / 2) {
+            if (shrink_pending_) {
+                guess_ = std::max(guess_ / 2, kMinSize);
+                shrink_pending_ = false;
+            }
+            else {
+                shrink_pending_ = true;
+            }
+        }
+        else {
+            shrink_pending_ = false;
+        }
+    }
+
+private:
+    size_t guess_;
+    bool shrink_pending_;
+    Stats stats_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
@@ -18,6 +18,33 @@ public:
         }
         return addr;
     }
+    static auto GetPeerAddr(int sockfd) -> std::optional<sockaddr_in> {
+        sockaddr_in addr;
+        ZeroMemory(addr);
+        socklen_t addrlen = sizeof(addr);
+        if (::getpeername(sockfd, (sockaddr*)&addr, &addrlen) == -1) {
+            MUDUO_STUDY_LOG_SYSERR("::getpeername failed!");
+            return std::nullopt;
+        }
+        return addr;
+    }
+    // A connect() to a local port in the ephemeral range can end up
+    // connected to itself when nothing listens there.
+    static bool IsSelfConnect(int sockfd) {
+        auto local = GetLocalAddr(sockfd);
+        auto peer = GetPeerAddr(sockfd);
+        return local && peer &&
+            local->sin_port == peer->sin_port &&
+            local->sin_addr.s_addr == peer->sin_addr.s_addr;
+    }
+    static int GetSocketError(int sockfd) {
+        int optval;
+        socklen_t optlen = sizeof(optval);
+        if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) == 0) {
+            return optval;
+        }
+        return errno;
+    }
 
     explicit Socket(int sockfd) :
         sockfd_{sockfd}
@@ -36,14 +63,7 @@ public:
         return std::unexpected(errno);
     }
     int socket_error() {
-        int optval;
-        socklen_t optlen = sizeof(optval);
-        if (::getsockopt(sockfd_, SOL_SOCKET, SO_ERROR, &optval, &optlen) == 0) {
-            return optval;
-        }
-        else {
-            return errno;
-        }
+        return GetSocketError(sockfd_);
     }
 
     void set_tcp_no_delay(bool b) {
@@ -61,6 +81,14 @@ public:
             MUDUO_STUDY_LOG_SYSERR("setsockopt SO_REUSEPORT failed!");
         }
     }
+    bool set_zerocopy(bool b) {
+        int optval = b ? 1 : 0;
+        int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof(optval));
+        if (ret < 0 && b) {
+            MUDUO_STUDY_LOG_SYSERR("setsockopt SO_ZEROCOPY failed!");
+        }
+        return ret == 0;
+    }
     void set_keep_alive(bool b) {
         int optval = b ? 1 : 0;
         ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof(optval));
@@ -77,16 +105,16 @@ public:
             MUDUO_STUDY_LOG_SYSFATAL("listen() failed!");
         }
     }
-    int Accept(InetAddress* peeraddr) {
+    // EAGAIN when there is nothing to accept, e.g. another loop's acceptor
+    // was faster.
+    auto Accept(InetAddress* peeraddr) -> std::expected<int, int> {
         socklen_t addrlen = sizeof(sockaddr_in);
         sockaddr_in addr;
         auto connfd = ::accept4(sockfd_, (sockaddr*)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (connfd == -1) {
-            MUDUO_STUDY_LOG_SYSFATAL("accept4() failed!");
-        }
-        else {
-            peeraddr->set_sockaddr(addr);
+            return std::unexpected(errno);
         }
+        peeraddr->set_sockaddr(addr);
         return connfd;
     }
     void ShutDownWrite() {
@@ -0,0 +1,144 @@
+#pragma once
+#include "core.hpp"
+#include "callbacks.hpp"
+#include "connector.hpp"
+#include "tcp_connection.hpp"
+#include <mutex>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+namespace details {
+// Wraps a freshly connected fd with the default callbacks, the caller sets
+// its own and then calls ConnectEstablished() in loop.
+inline TcpConnectionPtr NewClientConnection(EventLoop* loop, int sockfd, std::string_view name) {
+    auto local = Socket::GetLocalAddr(sockfd);
+    auto peer = Socket::GetPeerAddr(sockfd);
+    if (!local || !peer) {
+        ::close(sockfd);
+        return nullptr;
+    }
+    auto conn = std::make_shared<TcpConnection>(loop, name, sockfd, InetAddress{*local}, InetAddress{*peer});
+    conn->set_connection_callback(DefaultConnectionCallback);
+    conn->set_message_callback(DefaultMessageCallback);
+    return conn;
+}
+}
+
+// One outgoing connection, a Connector to set it up and the same
+// TcpConnection servers use to run it. With retry on, a lost connection is
+// reconnected. Destroyed in the loop thread.
+class TcpClient
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(TcpClient)
+
+    TcpClient(EventLoop* loop, const InetAddress& server_addr, std::string_view name) :
+        loop_{loop},
+        connector_{std::make_shared<Connector>(loop, server_addr)},
+        name_{name},
+        connection_callback_{details::DefaultConnectionCallback},
+        message_callback_{details::DefaultMessageCallback},
+        retry_{false},
+        connect_{false},
+        next_connid_{1}
+    {
+        connector_->set_new_connection_callback([this](int sockfd){ NewConnection(sockfd); });
+    }
+    // In the loop thread, the connector and the connection call back into
+    // the client from there. Both are stopped right here, the connector
+    // first so it can't hand over a new connection, then the connection is
+    // torn down without calling back into the client. Whoever still holds
+    // it sees it disconnected.
+    ~TcpClient() {
+        loop_->AssertInLoopThread();
+        connector_->Stop();
+        TcpConnectionPtr conn;
+        {
+            std::scoped_lock lock{mutex_};
+            conn = std::move(connection_);
+        }
+        if (conn) {
+            conn->set_close_callback([](const TcpConnectionPtr){});
+            conn->ConnectDestroyed();
+        }
+    }
+
+    auto loop() const noexcept { return loop_; }
+    const auto& name() const noexcept { return name_; }
+    bool retry() const noexcept { return retry_; }
+    void EnableRetry() { retry_ = true; }
+    TcpConnectionPtr connection() const {
+        std::scoped_lock lock{mutex_};
+        return connection_;
+    }
+
+    // Set before Connect().
+    void set_connection_callback(ConnectionCallback cb) { connection_callback_ = std::move(cb); }
+    void set_message_callback(MessageCallback cb) { message_callback_ = std::move(cb); }
+    void set_write_complete_callback(WriteCompleteCallback cb) { write_complete_callback_ = std::move(cb); }
+
+    void Connect() {
+        MUDUO_STUDY_LOG_INFO("TcpClient::Connect [{}] connecting to {}", name_, connector_->server_addr().ip_port());
+        connect_ = true;
+        connector_->Start();
+    }
+    // Graceful, the connection is shut down once its output is flushed.
+    void Disconnect() {
+        connect_ = false;
+        std::scoped_lock lock{mutex_};
+        if (connection_) {
+            connection_->Shutdown();
+        }
+    }
+    // Gives up connecting, an established connection is left alone.
+    void Stop() {
+        connect_ = false;
+        connector_->Stop();
+    }
+
+private:
+    void NewConnection(int sockfd) {
+        loop_->AssertInLoopThread();
+        auto conn_name = std::format("{}:{}#{}", name_, connector_->server_addr().ip_port(), next_connid_);
+        ++next_connid_;
+        auto conn = details::NewClientConnection(loop_, sockfd, conn_name);
+        if (!conn) return;
+        conn->set_connection_callback(connection_callback_);
+        conn->set_message_callback(message_callback_);
+        conn->set_write_complete_callback(write_complete_callback_);
+        conn->set_close_callback([this](const TcpConnectionPtr c){ RemoveConnection(c); });
+        {
+            std::scoped_lock lock{mutex_};
+            connection_ = conn;
+        }
+        conn->ConnectEstablished();
+    }
+    void RemoveConnection(const TcpConnectionPtr& conn) {
+        loop_->AssertInLoopThread();
+        {
+            std::scoped_lock lock{mutex_};
+            assert(connection_ == conn);
+            connection_.reset();
+        }
+        loop_->QueueInLoop([conn](){ conn->ConnectDestroyed(); });
+        if (retry_ && connect_) {
+            MUDUO_STUDY_LOG_INFO("TcpClient::RemoveConnection [{}] reconnecting to {}",
+                name_, connector_->server_addr().ip_port());
+            connector_->Restart();
+        }
+    }
+
+    EventLoop* loop_;
+    std::shared_ptr<Connector> connector_;
+    const std::string name_;
+    ConnectionCallback connection_callback_;
+    MessageCallback message_callback_;
+    WriteCompleteCallback write_complete_callback_;
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    int next_connid_;
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_;
+};
+
+MUDUO_STUDY_END_NAMESPACE
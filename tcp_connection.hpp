@@ -2,15 +2,36 @@
 #include "core.hpp"
 #include "callbacks.hpp"
 #include "buffer.hpp"
+#include "chain_buffer.hpp"
+#include "read_size_predictor.hpp"
 #include "inet_address.hpp"
 #include "socket.hpp"
 #include "event_loop.hpp"
+#include <linux/errqueue.h>
+#include <any>
+#include <utility>
 
 MUDUO_STUDY_BEGIN_NAMESPACE
 
 class TcpConnection : public std::enable_shared_from_this<TcpConnection>
 {
 public:
+    // kCompletion runs recv/send as io_uring operations instead of reacting
+    // to readiness. Needs the loop to run on IoUringPoller, falls back to
+    // kReadiness otherwise.
+    enum IoMode { kReadiness, kCompletion };
+    // Reads per wakeup before yielding to other channels.
+    static constexpr int kMaxReadsPerWakeup = 16;
+
+    // sends counts MSG_ZEROCOPY sendmsg() calls, completed those the kernel
+    // reported done, copied those where it fell back to copying anyway
+    // (always the case over loopback).
+    struct ZerocopyStats {
+        uint64_t sends = 0;
+        uint64_t completed = 0;
+        uint64_t copied = 0;
+    };
+
     TcpConnection(
         EventLoop* loop,
         std::string_view name,
@@ -25,7 +46,18 @@ public:
         channel_{new Channel(loop, sockfd)},
         local_addr_{local_addr},
         peer_addr_{peer_addr},
-        high_water_mark_{64*1024*1024}
+        high_water_mark_{64*1024*1024},
+        input_buffer_{loop->buffer_pool()},
+        output_buffer_{loop->buffer_pool()},
+        io_mode_{kReadiness},
+        completion_token_{0},
+        inflight_ops_{0},
+        recv_armed_{false},
+        sending_{false},
+        polling_writable_{false},
+        send_msg_{},
+        zerocopy_threshold_{0},
+        next_zerocopy_id_{0}
     {
         channel_->set_read_callback([this](auto rt){ HandleRead(rt); });
         channel_->set_write_callback([this](){ HandleWrite(); });
@@ -46,7 +78,18 @@ public:
     bool connected() { return state_ == kConnected; }
     bool disconnected() const { return state_ == kDisconnected; }
     bool reading() const noexcept { return reading_; }
+    auto io_mode() const noexcept { return io_mode_; }
     auto tcp_info() const noexcept { return socket_->tcp_info(); }
+    auto zerocopy_threshold() const noexcept { return zerocopy_threshold_; }
+    auto zerocopy_stats() const noexcept { return zerocopy_stats_; }
+    // Sizes of the readiness mode reads and what they cost, see
+    // ReadSizePredictor.
+    const auto& read_stats() const noexcept { return read_size_.stats(); }
+    // Per-connection state of whoever parses this stream, a codec or a
+    // protocol context. Loop thread only.
+    void set_context(std::any context) { context_ = std::move(context); }
+    const std::any& context() const noexcept { return context_; }
+    std::any* mutable_context() noexcept { return &context_; }
     auto input_buffer() { return &input_buffer_; }
     auto output_buffer() { return &output_buffer_; }
     
@@ -56,23 +99,119 @@ public:
     void set_high_water_mark_callback(HighWaterMarkCallback cb) { high_water_mark_callback_ = std::move(cb); }
     void set_close_callback(CloseCallback cb) { close_callback_ = std::move(cb); }
     void set_tcp_no_dealy(bool b) { socket_->set_tcp_no_delay(b); }
+    // Only before ConnectEstablished().
+    void set_io_mode(IoMode mode) { assert(state_ == kConnecting); io_mode_ = mode; }
+    // Readiness mode only, before ConnectEstablished(). The socket is
+    // registered once with EPOLLET and reads/writes are drained to EAGAIN,
+    // so toggling write interest never costs an epoll_ctl().
+    void set_edge_triggered(bool on) { assert(state_ == kConnecting); channel_->set_edge_triggered(on); }
+    // Queued writes of at least threshold bytes go out with MSG_ZEROCOPY,
+    // 0 turns it off. Pays off for multi-megabyte sends only, pinning pages
+    // and reading the completions costs more than copying small ones.
+    // Readiness mode only, set before ConnectEstablished().
+    void set_zerocopy_threshold(size_t threshold) {
+        assert(state_ == kConnecting);
+        if (threshold > 0 && !socket_->set_zerocopy(true)) {
+            threshold = 0;
+        }
+        zerocopy_threshold_ = threshold;
+    }
+    // Reads into a double-mapped ring of at least size bytes instead of a
+    // growable buffer, unread data is never moved to make room. Keeps the
+    // default buffer if the mapping fails. Before ConnectEstablished().
+    void set_ring_input_buffer(size_t size) {
+        assert(state_ == kConnecting);
+        auto ring = Buffer::CreateRing(size);
+        if (!ring.has_value()) {
+            errno = ring.error();
+            MUDUO_STUDY_LOG_SYSERR("TcpConnection::set_ring_input_buffer [{}] failed!", name_);
+            return;
+        }
+        input_buffer_ = std::move(ring.value());
+    }
 
+    // Borrowed data, whatever the socket doesn't take right away is copied.
+    // Off the loop thread it is copied once up front.
     void Send(const std::span<const char> data) {
         if (state_ == kConnected) {
             if (loop_->IsInLoopThread()) {
                 SendInLoop(data);
             }
             else {
-                loop_->QueueInLoop([this, copy_data=std::vector<char>(data.begin(), data.end())]() { 
-                    SendInLoop(std::span(copy_data));
-                });
+                SendOwned(std::string(data.begin(), data.end()));
+            }
+        }
+    }
+    // Takes ownership, the bytes are never copied, also not when handed to
+    // the loop from another thread. Only binds to rvalues, so string
+    // literals and lvalues keep going to the span overload.
+    template<typename Owned>
+        requires std::same_as<Owned, std::string> || std::same_as<Owned, std::vector<char>>
+    void Send(Owned&& data) {
+        SendOwned(std::move(data));
+    }
+    // Shared immutable data, e.g. a cached response body, is queued by
+    // reference and never copied.
+    void Send(std::shared_ptr<const std::string> blob) {
+        SendOwned(std::move(blob));
+    }
+    // Refcounted data of any kind (a pooled block, a mapped file...), data
+    // must stay valid as long as owner is alive.
+    void Send(std::span<const char> data, std::shared_ptr<const void> owner) {
+        SendOwned(OwnedSlice{data, std::move(owner)});
+    }
+    // data stays owned by the caller until release runs, it is never copied
+    // and may be pinned by a zero-copy send until the kernel is done with
+    // it. release runs in the loop thread, or right away when the
+    // connection is down.
+    void Send(std::span<const char> data, SendReleaseCallback release) {
+        Send(data, std::make_shared<const ReleaseGuard>(std::move(release)));
+    }
+    // Many messages for this connection in one posted task, sent with one
+    // writev() and queued without copying.
+    void SendBatch(std::vector<std::string> messages) {
+        SendOwned(std::move(messages));
+    }
+    // Gathered write of several fragments. In the loop thread they go out
+    // with one writev() and only the part the socket didn't take is copied.
+    void Send(std::span<const iovec> iov) {
+        if (state_ == kConnected) {
+            if (loop_->IsInLoopThread()) {
+                SendInLoop(iov);
+            }
+            else {
+                std::string data;
+                for (auto& vec : iov) {
+                    data.append(static_cast<const char*>(vec.iov_base), vec.iov_len);
+                }
+                SendOwned(std::move(data));
             }
         }
     }
+    // Sends length bytes of fd from offset, in order with everything sent
+    // before, via sendfile(2) and without reading the file into memory. fd
+    // is duplicated, the caller may close its own right away.
+    void SendFile(int fd, off_t offset, size_t length) {
+        if (state_ == kConnected && length > 0) {
+            auto file = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            if (file == -1) {
+                MUDUO_STUDY_LOG_SYSERR("fcntl(F_DUPFD_CLOEXEC) failed!");
+                return;
+            }
+            loop_->RunInLoop([=, self=shared_from_this()](){ self->SendFileInLoop(file, offset, length); });
+        }
+    }
     void Shutdown() {
         if (state_ == kConnected) {
             set_state(kDisconnecting);
-            loop_->RunInLoop([this](){ ShutdownInLoop(); });
+            loop_->RunInLoop([self=shared_from_this()](){ self->ShutdownInLoop(); });
+        }
+    }
+    // Closes without waiting for queued output, which is dropped.
+    void ForceClose() {
+        if (state_ == kConnected || state_ == kDisconnecting) {
+            set_state(kDisconnecting);
+            loop_->QueueInLoop([self=shared_from_this()](){ self->ForceCloseInLoop(); });
         }
     }
     void ConnectEstablished() {
@@ -80,90 +219,366 @@ public:
         assert(state_ == kConnecting);
         set_state(kConnected);
         channel_->Tie(shared_from_this());
-        channel_->EnableReading();
+        if (io_mode_ == kCompletion && !StartCompletion()) {
+            io_mode_ = kReadiness;
+        }
+        if (io_mode_ == kReadiness) {
+            channel_->EnableReading();
+        }
         connection_callback_(shared_from_this());
     }
     void ConnectDestroyed() {
         loop_->AssertInLoopThread();
-        if (state_ == kConnected) {
+        // Also when its owner goes away halfway through a shutdown.
+        if (state_ == kConnected || state_ == kDisconnecting) {
             set_state(kDisconnected);
-            channel_->DisableAll();
+            if (io_mode_ == kCompletion) {
+                StopCompletion();
+            }
+            else {
+                channel_->DisableAll();
+            }
 
             connection_callback_(shared_from_this());
         }
-        channel_->Remove();
+        if (io_mode_ == kReadiness) {
+            channel_->Remove();
+        }
     }
 
 private:
     enum StateE { kDisconnected, kConnecting, kConnected, kDisconnecting };
 
+    struct OwnedSlice {
+        std::span<const char> data;
+        std::shared_ptr<const void> owner;
+    };
+    struct ReleaseGuard {
+        explicit ReleaseGuard(SendReleaseCallback cb) : release{std::move(cb)} {}
+        ~ReleaseGuard() { if (release) release(); }
+        SendReleaseCallback release;
+    };
+    // What one MSG_ZEROCOPY sendmsg() pinned, released by id once the
+    // kernel's completion arrives on the error queue.
+    struct ZerocopySend {
+        uint32_t id;
+        std::vector<std::shared_ptr<const void>> owners;
+    };
+    enum CompletionOp : uint8_t { kRecvOp = 1, kSendOp, kWritableOp };
+
     void set_state(StateE s) noexcept { state_ = s; }
 
+    // Level triggered reading stops at the first short read, the socket is
+    // empty then or the next wakeup reports the rest. Edge triggered reading
+    // goes on to EAGAIN since no new edge comes for data left behind. Either
+    // way at most kMaxReadsPerWakeup reads, so one busy connection cannot
+    // starve the loop, edge triggered leftovers are picked up by a queued
+    // continuation.
     void HandleRead(time_point receive_time) {
         loop_->AssertInLoopThread();
-        auto exp = input_buffer_.ReadFd(channel_->fd());
-        if (exp.has_value()) {
-            if (exp.value() > 0) {
-                message_callback_(shared_from_this(), &input_buffer_, receive_time);
+        auto edge_triggered = channel_->edge_triggered();
+        size_t total = 0;
+        bool eof = false;
+        bool drained = false;
+        for (int i = 0; i < kMaxReadsPerWakeup; i++) {
+            bool full = false;
+            auto exp = ReadInput(&full);
+            if (!exp.has_value()) {
+                if (exp.error() == EAGAIN) {
+                    drained = true;
+                    break;
+                }
+                errno = exp.error();
+                MUDUO_STUDY_LOG_SYSERR("muduo_study::Buffer::ReadFd failed!");
+                HandleError();
+                // A hard error won't be reported again without a new edge.
+                eof = edge_triggered;
+                drained = true;
+                break;
             }
-            else {
+            if (exp.value() == 0) {
+                eof = true;
+                break;
+            }
+            total += exp.value();
+            if (!edge_triggered && !full) {
+                drained = true;
+                break;
+            }
+        }
+        if (total > 0) {
+            message_callback_(shared_from_this(), &input_buffer_, receive_time);
+        }
+        if (eof) {
+            if (state_ == kConnected || state_ == kDisconnecting) {
                 HandleClose();
             }
         }
-        else {
-            errno = exp.error();
-            MUDUO_STUDY_LOG_SYSERR("muduo_study::Buffer::ReadFd failed!");
-            HandleError();
+        else if (!drained && edge_triggered) {
+            loop_->QueueInLoop([self=shared_from_this()](){
+                if (self->state_ == kConnected || self->state_ == kDisconnecting) {
+                    self->HandleRead(std::chrono::system_clock::now());
+                }
+            });
+        }
+    }
+    // One read, with the input buffer reserving what read_size_ predicts
+    // and the loop's scratch area catching the rest. full is set when the
+    // read took everything offered, the socket likely has more.
+    auto ReadInput(bool* full) -> std::expected<ssize_t, int> {
+        if (!input_buffer_.is_ring()) {
+            input_buffer_.EnsureWritableBytes(read_size_.guess() - Buffer::kCheapPrepend);
+        }
+        auto scratch = loop_->read_scratch();
+        auto writable = input_buffer_.writable_bytes();
+        auto offered = writable + (writable < scratch.size() ? scratch.size() : 0);
+        auto exp = input_buffer_.ReadFd(channel_->fd(), scratch);
+        if (!exp.has_value()) {
+            if (exp.error() == EAGAIN) {
+                read_size_.RecordWouldBlock();
+            }
+            return exp;
         }
+        auto n = static_cast<size_t>(exp.value());
+        read_size_.Record(n, n > writable);
+        *full = n == offered;
+        return exp;
     }
     void HandleWrite() {
         loop_->AssertInLoopThread();
+        if (channel_->edge_triggered()) {
+            HandleWriteEdgeTriggered();
+            return;
+        }
         if (channel_->IsWriting()) {
-            auto n = output_buffer_.WriteFd(channel_->fd());
+            auto n = WriteOutput();
             if (n > 0) {
                 output_buffer_.Retrieve(n);
-                if (output_buffer_.readable_bytes() == 0) {
-                    channel_->DisableWriting();
-                    if (write_complete_callback_) {
-                        loop_->QueueInLoop([self=shared_from_this()](){ self->write_complete_callback_(self); });
-                    }
-                    if (state_ == kDisconnecting) {
-                        ShutdownInLoop();
-                    }
-                }
             }
             else {
                 MUDUO_STUDY_LOG_SYSERR("muduo_study::Buffer::WriteFd failed!");
             }
+            // Also after a failure, a truncated file region gets dropped.
+            if (output_buffer_.empty()) {
+                channel_->DisableWriting();
+                if (write_complete_callback_) {
+                    loop_->QueueInLoop([self=shared_from_this()](){ self->write_complete_callback_(self); });
+                }
+                if (state_ == kDisconnecting) {
+                    ShutdownInLoop();
+                }
+            }
         }
         else {
             MUDUO_STUDY_LOG_DEBUG("Connection fd={} is down, no more writing", channel_->fd());
         }
     }
+    // Only called while write interest is on. DisableWriting() here is a
+    // local flag flip, the registration stays IN|OUT|RDHUP|ET.
+    void HandleWriteEdgeTriggered() {
+        while (output_buffer_.readable_bytes() > 0) {
+            auto n = WriteOutput();
+            if (n > 0) {
+                output_buffer_.Retrieve(n);
+            }
+            else if (errno == ENODATA) {
+                // A truncated file region was dropped, go on with the rest.
+                MUDUO_STUDY_LOG_SYSERR("muduo_study::Buffer::WriteFd failed!");
+            }
+            else {
+                if (errno != EWOULDBLOCK) {
+                    MUDUO_STUDY_LOG_SYSERR("muduo_study::Buffer::WriteFd failed!");
+                }
+                return;
+            }
+        }
+        channel_->DisableWriting();
+        if (write_complete_callback_) {
+            loop_->QueueInLoop([self=shared_from_this()](){ self->write_complete_callback_(self); });
+        }
+        if (state_ == kDisconnecting) {
+            ShutdownInLoop();
+        }
+    }
     void HandleClose() {
         loop_->AssertInLoopThread();
         assert(state_ == kConnected || state_ == kDisconnecting);
         set_state(kDisconnected);
-        channel_->DisableAll();
+        if (io_mode_ == kCompletion) {
+            StopCompletion();
+        }
+        else {
+            channel_->DisableAll();
+        }
         connection_callback_(shared_from_this());
         close_callback_(shared_from_this());
     }
+    // One write from output_buffer_, with MSG_ZEROCOPY if enough goes out
+    // in one go. The slices written that way stay referenced until the
+    // kernel reports the send complete, Retrieve() alone doesn't free them.
+    ssize_t WriteOutput() {
+        auto fd = channel_->fd();
+        if (zerocopy_threshold_ == 0 || output_buffer_.front_is_file() ||
+            output_buffer_.front_memory_bytes() < zerocopy_threshold_) {
+            return output_buffer_.WriteFd(fd);
+        }
+        auto n = output_buffer_.SendMsg(fd, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (n == -1 && errno == ENOBUFS) {
+            // Out of optmem for pinning, copy this time.
+            return output_buffer_.WriteFd(fd);
+        }
+        if (n > 0) {
+            // The kernel numbers zero-copy sends per socket, starting at 0.
+            auto& pending = zerocopy_pending_.emplace_back(ZerocopySend{next_zerocopy_id_++, {}});
+            output_buffer_.CollectOwners(n, pending.owners);
+            ++zerocopy_stats_.sends;
+        }
+        return n;
+    }
+    // Returns the number of notifications read, each covers a range of ids.
+    size_t HandleZerocopyCompletions() {
+        size_t count = 0;
+        while (true) {
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err)) + CMSG_SPACE(sizeof(sockaddr_in6))];
+            msghdr msg;
+            ZeroMemory(msg);
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (::recvmsg(channel_->fd(), &msg, MSG_ERRQUEUE) == -1) {
+                break;
+            }
+            for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+                    !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                    continue;
+                }
+                auto err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+                if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY || err->ee_errno != 0) {
+                    continue;
+                }
+                auto lo = err->ee_info;
+                auto hi = err->ee_data;
+                auto n = std::erase_if(zerocopy_pending_, [=](auto& pending){
+                    return pending.id - lo <= hi - lo;
+                });
+                zerocopy_stats_.completed += n;
+                if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                    zerocopy_stats_.copied += n;
+                }
+                ++count;
+            }
+        }
+        return count;
+    }
+    // EPOLLERR is also how the kernel reports finished zero-copy sends.
     void HandleError() {
+        if (!zerocopy_pending_.empty() && HandleZerocopyCompletions() > 0) {
+            return;
+        }
         MUDUO_STUDY_LOG_ERROR2(socket_->socket_error(), "SO_ERROR");
     }
     void SendInLoop(const std::span<const char> data) {
+        iovec iov{const_cast<char*>(data.data()), data.size()};
+        SendInLoop({&iov, 1}, data.size(), false, [&](size_t skip){
+            output_buffer_.Append(data.subspan(skip));
+        });
+    }
+    // Moves owned payloads into the loop thread together with a strong
+    // reference, so neither the data nor the connection is copied or lost.
+    template<typename Payload>
+    void SendOwned(Payload payload) {
+        if (state_ == kConnected) {
+            if (loop_->IsInLoopThread()) {
+                SendInLoop(std::move(payload));
+            }
+            else {
+                loop_->QueueInLoop([self=shared_from_this(), payload=std::move(payload)]() mutable {
+                    self->SendInLoop(std::move(payload));
+                });
+            }
+        }
+    }
+    template<typename Owned>
+        requires std::same_as<Owned, std::string> || std::same_as<Owned, std::vector<char>>
+    void SendInLoop(Owned&& data) {
+        iovec iov{data.data(), data.size()};
+        SendInLoop({&iov, 1}, data.size(), true, [&](size_t skip){
+            output_buffer_.Append(std::move(data), skip);
+        });
+    }
+    void SendInLoop(std::vector<std::string>&& messages) {
+        std::vector<iovec> iov;
+        iov.reserve(messages.size());
+        size_t len = 0;
+        for (auto& msg : messages) {
+            iov.push_back({msg.data(), msg.size()});
+            len += msg.size();
+        }
+        SendInLoop(iov, len, true, [&](size_t skip){
+            for (auto& msg : messages) {
+                if (skip >= msg.size()) {
+                    skip -= msg.size();
+                    continue;
+                }
+                output_buffer_.Append(std::move(msg), skip);
+                skip = 0;
+            }
+        });
+    }
+    void SendInLoop(std::shared_ptr<const std::string> blob) {
+        iovec iov{const_cast<char*>(blob->data()), blob->size()};
+        SendInLoop({&iov, 1}, blob->size(), true, [&](size_t skip){
+            output_buffer_.Append(std::move(blob), skip);
+        });
+    }
+    void SendInLoop(OwnedSlice&& slice) {
+        iovec iov{const_cast<char*>(slice.data.data()), slice.data.size()};
+        SendInLoop({&iov, 1}, slice.data.size(), true, [&](size_t skip){
+            output_buffer_.AppendRef(slice.data.subspan(skip), std::move(slice.owner));
+        });
+    }
+    void SendInLoop(std::span<const iovec> iov) {
+        size_t len = 0;
+        for (auto& vec : iov) {
+            len += vec.iov_len;
+        }
+        SendInLoop(iov, len, false, [&](size_t skip){
+            for (auto& vec : iov) {
+                std::span data{static_cast<const char*>(vec.iov_base), vec.iov_len};
+                if (skip >= data.size()) {
+                    skip -= data.size();
+                    continue;
+                }
+                output_buffer_.Append(data.subspan(skip));
+                skip = 0;
+            }
+        });
+    }
+    // Writes what the socket takes right away when nothing is queued, then
+    // hands queue_rest() the number of bytes already written so it can queue
+    // the rest. Completion mode always queues and sends from output_buffer_,
+    // so do large owned (pinnable) payloads that qualify for zero-copy.
+    template<typename QueueRest>
+    void SendInLoop(std::span<const iovec> iov, size_t len, bool pinnable, QueueRest&& queue_rest) {
         loop_->AssertInLoopThread();
         ssize_t nwrote = 0;
-        auto remaining = data.size();
+        auto remaining = len;
         bool fault_error = false;
         if (state_ == kDisconnected) {
             MUDUO_STUDY_LOG_WARNING("disconnected, give up writing!");
             return;
         }
-        if (!channel_->IsWriting() && output_buffer_.readable_bytes() == 0) {
-            nwrote = ::write(channel_->fd(), data.data(), data.size());
+        bool zerocopy = pinnable && zerocopy_threshold_ > 0 && len >= zerocopy_threshold_;
+        if (io_mode_ == kReadiness && !zerocopy && !channel_->IsWriting() && output_buffer_.empty()) {
+            if (iov.size() == 1) {
+                nwrote = ::write(channel_->fd(), iov[0].iov_base, iov[0].iov_len);
+            }
+            else {
+                auto iovcnt = std::min<size_t>(iov.size(), ChainBuffer::kMaxIovecs);
+                nwrote = ::writev(channel_->fd(), iov.data(), static_cast<int>(iovcnt));
+            }
             if (nwrote >= 0) {
-                remaining = data.size() - nwrote;
+                remaining = len - nwrote;
                 if (remaining == 0 && write_complete_callback_) {
                     loop_->QueueInLoop([self=shared_from_this()](){ self->write_complete_callback_(self); });
                 }
@@ -179,7 +594,7 @@ private:
             }
         }
 
-        assert(remaining <= data.size());
+        assert(remaining <= len);
         if (!fault_error && remaining > 0) {
             auto old_len = output_buffer_.readable_bytes();
             if (old_len + remaining >= high_water_mark_ &&
@@ -188,19 +603,247 @@ private:
             {
                 loop_->QueueInLoop([=, self=shared_from_this()](){ self->high_water_mark_callback_(self, old_len + remaining); });
             }
-            output_buffer_.Append(data.subspan(nwrote, remaining));
-            if (!channel_->IsWriting()) {
+            queue_rest(static_cast<size_t>(nwrote));
+            if (io_mode_ == kCompletion) {
+                if (!sending_) {
+                    SubmitSend();
+                }
+            }
+            else if (!channel_->IsWriting()) {
                 channel_->EnableWriting();
+                // Nothing went out yet, an edge triggered socket that is
+                // already writable won't report it again.
+                if (zerocopy) {
+                    HandleWrite();
+                }
             }
         }
     }
+    // Owns fd. Goes through the same path as buffered bytes, so ordering,
+    // the high water mark and WriteCompleteCallback behave the same.
+    void SendFileInLoop(int fd, off_t offset, size_t length) {
+        loop_->AssertInLoopThread();
+        if (state_ == kDisconnected) {
+            MUDUO_STUDY_LOG_WARNING("disconnected, give up writing!");
+            ::close(fd);
+            return;
+        }
+        auto old_len = output_buffer_.readable_bytes();
+        if (old_len + length >= high_water_mark_ &&
+            old_len < high_water_mark_ &&
+            high_water_mark_callback_)
+        {
+            loop_->QueueInLoop([=, self=shared_from_this()](){ self->high_water_mark_callback_(self, old_len + length); });
+        }
+        output_buffer_.AppendFile(fd, offset, length);
+        if (io_mode_ == kCompletion) {
+            if (!sending_) {
+                SubmitSend();
+            }
+        }
+        else if (!channel_->IsWriting()) {
+            channel_->EnableWriting();
+            // An edge triggered socket that is already writable won't
+            // report it again, start draining right away.
+            if (channel_->edge_triggered()) {
+                HandleWriteEdgeTriggered();
+            }
+        }
+    }
+    void ForceCloseInLoop() {
+        loop_->AssertInLoopThread();
+        if (state_ == kConnected || state_ == kDisconnecting) {
+            HandleClose();
+        }
+    }
     void ShutdownInLoop() {
         loop_->AssertInLoopThread();
-        if (!channel_->IsWriting()) {
+        if (io_mode_ == kCompletion) {
+            if (!sending_ && output_buffer_.empty()) {
+                socket_->ShutDownWrite();
+            }
+        }
+        else if (!channel_->IsWriting()) {
             socket_->ShutDownWrite();
         }
     }
 
+    // Completion mode. The poller's handler owns a strong reference, so the
+    // connection and the buffers the kernel reads from or writes to outlive
+    // every in-flight operation. It is dropped once the connection is down
+    // and the last operation has completed.
+    bool StartCompletion() {
+        auto poller = loop_->io_uring_poller();
+        if (!poller || !poller->buffer_ring()) {
+            MUDUO_STUDY_LOG_WARNING("completion mode needs io_uring provided buffers, use readiness for {}", name_);
+            return false;
+        }
+        completion_token_ = poller->AddCompletionHandler([self=shared_from_this()](auto op, auto& cqe){
+            self->HandleCompletion(op, cqe);
+        });
+        SubmitRecv();
+        return true;
+    }
+    // A send to a peer that stopped reading would never complete, so every
+    // armed operation is canceled, not just the recv.
+    void StopCompletion() {
+        auto poller = loop_->io_uring_poller();
+        if (recv_armed_) {
+            poller->CancelCompletion(completion_token_, kRecvOp);
+        }
+        if (sending_) {
+            poller->CancelCompletion(completion_token_, polling_writable_ ? kWritableOp : kSendOp);
+        }
+        MaybeReleaseCompletion();
+    }
+    void MaybeReleaseCompletion() {
+        if (state_ == kDisconnected && inflight_ops_ == 0 && completion_token_ != 0) {
+            auto token = std::exchange(completion_token_, 0);
+            loop_->io_uring_poller()->RemoveCompletionHandler(token);
+        }
+    }
+    void SubmitRecv() {
+        auto poller = loop_->io_uring_poller();
+        auto sqe = poller->PrepareCompletion(completion_token_, kRecvOp);
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = channel_->fd();
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = poller->buffer_ring()->buf_group();
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        recv_armed_ = true;
+        ++inflight_ops_;
+    }
+    // The queued slices go out as one sendmsg. Slices never move and are
+    // only retrieved on completion, appending meanwhile is safe. There is no
+    // sendfile opcode, so file regions are written directly with sendfile()
+    // and a POLLOUT poll waits whenever the socket is full.
+    void SubmitSend() {
+        while (output_buffer_.front_is_file()) {
+            auto n = output_buffer_.WriteFd(channel_->fd());
+            if (n > 0) {
+                output_buffer_.Retrieve(n);
+            }
+            else if (errno == EAGAIN) {
+                auto sqe = loop_->io_uring_poller()->PrepareCompletion(completion_token_, kWritableOp);
+                sqe->opcode = IORING_OP_POLL_ADD;
+                sqe->fd = channel_->fd();
+                sqe->poll32_events = POLLOUT;
+                sending_ = true;
+                polling_writable_ = true;
+                ++inflight_ops_;
+                return;
+            }
+            else {
+                MUDUO_STUDY_LOG_SYSERR("muduo_study::ChainBuffer::WriteFd failed!");
+                if (errno != ENODATA) {
+                    output_buffer_.RetrieveAll();
+                }
+            }
+        }
+        if (output_buffer_.empty()) {
+            HandleSendDone();
+            return;
+        }
+        send_iov_.resize(std::min<size_t>(output_buffer_.slice_count(), ChainBuffer::kMaxIovecs));
+        send_msg_.msg_iov = send_iov_.data();
+        send_msg_.msg_iovlen = output_buffer_.FillIovec(send_iov_);
+        auto sqe = loop_->io_uring_poller()->PrepareCompletion(completion_token_, kSendOp);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = channel_->fd();
+        sqe->addr = reinterpret_cast<uint64_t>(&send_msg_);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sending_ = true;
+        ++inflight_ops_;
+    }
+    void HandleCompletion(uint8_t op, const io_uring_cqe& cqe) {
+        loop_->AssertInLoopThread();
+        if (op == kRecvOp) {
+            HandleRecvCompletion(cqe);
+        }
+        else if (op == kSendOp) {
+            HandleSendCompletion(cqe);
+        }
+        else {
+            assert(op == kWritableOp);
+            sending_ = false;
+            polling_writable_ = false;
+            --inflight_ops_;
+            if (state_ != kDisconnected) {
+                SubmitSend();
+            }
+        }
+        MaybeReleaseCompletion();
+    }
+    // One CQE per received chunk, the data is copied from the provided
+    // buffer into input_buffer_ so MessageCallback keeps seeing a Buffer*.
+    void HandleRecvCompletion(const io_uring_cqe& cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            recv_armed_ = false;
+            --inflight_ops_;
+        }
+        auto buffer_ring = loop_->io_uring_poller()->buffer_ring();
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe.res > 0 && state_ != kDisconnected) {
+                input_buffer_.Append(buffer_ring->buffer(bid, cqe.res));
+            }
+            buffer_ring->Recycle(bid);
+        }
+        if (state_ == kDisconnected) {
+            return;
+        }
+        if (cqe.res > 0) {
+            message_callback_(shared_from_this(), &input_buffer_, std::chrono::system_clock::now());
+        }
+        else if (cqe.res == 0) {
+            HandleClose();
+            return;
+        }
+        else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+            errno = -cqe.res;
+            MUDUO_STUDY_LOG_SYSERR("io_uring recv failed!");
+            HandleClose();
+            return;
+        }
+        if (!recv_armed_ && state_ != kDisconnected) {
+            SubmitRecv();
+        }
+    }
+    void HandleSendCompletion(const io_uring_cqe& cqe) {
+        sending_ = false;
+        --inflight_ops_;
+        if (cqe.res < 0) {
+            // Closed or destroyed while the send was in flight.
+            if (state_ == kDisconnected) {
+                return;
+            }
+            // Reset or broken pipe, closed like the readiness path closes
+            // on EPOLLERR/EPOLLHUP.
+            errno = -cqe.res;
+            MUDUO_STUDY_LOG_SYSERR("io_uring send failed!");
+            HandleClose();
+            return;
+        }
+        output_buffer_.Retrieve(cqe.res);
+        if (state_ == kDisconnected) {
+            return;
+        }
+        if (!output_buffer_.empty()) {
+            SubmitSend();
+            return;
+        }
+        HandleSendDone();
+    }
+    void HandleSendDone() {
+        if (write_complete_callback_) {
+            loop_->QueueInLoop([self=shared_from_this()](){ self->write_complete_callback_(self); });
+        }
+        if (state_ == kDisconnecting) {
+            ShutdownInLoop();
+        }
+    }
+
     EventLoop* loop_;
     const std::string name_;
     StateE state_;
@@ -216,7 +859,35 @@ private:
     CloseCallback close_callback_;
     size_t high_water_mark_;
     Buffer input_buffer_;
-    Buffer output_buffer_;
+    ChainBuffer output_buffer_;
+    IoMode io_mode_;
+    IoUringPoller::CompletionToken completion_token_;
+    size_t inflight_ops_;
+    bool recv_armed_;
+    // Either a sendmsg or, while a file waits for room, a POLLOUT poll.
+    bool sending_;
+    bool polling_writable_;
+    std::vector<iovec> send_iov_;
+    msghdr send_msg_;
+    size_t zerocopy_threshold_;
+    uint32_t next_zerocopy_id_;
+    std::deque<ZerocopySend> zerocopy_pending_;
+    ZerocopyStats zerocopy_stats_;
+    ReadSizePredictor read_size_;
+    std::any context_;
 };
 
+// Used by TcpServer and TcpClient when no callback is set.
+namespace details {
+inline void DefaultConnectionCallback(const TcpConnectionPtr conn) {
+    MUDUO_STUDY_LOG_DEBUG("{} -> {} is {}",
+                            conn->local_addr().ip_port(),
+                            conn->peer_addr().ip_port(),
+                            conn->connected() ? "UP" : "DOWN");
+}
+inline void DefaultMessageCallback(const TcpConnectionPtr conn, Buffer* buf, time_point receive_time) {
+    buf->RetrieveAll();
+}
+}
+
 MUDUO_STUDY_END_NAMESPACE
\ No newline at end of file
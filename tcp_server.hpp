@@ -5,21 +5,10 @@
 #include "callbacks.hpp"
 #include "acceptor.hpp"
 #include "tcp_connection.hpp"
+#include <latch>
 
 MUDUO_STUDY_BEGIN_NAMESPACE
 
-namespace details {
-void DefaultConnectionCallback(const TcpConnectionPtr conn) {
-    MUDUO_STUDY_LOG_DEBUG("{} -> {} is {}",
-                            conn->local_addr().ip_port(),
-                            conn->peer_addr().ip_port(),
-                            conn->connected() ? "UP" : "DOWN");
-}
-void DefaultMessageCallback(const TcpConnectionPtr conn, Buffer* buf, time_point receive_time) {
-    buf->RetrieveAll();
-}
-}
-
 class TcpServer
 {
 public:
@@ -27,23 +16,41 @@ public:
 
     enum Option {
         kNoReusePort,
-        kReusePort
+        kReusePort,
+        // Each loop of the pool listens on a socket of its own, bound with
+        // SO_REUSEPORT, and the kernel spreads the connections over them.
+        // A connection is created, served and removed on the loop that
+        // accepted it, the loop strategy doesn't apply.
+        kReusePortPerLoop,
+        // Like kReusePortPerLoop, but the loops share one listening socket
+        // and wait on it with EPOLLEXCLUSIVE, a connection goes to
+        // whichever loop is woken.
+        kExclusivePerLoop
     };
 
     explicit TcpServer(EventLoop* loop, const InetAddress& listen_addr, std::string_view name, Option opt = kNoReusePort) :
         loop_{loop},
+        listen_addr_{listen_addr},
         ip_port_{listen_addr.ip_port()},
         name_{name},
-        acceptor_{new Acceptor(loop_, listen_addr, opt == kReusePort)},
+        option_{opt},
+        // Per loop acceptors are made by Start(), once the loops exist.
+        acceptor_{PerLoop(opt) ? nullptr : new Acceptor(loop_, listen_addr, opt == kReusePort)},
         thread_pool_{new EventLoopThreadPool(loop_, name)},
         connection_callback_{details::DefaultConnectionCallback},
         message_callback_{details::DefaultMessageCallback},
         next_connid_{1},
-        started_{false}
+        started_{false},
+        io_mode_{TcpConnection::kReadiness},
+        edge_triggered_{false},
+        zerocopy_threshold_{0},
+        ring_input_buffer_size_{0}
     {
-        acceptor_->set_new_connection_callback([this](auto sockfd, auto peer_addr){
-            NewConnection(sockfd, peer_addr);
-        });
+        if (acceptor_) {
+            acceptor_->set_new_connection_callback([this](auto sockfd, auto peer_addr){
+                NewConnection(sockfd, peer_addr);
+            });
+        }
     }
     ~TcpServer() {
         loop_->AssertInLoopThread();
@@ -53,6 +60,20 @@ public:
             item.second.reset();
             conn->loop()->RunInLoop([conn](){ conn->ConnectDestroyed(); });
         }
+        // Waited for, the acceptors call back into this server until they
+        // are gone.
+        std::latch done{static_cast<std::ptrdiff_t>(loop_acceptors_.size())};
+        for (auto& loop_acceptor : loop_acceptors_) {
+            loop_acceptor->loop->RunInLoop([loop_acceptor = loop_acceptor.get(), &done](){
+                loop_acceptor->acceptor.reset();
+                auto connections = std::move(loop_acceptor->connections);
+                for (auto& item : connections) {
+                    item.second->ConnectDestroyed();
+                }
+                done.count_down();
+            });
+        }
+        done.wait();
     }
 
     auto ip_port() const { return ip_port_; }
@@ -61,15 +82,27 @@ public:
     auto thread_pool() { return thread_pool_; }
 
     void set_thread_num(size_t num) { thread_pool_->set_thread_num(num); }
+    // How new connections are spread over the threads, round robin by default.
+    void set_loop_strategy(EventLoopThreadPool::Strategy strategy) { thread_pool_->set_strategy(strategy); }
     void set_thread_init_callback(ThreadInitCallBack cb) { thread_init_callback_ = std::move(cb); }
     void set_connection_callback(ConnectionCallback cb) { connection_callback_ = std::move(cb); }
     void set_message_callback(MessageCallback cb) { message_callback_ = std::move(cb); }
     void set_write_complete_callback(WriteCompleteCallback cb) { write_complete_callback_ = std::move(cb); }
+    // Applies to connections accepted afterwards.
+    void set_io_mode(TcpConnection::IoMode mode) { io_mode_ = mode; }
+    void set_edge_triggered(bool on) { edge_triggered_ = on; }
+    void set_zerocopy_threshold(size_t threshold) { zerocopy_threshold_ = threshold; }
+    // 0 keeps the growable input buffer.
+    void set_ring_input_buffer(size_t size) { ring_input_buffer_size_ = size; }
 
     void Start() {
         if (!started_) {
             started_ = true;
             thread_pool_->Start(thread_init_callback_);
+            if (PerLoop(option_)) {
+                StartLoopAcceptors();
+                return;
+            }
             assert(!acceptor_->listening());
             loop_->RunInLoop([this](){ acceptor_->Listen(); });
         }
@@ -78,23 +111,95 @@ public:
 private:
     using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
 
+    // The acceptor and connections of one loop in the per loop modes, only
+    // touched in that loop.
+    struct LoopAcceptor {
+        EventLoop* loop;
+        size_t index;
+        std::unique_ptr<Acceptor> acceptor;
+        ConnectionMap connections;
+        int next_connid;
+    };
+
+    static bool PerLoop(Option opt) { return opt == kReusePortPerLoop || opt == kExclusivePerLoop; }
+
+    // Listening on every loop once it returns, so a client connecting right
+    // after Start() isn't refused.
+    void StartLoopAcceptors() {
+        auto loops = thread_pool_->all_loops();
+        if (loops.empty()) loops.push_back(loop_);
+        std::latch listening{static_cast<std::ptrdiff_t>(loops.size())};
+        for (size_t i = 0; i < loops.size(); i++) {
+            auto acceptor = option_ == kExclusivePerLoop && i > 0
+                ? std::make_unique<Acceptor>(loops[i], *loop_acceptors_[0]->acceptor)
+                : std::make_unique<Acceptor>(loops[i], listen_addr_, option_ == kReusePortPerLoop);
+            acceptor->set_exclusive(option_ == kExclusivePerLoop);
+            auto loop_acceptor = loop_acceptors_.emplace_back(
+                new LoopAcceptor{loops[i], i, std::move(acceptor), {}, 1}).get();
+            loop_acceptor->acceptor->set_new_connection_callback([this, loop_acceptor](auto sockfd, auto peer_addr){
+                NewLoopConnection(loop_acceptor, sockfd, peer_addr);
+            });
+            loops[i]->RunInLoop([loop_acceptor, &listening](){
+                loop_acceptor->acceptor->Listen();
+                listening.count_down();
+            });
+        }
+        listening.wait();
+    }
+
+    // nullptr, with sockfd closed, if the socket already failed.
+    TcpConnectionPtr CreateConnection(EventLoop* ioloop, const std::string& conn_name, int sockfd, const InetAddress& peer_addr) {
+        auto opt = Socket::GetLocalAddr(sockfd);
+        if (!opt.has_value()) {
+            ::close(sockfd);
+            return nullptr;
+        }
+        InetAddress local_addr{ opt.value() };
+        auto conn = std::make_shared<TcpConnection>(ioloop, conn_name, sockfd, local_addr, peer_addr);
+        conn->set_connection_callback(connection_callback_);
+        conn->set_message_callback(message_callback_);
+        conn->set_write_complete_callback(write_complete_callback_);
+        conn->set_io_mode(io_mode_);
+        conn->set_edge_triggered(edge_triggered_);
+        if (zerocopy_threshold_ > 0) {
+            conn->set_zerocopy_threshold(zerocopy_threshold_);
+        }
+        if (ring_input_buffer_size_ > 0) {
+            conn->set_ring_input_buffer(ring_input_buffer_size_);
+        }
+        return conn;
+    }
+
     void NewConnection(int sockfd, const InetAddress& peer_addr) {
         loop_->AssertInLoopThread();
-        auto ioloop = thread_pool_->next_loop();
+        auto ioloop = thread_pool_->GetNextLoop(peer_addr);
         auto conn_name = std::format("{}-{}#{}", name_, ip_port_, next_connid_);
         ++next_connid_;
         MUDUO_STUDY_LOG_INFO("new connection [{}] from {}", conn_name, peer_addr.ip_port());
-        if (auto opt = Socket::GetLocalAddr(sockfd); opt.has_value()) {
-            InetAddress local_addr{ opt.value() };
-            auto conn = std::make_shared<TcpConnection>(loop_, conn_name, sockfd, local_addr, peer_addr);
+        if (auto conn = CreateConnection(ioloop, conn_name, sockfd, peer_addr)) {
             connections_[conn_name] = conn;
-            conn->set_connection_callback(connection_callback_);
-            conn->set_message_callback(message_callback_);
-            conn->set_write_complete_callback(write_complete_callback_);
+            thread_pool_->ConnectionOpened(ioloop);
             conn->set_close_callback([this](auto ptr){ RemoveConnection(ptr); });
             ioloop->RunInLoop([conn](){ conn->ConnectEstablished(); });
         }
     }
+    // Accepted on loop_acceptor's loop, which serves it from here on.
+    void NewLoopConnection(LoopAcceptor* loop_acceptor, int sockfd, const InetAddress& peer_addr) {
+        loop_acceptor->loop->AssertInLoopThread();
+        auto conn_name = std::format("{}-{}#{}-{}", name_, ip_port_, loop_acceptor->index, loop_acceptor->next_connid);
+        ++loop_acceptor->next_connid;
+        MUDUO_STUDY_LOG_INFO("new connection [{}] from {}", conn_name, peer_addr.ip_port());
+        if (auto conn = CreateConnection(loop_acceptor->loop, conn_name, sockfd, peer_addr)) {
+            loop_acceptor->connections[conn_name] = conn;
+            conn->set_close_callback([loop_acceptor](auto ptr){
+                MUDUO_STUDY_LOG_INFO("remove connection {}", ptr->name());
+                auto n = loop_acceptor->connections.erase(ptr->name());
+                assert(n == 1);
+                loop_acceptor->loop->QueueInLoop([ptr](){ ptr->ConnectDestroyed(); });
+            });
+            conn->ConnectEstablished();
+        }
+    }
     void RemoveConnection(const TcpConnectionPtr& conn) {
         loop_->RunInLoop([this, conn](){
             RemoveConnectionInLoop(conn);
@@ -106,12 +211,15 @@ private:
         auto n = connections_.erase(conn->name());
         assert(n == 1);
         auto ioloop = conn->loop();
+        thread_pool_->ConnectionClosed(ioloop);
         ioloop->QueueInLoop([conn](){ conn->ConnectDestroyed(); });
     }
 
     EventLoop* loop_;
+    const InetAddress listen_addr_;
     const std::string ip_port_;
     const std::string name_;
+    const Option option_;
     std::unique_ptr<Acceptor> acceptor_;
     std::shared_ptr<EventLoopThreadPool> thread_pool_;
     ConnectionCallback connection_callback_;
@@ -120,7 +228,12 @@ private:
     ThreadInitCallBack thread_init_callback_;
     int next_connid_;
     ConnectionMap connections_;
+    std::vector<std::unique_ptr<LoopAcceptor>> loop_acceptors_;
     bool started_;
+    TcpConnection::IoMode io_mode_;
+    bool edge_triggered_;
+    size_t zerocopy_threshold_;
+    size_t ring_input_buffer_size_;
 };
 
 MUDUO_STUDY_END_NAMESPACE
\ No newline at end of file
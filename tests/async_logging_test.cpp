@@ -0,0 +1,106 @@
+// LogFile rolling by size and naming its files, AsyncLogging dropping
+// lines once its buffers are all queued and noting how many in the log.
+// Files go to a fresh directory under /tmp, removed afterwards.
+#include "test_common.hpp"
+#include "async_logging.hpp"
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+
+using namespace muduo_study;
+
+namespace {
+
+struct TempDir {
+    TempDir() {
+        char templ[] = "/tmp/async_logging_test_XXXXXX";
+        if (CHECK(::mkdtemp(templ))) path = templ;
+    }
+    ~TempDir() {
+        if (!path.empty()) std::filesystem::remove_all(path);
+    }
+    std::string path;
+};
+
+std::string Contents(const std::filesystem::path& file) {
+    std::ifstream in{file};
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+} // namespace
+
+// Every line would push the file over roll_size, so each gets a file of
+// its own. Rolls within one second are numbered from .1 on.
+TEST_CASE(LogFileRollsBySize) {
+    TempDir dir;
+    if (dir.path.empty()) return;
+    constexpr int kLines = 5;
+    std::set<std::string> lines;
+    {
+        LogFile file{dir.path + "/roll", 100};
+        for (int i = 0; i < kLines; i++) {
+            auto line = std::format("line {} {}\n", i, std::string(50, 'x'));
+            file.Append(line);
+            CHECK_EQ(file.written_bytes(), line.size());
+            lines.insert(line);
+        }
+    }
+    char host[256] = "unknownhost";
+    ::gethostname(host, sizeof(host) - 1);
+    std::regex name{R"(roll\.(\d{8}-\d{6})\.(.+?)\.(\d+)(\.(\d+))?\.log)"};
+    std::map<std::string, std::set<int>> seqs_by_second;
+    std::set<std::string> found;
+    for (auto& entry : std::filesystem::directory_iterator{dir.path}) {
+        auto file_name = entry.path().filename().string();
+        std::smatch match;
+        if (!CHECK(std::regex_match(file_name, match, name))) {
+            fprintf(stderr, "  %s\n", file_name.c_str());
+            continue;
+        }
+        CHECK_EQ(match[2].str(), host);
+        CHECK_EQ(std::stoi(match[3].str()), ::getpid());
+        seqs_by_second[match[1].str()].insert(match[5].matched ? std::stoi(match[5].str()) : 0);
+        found.insert(Contents(entry.path()));
+    }
+    CHECK(found == lines);
+    for (auto& [second, seqs] : seqs_by_second) {
+        CHECK_EQ(*seqs.rbegin() + 1, static_cast<int>(seqs.size()));
+    }
+}
+
+// Not started, nothing drains: two buffers fill, one queued and the
+// current one, the rest is dropped and counted. The writer notes the count
+// ahead of the lines it writes.
+TEST_CASE(AsyncLoggingCountsDroppedLines) {
+    TempDir dir;
+    if (dir.path.empty()) return;
+    constexpr size_t kBufferSize = 1000;
+    constexpr int kLines = 100;
+    std::string kept;
+    {
+        AsyncLogging log{dir.path + "/flood", LogFile::kDefaultRollSize, 10ms, kBufferSize, 1};
+        for (int i = 0; i < kLines; i++) {
+            auto line = std::format("line {:03} {}\n", i, std::string(90, 'x'));
+            log.stream() << line;
+            if (i < 20) kept += line;
+        }
+        CHECK_EQ(log.dropped(), 80u);
+        log.Start();
+        log.Stop();
+        CHECK_EQ(log.dropped(), 80u);
+    }
+    std::string written;
+    for (auto& entry : std::filesystem::directory_iterator{dir.path}) {
+        written += Contents(entry.path());
+    }
+    CHECK_EQ(written, "[Warning] AsyncLogging dropped 80 messages, the writer fell behind\n" + kept);
+}
+
+int main(int argc, char* argv[]) {
+    return test::RunAll(argc, argv);
+}
@@ -0,0 +1,67 @@
+// BinaryLogging started and stopped while other threads keep logging:
+// Stop() returns, no instance is used after it is gone, and every
+// statement is either written or counted as dropped.
+#include "test_common.hpp"
+#include "binary_logging.hpp"
+
+using namespace muduo_study;
+
+namespace {
+
+// Counts lines, the writer and synchronous statements may write at once.
+class LineCountBuf : public std::streambuf
+{
+public:
+    uint64_t lines() const noexcept { return lines_.load(); }
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        lines_ += std::count(s, s + n, '\n');
+        return n;
+    }
+    int_type overflow(int_type c) override {
+        if (c == '\n') ++lines_;
+        return traits_type::not_eof(c);
+    }
+
+private:
+    std::atomic_uint64_t lines_{0};
+};
+
+} // namespace
+
+TEST_CASE(StopWhileThreadsLog) {
+    static LineCountBuf buf;
+    static std::ostream out{&buf};
+    Logger::set_ostream(Logger::kInfo, out);
+    std::atomic_bool stop{false};
+    std::atomic_uint64_t logged{0};
+    uint64_t dropped = 0;
+    {
+        std::vector<std::jthread> threads;
+        for (int t = 0; t < 3; t++) {
+            threads.emplace_back([&, t]{
+                static constinit LogSite site{__FILE__, __func__, __LINE__, Logger::kInfo};
+                for (int i = 0; !stop.load(std::memory_order_relaxed); i++) {
+                    BinaryLogging::Log(site, 0, "thread {} message {}", t, i);
+                    logged.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+        // Small rings, so some records are dropped as well.
+        for (int round = 0; round < 200; round++) {
+            BinaryLogging logging{4096};
+            logging.Start();
+            std::this_thread::sleep_for(std::chrono::microseconds(round % 7 * 100));
+            logging.Stop();
+            dropped += logging.dropped();
+        }
+        stop = true;
+    }
+    CHECK(logged.load() > 0);
+    CHECK_EQ(buf.lines() + dropped, logged.load());
+}
+
+int main(int argc, char* argv[]) {
+    return test::RunAll(argc, argv);
+}
@@ -0,0 +1,113 @@
+// BufferPool's size classes and stats, the cap on cached bytes, and blocks
+// acquired or released off the owner thread going to the heap instead of
+// the free lists.
+#include "test_common.hpp"
+#include "buffer_pool.hpp"
+#include "buffer.hpp"
+
+using namespace muduo_study;
+
+TEST_CASE(SizeClasses) {
+    CHECK_EQ(BufferPool::ClassIndex(0), 0u);
+    CHECK_EQ(BufferPool::ClassIndex(1024), 0u);
+    CHECK_EQ(BufferPool::ClassIndex(1025), 1u);
+    CHECK_EQ(BufferPool::ClassIndex(1 << 20), BufferPool::kNumClasses - 1);
+    CHECK_EQ(BufferPool::ClassIndex((1 << 20) + 1), BufferPool::kNumClasses);
+    CHECK_EQ(BufferPool::ClassSize(2), 4096u);
+    // Too big to pool, it bypasses the classes and their stats.
+    BufferPool pool;
+    auto big = pool.Acquire((1 << 20) + 1);
+    CHECK_EQ(big.size, (1u << 20) + 1);
+    pool.Release(big);
+    auto stats = pool.stats();
+    CHECK_EQ(stats.in_use_bytes, 0u);
+    CHECK_EQ(stats.cached_bytes, 0u);
+}
+
+// A released block is handed out again for the same class, counted as a
+// hit, the first acquire as a miss.
+TEST_CASE(OwnerThreadReuses) {
+    BufferPool pool;
+    auto block = pool.Acquire(3000);
+    CHECK_EQ(block.size, 4096u);
+    auto stats = pool.stats();
+    CHECK_EQ(stats.classes[2].block_size, 4096u);
+    CHECK_EQ(stats.classes[2].in_use, 1u);
+    CHECK_EQ(stats.classes[2].misses, 1u);
+    CHECK_EQ(stats.in_use_bytes, 4096u);
+    pool.Release(block);
+    stats = pool.stats();
+    CHECK_EQ(stats.classes[2].in_use, 0u);
+    CHECK_EQ(stats.classes[2].cached, 1u);
+    CHECK_EQ(stats.cached_bytes, 4096u);
+    auto again = pool.Acquire(4096);
+    CHECK(again.data == block.data);
+    stats = pool.stats();
+    CHECK_EQ(stats.classes[2].hits, 1u);
+    CHECK_EQ(stats.classes[2].misses, 1u);
+    CHECK_EQ(stats.cached_bytes, 0u);
+    pool.Release(again);
+}
+
+// Released beyond max_cached_bytes goes to the heap, and lowering the cap
+// drops the surplus right away.
+TEST_CASE(CapsCachedBytes) {
+    BufferPool pool{8192};
+    std::vector<BufferPool::Block> blocks;
+    for (int i = 0; i < 3; i++) {
+        blocks.push_back(pool.Acquire(4096));
+    }
+    for (auto& block : blocks) {
+        pool.Release(block);
+    }
+    auto stats = pool.stats();
+    CHECK_EQ(stats.classes[2].cached, 2u);
+    CHECK_EQ(stats.cached_bytes, 8192u);
+    CHECK_EQ(stats.in_use_bytes, 0u);
+    pool.set_max_cached_bytes(4096);
+    CHECK_EQ(pool.stats().cached_bytes, 4096u);
+}
+
+// Another thread never touches the free lists: its acquires are neither
+// hits nor misses and its releases aren't cached, in_use counts them all.
+TEST_CASE(OtherThreadsUseTheHeap) {
+    BufferPool pool;
+    pool.Release(pool.Acquire(1024));
+    CHECK_EQ(pool.stats().classes[0].cached, 1u);
+    BufferPool::Block block;
+    std::jthread{[&]{ block = pool.Acquire(1024); }}.join();
+    auto stats = pool.stats();
+    CHECK_EQ(stats.classes[0].in_use, 1u);
+    CHECK_EQ(stats.classes[0].cached, 1u);
+    // Only the owner thread's first acquire.
+    CHECK_EQ(stats.classes[0].hits, 0u);
+    CHECK_EQ(stats.classes[0].misses, 1u);
+
+    auto owned = pool.Acquire(1024);
+    std::jthread{[&]{
+        pool.Release(block);
+        pool.Release(owned);
+    }}.join();
+    stats = pool.stats();
+    CHECK_EQ(stats.classes[0].in_use, 0u);
+    CHECK_EQ(stats.classes[0].cached, 0u);
+    CHECK_EQ(stats.cached_bytes, 0u);
+}
+
+// The way it happens in a server: a Buffer with pooled storage is
+// destroyed by a worker thread, its block goes to the heap.
+TEST_CASE(BufferDestroyedOnAnotherThread) {
+    auto pool = std::make_shared<BufferPool>();
+    auto buf = std::make_unique<Buffer>(pool);
+    buf->Append(std::string(3000, 'x'));
+    auto stats = pool->stats();
+    CHECK_EQ(stats.in_use_bytes, 4096u);
+    std::jthread{[buf = std::move(buf)]() mutable { buf.reset(); }}.join();
+    stats = pool->stats();
+    CHECK_EQ(stats.in_use_bytes, 0u);
+    CHECK_EQ(stats.cached_bytes, 0u);
+}
+
+int main(int argc, char* argv[]) {
+    return test::RunAll(argc, argv);
+}
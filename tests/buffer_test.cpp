@@ -0,0 +1,199 @@
+// Buffer in both layouts, the ring's wrap in particular, reads through the
+// scratch area and ReadSizePredictor.
+#include "test_common.hpp"
+#include "buffer.hpp"
+#include "read_size_predictor.hpp"
+#include <sys/socket.h>
+#include <array>
+#include <limits>
+
+using namespace muduo_study;
+
+namespace {
+
+std::string Pattern(size_t size, size_t seed = 0) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<char>((seed + i) % 251);
+    }
+    return data;
+}
+
+std::string Readable(const Buffer& buf) {
+    return {buf.peek(), buf.readable_bytes()};
+}
+
+} // namespace
+
+// Readable bytes that run past the end of the ring stay contiguous, the
+// second mapping continues the first.
+TEST_CASE(RingWraps) {
+    auto ring = Buffer::CreateRing(4096);
+    if (!CHECK(ring.has_value())) return;
+    auto& buf = *ring;
+    auto capacity = buf.capacity();
+    CHECK(buf.is_ring());
+    CHECK(capacity >= 4096);
+    std::string expected = Pattern(capacity / 4);
+    buf.Append(expected);
+    // Several times around, a quarter stays readable so most rounds have
+    // bytes on both sides of the end.
+    for (size_t round = 1; round <= 20; round++) {
+        auto chunk = Pattern(capacity * 5 / 8, round);
+        buf.Append(chunk);
+        expected += chunk;
+        CHECK(Readable(buf) == expected);
+        buf.Retrieve(chunk.size());
+        expected.erase(0, chunk.size());
+        CHECK(Readable(buf) == expected);
+    }
+    // Consuming bytes never moves the rest.
+    auto p = buf.peek();
+    buf.Retrieve(16);
+    CHECK(buf.peek() == p + 16);
+    CHECK_EQ(buf.capacity(), capacity);
+}
+
+TEST_CASE(RingPrependsAcrossTheStart) {
+    auto ring = Buffer::CreateRing(4096);
+    if (!CHECK(ring.has_value())) return;
+    auto& buf = *ring;
+    buf.Append(std::string_view{"body"});
+    // The reader index is at the very start, the header goes in at the end
+    // of the ring and reads on into the body.
+    buf.PrependInt<uint32_t>(4);
+    CHECK_EQ(buf.readable_bytes(), 8u);
+    CHECK_EQ(buf.ReadInt<uint32_t>(), 4u);
+    CHECK_EQ(Readable(buf), "body");
+}
+
+// Every width and signedness goes out big endian and reads back the same,
+// PeekInt at an offset leaves the bytes where they are.
+TEST_CASE(IntegersRoundTrip) {
+    Buffer buf;
+    buf.AppendInt<int8_t>(-2);
+    buf.AppendInt<uint16_t>(0x0102);
+    buf.AppendInt<int32_t>(-3);
+    buf.AppendInt<uint32_t>(0x01020304);
+    buf.AppendInt<int64_t>(std::numeric_limits<int64_t>::min());
+    buf.AppendInt<uint64_t>(0x0102030405060708);
+    CHECK_EQ(buf.readable_bytes(), 1u + 2 + 4 + 4 + 8 + 8);
+    CHECK_EQ(Readable(buf).substr(0, 3), "\xfe\x01\x02");
+    CHECK_EQ(Readable(buf).substr(7, 4), "\x01\x02\x03\x04");
+    CHECK_EQ(buf.PeekInt<uint32_t>(7), 0x01020304u);
+    CHECK_EQ(buf.PeekInt<uint16_t>(1), 0x0102u);
+    CHECK_EQ(buf.ReadInt<int8_t>(), -2);
+    CHECK_EQ(buf.ReadInt<uint16_t>(), 0x0102u);
+    CHECK_EQ(buf.ReadInt<int32_t>(), -3);
+    CHECK_EQ(buf.ReadInt<uint32_t>(), 0x01020304u);
+    CHECK_EQ(buf.ReadInt<int64_t>(), std::numeric_limits<int64_t>::min());
+    CHECK_EQ(buf.ReadInt<uint64_t>(), 0x0102030405060708u);
+    CHECK_EQ(buf.readable_bytes(), 0u);
+}
+
+// A header prepended to a body fits in front without moving it, also
+// into a buffer that has no storage yet, and it stacks.
+TEST_CASE(PrependIntInFrontOfBody) {
+    Buffer empty;
+    empty.PrependInt<uint32_t>(0);
+    CHECK_EQ(empty.readable_bytes(), 4u);
+    CHECK_EQ(empty.ReadInt<uint32_t>(), 0u);
+
+    Buffer buf;
+    buf.Append(std::string_view{"body"});
+    auto body = buf.peek();
+    buf.PrependInt<uint32_t>(4);
+    CHECK(buf.peek() + 4 == body);
+    buf.PrependInt<uint16_t>(7);
+    CHECK_EQ(buf.readable_bytes(), 10u);
+    CHECK_EQ(buf.ReadInt<uint16_t>(), 7u);
+    CHECK_EQ(buf.ReadInt<uint32_t>(), 4u);
+    CHECK_EQ(Readable(buf), "body");
+}
+
+// Only a full ring moves its bytes, into a bigger one.
+TEST_CASE(RingGrows) {
+    auto ring = Buffer::CreateRing(4096);
+    if (!CHECK(ring.has_value())) return;
+    auto& buf = *ring;
+    auto capacity = buf.capacity();
+    buf.Append(Pattern(capacity - 100));
+    buf.Retrieve(capacity / 2);
+    auto expected = Pattern(capacity - 100).substr(capacity / 2) + Pattern(capacity * 2, 7);
+    buf.Append(Pattern(capacity * 2, 7));
+    CHECK(buf.is_ring());
+    CHECK(buf.capacity() > capacity);
+    CHECK(Readable(buf) == expected);
+}
+
+// readv() runs on past the writable space of a plain buffer into the
+// scratch area, and across the end of a ring.
+TEST_CASE(ReadFdThroughScratch) {
+    int fds[2];
+    if (!CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0)) return;
+    std::array<char, 65536> scratch;
+    Buffer buf{1024};
+    auto data = Pattern(10000);
+    CHECK(test::WriteAll(fds[1], data));
+    auto n = buf.ReadFd(fds[0], scratch);
+    CHECK(n.has_value() && *n == 10000);
+    CHECK(Readable(buf) == data);
+
+    auto ring = Buffer::CreateRing(4096);
+    if (!CHECK(ring.has_value())) return;
+    auto capacity = ring->capacity();
+    ring->Append(Pattern(capacity - 1000));
+    ring->Retrieve(capacity - 1000);
+    data = Pattern(3000, 3);
+    CHECK(test::WriteAll(fds[1], data));
+    n = ring->ReadFd(fds[0], scratch);
+    CHECK(n.has_value() && *n == 3000);
+    CHECK(Readable(*ring) == data);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+// peek() stays valid across Retrieve(len), also once most of a large
+// buffer has been consumed. Only RetrieveAll() gives the storage up.
+TEST_CASE(RetrieveKeepsStorage) {
+    Buffer buf;
+    buf.Append(Pattern(Buffer::kShrinkThreshold * 2));
+    auto capacity = buf.capacity();
+    auto p = buf.peek();
+    buf.Retrieve(buf.readable_bytes() - 100);
+    CHECK(buf.peek() == p + Buffer::kShrinkThreshold * 2 - 100);
+    CHECK_EQ(buf.capacity(), capacity);
+    buf.RetrieveAll();
+    CHECK(!buf.has_storage());
+}
+
+TEST_CASE(ReadSizePredictorAdapts) {
+    ReadSizePredictor predictor;
+    auto guess = predictor.guess();
+    CHECK_EQ(guess, ReadSizePredictor::kInitialSize);
+    // Filled, grows at once, up to the cap.
+    predictor.Record(guess, false);
+    CHECK_EQ(predictor.guess(), guess * 2);
+    for (int i = 0; i < 10; i++) {
+        predictor.Record(predictor.guess(), true);
+    }
+    CHECK_EQ(predictor.guess(), ReadSizePredictor::kMaxSize);
+    // One short read is not enough to shrink, two in a row are.
+    predictor.Record(100, false);
+    CHECK_EQ(predictor.guess(), ReadSizePredictor::kMaxSize);
+    predictor.Record(100, false);
+    CHECK_EQ(predictor.guess(), ReadSizePredictor::kMaxSize / 2);
+    for (int i = 0; i < 20; i++) {
+        predictor.Record(1, false);
+    }
+    CHECK_EQ(predictor.guess(), ReadSizePredictor::kMinSize);
+    predictor.RecordWouldBlock();
+    auto& stats = predictor.stats();
+    CHECK_EQ(stats.reads, 34u);
+    CHECK_EQ(stats.would_block, 1u);
+    CHECK_EQ(stats.overflows, 10u);
+}
+
+int main(int argc, char* argv[]) {
+    return test::RunAll(argc, argv);
+}
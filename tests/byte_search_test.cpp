@@ -0,0 +1,156 @@
+// Every delimiter search kernel the CPU can run against the scalar one, at
+// every length and offset around the vector block sizes, and LineCodec
+// splitting a stream that arrives in pieces.
+#include "test_common.hpp"
+#include "byte_search.hpp"
+#include "line_codec.hpp"
+#include <sys/socket.h>
+#include <random>
+
+using namespace muduo_study;
+
+namespace {
+
+struct Kernel {
+    const char* name;
+    const char* (*find_byte)(const char*, const char*, char) noexcept;
+    const char* (*find_crlf)(const char*, const char*) noexcept;
+};
+
+std::vector<Kernel> Kernels() {
+    std::vector<Kernel> kernels{{"scalar", details::FindByteScalar, details::FindCRLFScalar}};
+#if defined(__x86_64__)
+    kernels.push_back({"sse2", details::FindByteSse2, details::FindCRLFSse2});
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.push_back({"avx2", details::FindByteAvx2, details::FindCRLFAvx2});
+    }
+#endif
+    kernels.push_back({"dispatched", FindByte, FindCRLF});
+    return kernels;
+}
+
+// The scalar CRLF loop is the reference, itself checked against
+// std::string_view::find below.
+void CheckAll(std::string_view text, size_t offset) {
+    auto begin = text.data() + offset;
+    auto end = text.data() + text.size();
+    std::string_view rest{begin, end};
+    auto crlf = rest.find("\r\n");
+    auto lf = rest.find('\n');
+    auto expected_crlf = crlf == rest.npos ? nullptr : begin + crlf;
+    auto expected_lf = lf == rest.npos ? nullptr : begin + lf;
+    for (auto& kernel : Kernels()) {
+        if (kernel.find_crlf(begin, end) != expected_crlf || kernel.find_byte(begin, end, '\n') != expected_lf) {
+            CHECK(!"kernel disagrees with string_view::find");
+            fprintf(stderr, "  %s, length %zu, offset %zu\n", kernel.name, text.size(), offset);
+            return;
+        }
+    }
+}
+
+} // namespace
+
+// One \r\n at each position of buffers up to a few blocks long, also split
+// across the boundary of 16 and 32 byte blocks.
+TEST_CASE(CRLFAtEveryPosition) {
+    for (size_t size = 0; size <= 100; size++) {
+        for (size_t at = 0; at + 2 <= size; at++) {
+            std::string text(size, 'x');
+            text[at] = '\r';
+            text[at + 1] = '\n';
+            for (size_t offset = 0; offset <= std::min<size_t>(at, 3); offset++) {
+                CheckAll(text, offset);
+            }
+        }
+    }
+}
+
+// Halves of the pair on their own must not match: a trailing \r, \n
+// before \r, and \r\r\n which matches one byte in.
+TEST_CASE(CRLFNearMisses) {
+    for (size_t size = 1; size <= 70; size++) {
+        std::string text(size, 'x');
+        text.back() = '\r';
+        CheckAll(text, 0);
+        for (size_t at = 0; at + 2 <= size; at++) {
+            std::string near(size, 'x');
+            near[at] = '\n';
+            near[at + 1] = '\r';
+            CheckAll(near, 0);
+        }
+        if (size >= 3) {
+            std::string double_cr(size, 'x');
+            double_cr.replace(size - 3, 3, "\r\r\n");
+            CheckAll(double_cr, 0);
+        }
+    }
+}
+
+// Dense delimiters, so every lane of the vector compares sees some.
+TEST_CASE(RandomText) {
+    std::mt19937 rng{42};
+    std::uniform_int_distribution<int> pick{0, 3};
+    constexpr char kAlphabet[] = {'\r', '\n', 'a', '\0'};
+    for (int round = 0; round < 2000; round++) {
+        std::string text(rng() % 200, ' ');
+        for (auto& c : text) {
+            c = kAlphabet[pick(rng)];
+        }
+        CheckAll(text, text.empty() ? 0 : rng() % std::min<size_t>(text.size(), 40));
+    }
+}
+
+// Buffer searches from a given start, which the codec resumes from.
+TEST_CASE(BufferFindFromStart) {
+    Buffer buf;
+    buf.Append(std::string_view{"GET / HTTP/1.1\r\nHost: a\r\n\r\n"});
+    auto first = buf.FindCRLF();
+    CHECK_EQ(first - buf.peek(), 14);
+    auto second = buf.FindCRLF(first + 2);
+    CHECK_EQ(second - buf.peek(), 23);
+    CHECK_EQ(buf.FindCRLF(second + 2) - buf.peek(), 25);
+    CHECK(buf.FindCRLF(buf.begin_write()) == nullptr);
+    CHECK_EQ(buf.FindEOL() - buf.peek(), 15);
+}
+
+// Lines cut anywhere, also between \r and \n, come out whole and in order.
+// An overlong one shuts the connection down and drops what follows.
+TEST_CASE(LineCodecSplitsStream) {
+    EventLoop loop;
+    int fds[2];
+    if (!CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0)) return;
+    auto conn = std::make_shared<TcpConnection>(&loop, "line", fds[0], InetAddress{}, InetAddress{});
+    conn->set_connection_callback([](const TcpConnectionPtr){});
+    conn->set_close_callback([](const TcpConnectionPtr){});
+    conn->ConnectEstablished();
+    std::vector<std::string> lines;
+    LineCodec codec{[&](const TcpConnectionPtr, std::string_view line, time_point){
+        lines.emplace_back(line);
+    }, LineCodec::kCRLF, 64};
+    std::string_view stream = "first\r\nsecond line\r\n\r\nlast\r\n";
+    Buffer buf;
+    auto now = std::chrono::system_clock::now();
+    for (size_t step : {1, 2, 3, 7, 100}) {
+        lines.clear();
+        for (size_t offset = 0; offset < stream.size(); offset += step) {
+            buf.Append(stream.substr(offset, step));
+            codec.OnMessage(conn, &buf, now);
+        }
+        CHECK((lines == std::vector<std::string>{"first", "second line", "", "last"}));
+        CHECK_EQ(buf.readable_bytes(), 0u);
+    }
+    lines.clear();
+    buf.Append(std::string(65, 'x'));
+    codec.OnMessage(conn, &buf, now);
+    CHECK(!conn->connected());
+    buf.Append(std::string_view{"dropped\r\n"});
+    codec.OnMessage(conn, &buf, now);
+    CHECK(lines.empty());
+    CHECK_EQ(buf.readable_bytes(), 0u);
+    conn->ConnectDestroyed();
+    ::close(fds[1]);
+}
+
+int main(int argc, char* argv[]) {
+    return test::RunAll(argc, argv);
+}
@@ -0,0 +1,150 @@
+// ConnectionPool against a TcpServer on the same loop: leases up to
+// max_connections and reuse after Release(), waiters failed while the
+// backend is down, refilling once it is back or a connection is lost, and
+// idle connections closing.
+#include "test_common.hpp"
+#include "connection_pool.hpp"
+#include "tcp_server.hpp"
+
+using namespace muduo_study;
+
+namespace {
+
+constexpr uint16_t kPort = 19872;
+
+// Runs the loop until done() holds or the timeout passed.
+template<typename Done>
+bool RunUntil(EventLoop* loop, Done done, std::chrono::milliseconds timeout = 10s) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    auto poll = loop->RunEvery(1ms, [&]{
+        if (done() || std::chrono::steady_clock::now() > deadline) {
+            loop->Quit();
+        }
+    });
+    loop->Loop();
+    loop->Cancel(poll);
+    return done();
+}
+
+// Echoes, and keeps its connections so a case can close them.
+struct Backend {
+    explicit Backend(EventLoop* loop) : server{loop, InetAddress{"127.0.0.1", kPort}, "backend"} {
+        server.set_connection_callback([this](const TcpConnectionPtr conn){
+            if (conn->connected()) {
+                connections.push_back(conn);
+                ++accepted;
+            }
+            else {
+                std::erase(connections, conn);
+            }
+        });
+        server.set_message_callback([](const TcpConnectionPtr conn, Buffer* buf, auto){
+            conn->Send(buf->RetrieveAllAsString());
+        });
+        server.Start();
+    }
+    // Declared first, the server's destructor still calls back.
+    std::vector<TcpConnectionPtr> connections;
+    int accepted = 0;
+    TcpServer server;
+};
+
+} // namespace
+
+// The third lease waits for one of the first two, it gets the released
+// connection back, which is still usable.
+TEST_CASE(LeasesUpToMaxAndReuses) {
+    EventLoop loop;
+    Backend backend{&loop};
+    InetAddress addr{"127.0.0.1", kPort};
+    ConnectionPool pool{&loop, "pool", {.min_idle = 1, .max_connections = 2}};
+    pool.AddBackend(addr);
+    CHECK(RunUntil(&loop, [&]{ return pool.idle_count(addr) == 1; }));
+
+    std::vector<TcpConnectionPtr> leased;
+    for (int i = 0; i < 3; i++) {
+        pool.Acquire(addr, [&](TcpConnectionPtr conn){ leased.push_back(conn); });
+    }
+    CHECK_EQ(leased.size(), 1u);
+    CHECK(RunUntil(&loop, [&]{ return leased.size() == 2; }));
+    CHECK_EQ(pool.connection_count(addr), 2u);
+    if (!CHECK(leased[0] && leased[1])) return;
+
+    std::string echoed;
+    leased[0]->set_message_callback([&](const TcpConnectionPtr, Buffer* buf, auto){
+        echoed += buf->RetrieveAllAsString();
+    });
+    leased[0]->Send(std::string_view{"ping"});
+    CHECK(RunUntil(&loop, [&]{ return echoed == "ping"; }));
+    pool.Release(leased[0]);
+    CHECK(RunUntil(&loop, [&]{ return leased.size() == 3; }));
+    CHECK(leased[2] == leased[0]);
+    CHECK_EQ(backend.connections.size(), 2u);
+
+    // Released and idle, reused without a new connect.
+    pool.Release(leased[1]);
+    pool.Release(leased[2]);
+    CHECK(RunUntil(&loop, [&]{ return pool.idle_count(addr) == 2; }));
+    pool.Acquire(addr, [&](TcpConnectionPtr conn){ leased.push_back(conn); });
+    CHECK_EQ(leased.size(), 4u);
+    CHECK_EQ(backend.connections.size(), 2u);
+    // The pool goes first, with a connection still leased.
+}
+
+// While the backend refuses, waiters get nullptr instead of waiting. Once
+// it listens the pool connects again by itself.
+TEST_CASE(FailsWaitersWhileDownAndRecovers) {
+    EventLoop loop;
+    InetAddress addr{"127.0.0.1", kPort};
+    ConnectionPool pool{&loop, "pool"};
+    int failed = 0;
+    pool.Acquire(addr, [&](TcpConnectionPtr conn){ failed += !conn; });
+    CHECK(RunUntil(&loop, [&]{ return failed == 1; }));
+    pool.Acquire(addr, [&](TcpConnectionPtr conn){ failed += !conn; });
+    CHECK(RunUntil(&loop, [&]{ return failed == 2; }));
+    CHECK_EQ(pool.connection_count(addr), 0u);
+
+    Backend backend{&loop};
+    CHECK(RunUntil(&loop, [&]{ return pool.idle_count(addr) == 1; }));
+    TcpConnectionPtr leased;
+    pool.Acquire(addr, [&](TcpConnectionPtr conn){ leased = conn; });
+    CHECK(leased && leased->connected());
+}
+
+// A connection the backend closes is replaced, min_idle stays warm.
+TEST_CASE(RefillsLostConnections) {
+    EventLoop loop;
+    Backend backend{&loop};
+    InetAddress addr{"127.0.0.1", kPort};
+    ConnectionPool pool{&loop, "pool", {.min_idle = 2}};
+    pool.AddBackend(addr);
+    CHECK(RunUntil(&loop, [&]{ return pool.idle_count(addr) == 2 && backend.connections.size() == 2; }));
+    backend.connections.front()->ForceClose();
+    CHECK(RunUntil(&loop, [&]{ return backend.accepted == 3; }));
+    CHECK(RunUntil(&loop, [&]{ return pool.idle_count(addr) == 2 && backend.connections.size() == 2; }));
+    CHECK_EQ(pool.connection_count(addr), 2u);
+}
+
+// Above min_idle, connections unused for idle_timeout are closed.
+TEST_CASE(ClosesIdleConnections) {
+    EventLoop loop;
+    Backend backend{&loop};
+    InetAddress addr{"127.0.0.1", kPort};
+    ConnectionPool pool{&loop, "pool", {.min_idle = 1, .max_connections = 4, .idle_timeout = 20ms}};
+    std::vector<TcpConnectionPtr> leased;
+    for (int i = 0; i < 3; i++) {
+        pool.Acquire(addr, [&](TcpConnectionPtr conn){ leased.push_back(conn); });
+    }
+    CHECK(RunUntil(&loop, [&]{ return leased.size() == 3; }));
+    for (auto& conn : leased) {
+        if (CHECK(conn)) pool.Release(conn);
+    }
+    // The socket closes with the last reference.
+    leased.clear();
+    CHECK(RunUntil(&loop, [&]{ return pool.connection_count(addr) == 1 && backend.connections.size() == 1; }));
+    CHECK_EQ(pool.idle_count(addr), 1u);
+}
+
+int main(int argc, char* argv[]) {
+    return test::RunAll(argc, argv);
+}
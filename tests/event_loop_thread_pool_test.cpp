@@ -0,0 +1,156 @@
+// EventLoopThreadPool: its loops run on threads of their own, and each
+// strategy picks the loop it promises. No sockets, the peers are only
+// addresses.
+#include "test_common.hpp"
+#include "event_loop_thread_pool.hpp"
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+
+using namespace muduo_study;
+
+namespace {
+
+// Runs f on loop and waits for it.
+template<typename F>
+auto RunOn(EventLoop* loop, F f) {
+    std::packaged_task<decltype(f())()> task{std::move(f)};
+    auto result = task.get_future();
+    loop->QueueInLoop([&]{ task(); });
+    return result.get();
+}
+
+InetAddress Peer(int i, uint16_t port = 40000) {
+    return InetAddress{std::format("10.0.{}.{}", i / 250, i % 250 + 1), port};
+}
+
+} // namespace
+
+TEST_CASE(StartsItsLoops) {
+    EventLoop base;
+    EventLoopThreadPool pool{&base, "pool"};
+    pool.set_thread_num(3);
+    std::mutex mutex;
+    std::set<EventLoop*> initialized;
+    pool.Start([&](EventLoop* loop){
+        std::lock_guard lock{mutex};
+        initialized.insert(loop);
+    });
+    auto loops = pool.all_loops();
+    CHECK_EQ(loops.size(), 3u);
+    CHECK((initialized == std::set(loops.begin(), loops.end())));
+    std::set<std::thread::id> threads{std::this_thread::get_id()};
+    for (auto loop : loops) {
+        CHECK(loop != &base);
+        threads.insert(RunOn(loop, []{ return std::this_thread::get_id(); }));
+    }
+    CHECK_EQ(threads.size(), 4u);
+}
+
+// Every strategy and LoopForHash fall back to the basic loop.
+TEST_CASE(NoThreadsUsesBasicLoop) {
+    EventLoop base;
+    EventLoopThreadPool pool{&base, "pool"};
+    EventLoop* initialized = nullptr;
+    pool.Start([&](EventLoop* loop){ initialized = loop; });
+    CHECK(initialized == &base);
+    for (auto strategy : {EventLoopThreadPool::kRoundRobin, EventLoopThreadPool::kLeastConnections,
+                          EventLoopThreadPool::kLeastQueued, EventLoopThreadPool::kConsistentHash}) {
+        pool.set_strategy(strategy);
+        CHECK(pool.GetNextLoop(Peer(1)) == &base);
+    }
+    CHECK(pool.LoopForHash(42) == &base);
+}
+
+TEST_CASE(RoundRobin) {
+    EventLoop base;
+    EventLoopThreadPool pool{&base, "pool"};
+    pool.set_thread_num(3);
+    pool.Start(nullptr);
+    auto loops = pool.all_loops();
+    for (int i = 0; i < 7; i++) {
+        CHECK(pool.GetNextLoop(Peer(i)) == loops[i % 3]);
+    }
+}
+
+TEST_CASE(LeastConnections) {
+    EventLoop base;
+    EventLoopThreadPool pool{&base, "pool"};
+    pool.set_thread_num(3);
+    pool.set_strategy(EventLoopThreadPool::kLeastConnections);
+    pool.Start(nullptr);
+    auto loops = pool.all_loops();
+    pool.ConnectionOpened(loops[0]);
+    pool.ConnectionOpened(loops[0]);
+    pool.ConnectionOpened(loops[1]);
+    CHECK(pool.GetNextLoop(Peer(1)) == loops[2]);
+    pool.ConnectionOpened(loops[2]);
+    // Loops 1 and 2 tie, either will do but not loop 0.
+    auto next = pool.GetNextLoop(Peer(2));
+    CHECK(next == loops[1] || next == loops[2]);
+    pool.ConnectionClosed(loops[0]);
+    pool.ConnectionClosed(loops[0]);
+    CHECK_EQ(pool.connections(loops[0]), 0u);
+    CHECK(pool.GetNextLoop(Peer(3)) == loops[0]);
+    // Not one of the pool's, not counted.
+    pool.ConnectionOpened(&base);
+    CHECK_EQ(pool.connections(&base), 0u);
+}
+
+// Loops 0 and 1 are stuck in a functor with more queued behind it, the
+// idle loop 2 gets every new connection until they drain.
+TEST_CASE(LeastQueued) {
+    EventLoop base;
+    EventLoopThreadPool pool{&base, "pool"};
+    pool.set_thread_num(3);
+    pool.set_strategy(EventLoopThreadPool::kLeastQueued);
+    pool.Start(nullptr);
+    auto loops = pool.all_loops();
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    for (auto loop : {loops[0], loops[1]}) {
+        loop->QueueInLoop([released]{ released.wait(); });
+        for (int i = 0; i < 10; i++) {
+            loop->QueueInLoop([]{});
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        CHECK(pool.GetNextLoop(Peer(i)) == loops[2]);
+    }
+    release.set_value();
+    for (auto loop : loops) {
+        RunOn(loop, []{ return 0; });
+    }
+    std::set<EventLoop*> picked;
+    for (int i = 0; i < 3; i++) {
+        picked.insert(pool.GetNextLoop(Peer(i)));
+    }
+    CHECK_EQ(picked.size(), 3u);
+}
+
+// The loop depends on the peer's IP only, and the peers spread over all
+// loops.
+TEST_CASE(ConsistentHash) {
+    EventLoop base;
+    EventLoopThreadPool pool{&base, "pool"};
+    pool.set_thread_num(4);
+    pool.set_strategy(EventLoopThreadPool::kConsistentHash);
+    pool.Start(nullptr);
+    constexpr int kPeers = 4000;
+    std::map<EventLoop*, int> share;
+    for (int i = 0; i < kPeers; i++) {
+        auto loop = pool.GetNextLoop(Peer(i));
+        CHECK(pool.GetNextLoop(Peer(i, 50000)) == loop);
+        ++share[loop];
+    }
+    CHECK_EQ(share.size(), 4u);
+    for (auto [loop, peers] : share) {
+        CHECK(peers > kPeers / 4 / 2);
+    }
+    CHECK(pool.LoopForHash(12345) == pool.LoopForHash(12345));
+}
+
+int main(int argc, char* argv[]) {
+    return test::RunAll(argc, argv);
+}
@@ -0,0 +1,230 @@
+// HttpContext fed a stream in pieces of every size, its answers to
+// malformed and oversized requests, and HttpServer over loopback:
+// pipelined responses in order, bodiless statuses and errors.
+#include "test_common.hpp"
+#include "http_server.hpp"
+
+using namespace muduo_study;
+
+namespace {
+
+constexpr uint16_t kPort = 19871;
+
+// One line per request with everything the parser made of it.
+std::string Describe(const HttpRequest& req) {
+    std::string text{req.method_string()};
+    text += ' ';
+    text += req.path();
+    text += '?';
+    text += req.query();
+    text += req.version() == HttpRequest::kHttp11 ? " 1.1" : " 1.0";
+    text += req.keep_alive() ? " keep" : " close";
+    for (size_t i = 0; i < req.header_count(); i++) {
+        auto header = req.header(i);
+        text += ' ';
+        text += header.name;
+        text += '=';
+        text += header.value;
+    }
+    text += " [";
+    text += req.body();
+    text += ']';
+    return text;
+}
+
+// Appends input step bytes at a time and parses after each append, as
+// reads of that size would. Stops at the first error, whose status is the
+// last entry.
+std::vector<std::string> ParseAll(std::string_view input, size_t step, size_t max_body_bytes = HttpContext::kDefaultMaxBodyBytes) {
+    std::vector<std::string> requests;
+    HttpContext context{max_body_bytes};
+    Buffer buf;
+    for (size_t offset = 0; offset < input.size(); offset += step) {
+        buf.Append(input.substr(offset, step));
+        while (true) {
+            auto result = context.Parse(buf);
+            if (result == HttpContext::kIncomplete) break;
+            if (result == HttpContext::kError) {
+                requests.push_back(std::to_string(context.error_status()));
+                return requests;
+            }
+            requests.push_back(Describe(context.request()));
+            context.Consume(&buf);
+        }
+    }
+    return requests;
+}
+
+// Writes requests from a client thread while loop serves, returns all the
+// client read up to EOF.
+std::string Exchange(EventLoop* loop, std::string_view requests) {
+    std::string response;
+    std::jthread client{[&]{
+        auto fd = test::Connect(kPort);
+        if (CHECK(fd != -1)) {
+            CHECK(test::WriteAll(fd, requests));
+            response = test::Read(fd);
+            ::close(fd);
+        }
+        loop->RunAfter(0ms, [loop]{ loop->Quit(); });
+    }};
+    loop->Loop();
+    return response;
+}
+
+int ErrorStatus(std::string_view input, size_t max_body_bytes = HttpContext::kDefaultMaxBodyBytes) {
+    auto requests = ParseAll(input, input.size(), max_body_bytes);
+    return requests.size() == 1 && requests[0].size() == 3 ? std::stoi(requests[0]) : 0;
+}
+
+} // namespace
+
+// Every cut, also between \r and \n and inside a chunk, parses the same.
+TEST_CASE(ParsesPipelinedRequestsInPieces) {
+    std::string_view input =
+        "\r\n"
+        "GET /index.html?a=1&b HTTP/1.1\r\n"
+        "Host:  example.com \t\r\n"
+        "X-Empty:\r\n"
+        "\r\n"
+        "POST /form HTTP/1.0\r\n"
+        "Connection: keep-alive\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "hello"
+        "PUT /up HTTP/1.1\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Connection: close\r\n"
+        "\r\n"
+        "5;ext=1\r\nhello\r\n"
+        "6 \r\n world\r\n"
+        "0\r\n"
+        "Trailer: ignored\r\n"
+        "\r\n";
+    std::vector<std::string> expected{
+        "GET /index.html?a=1&b 1.1 keep Host=example.com X-Empty= []",
+        "POST /form? 1.0 keep Connection=keep-alive Content-Length=5 [hello]",
+        "PUT /up? 1.1 close Transfer-Encoding=chunked Connection=close [hello world]",
+    };
+    for (size_t step = 1; step <= input.size(); step++) {
+        auto requests = ParseAll(input, step);
+        if (requests != expected) {
+            CHECK(!"pipelined requests parsed differently");
+            fprintf(stderr, "  step %zu\n", step);
+            for (auto& request : requests) {
+                fprintf(stderr, "  %s\n", request.c_str());
+            }
+            return;
+        }
+    }
+}
+
+TEST_CASE(RejectsMalformedRequests) {
+    CHECK_EQ(ErrorStatus("FETCH / HTTP/1.1\r\n\r\n"), 400);
+    CHECK_EQ(ErrorStatus("GET  HTTP/1.1\r\n\r\n"), 400);
+    CHECK_EQ(ErrorStatus("GET /\r\n\r\n"), 400);
+    CHECK_EQ(ErrorStatus("GET / HTTP/2.0\r\n\r\n"), 505);
+    CHECK_EQ(ErrorStatus("GET / SPDY\r\n\r\n"), 400);
+    CHECK_EQ(ErrorStatus("GET / HTTP/1.1\r\nNo colon\r\n\r\n"), 400);
+    CHECK_EQ(ErrorStatus("GET / HTTP/1.1\r\nHost : a\r\n\r\n"), 400);
+    CHECK_EQ(ErrorStatus("POST / HTTP/1.1\r\nContent-Length: 5x\r\n\r\n"), 400);
+    CHECK_EQ(ErrorStatus("POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 6\r\n\r\n"), 400);
+    CHECK_EQ(ErrorStatus("POST / HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n"), 400);
+    CHECK_EQ(ErrorStatus("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n"), 501);
+    CHECK_EQ(ErrorStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n"), 400);
+    CHECK_EQ(ErrorStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabcd\r\n"), 400);
+    // Repeating the same length is fine.
+    CHECK_EQ(ParseAll("POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 1\r\n\r\nx", 64).size(), 1u);
+}
+
+TEST_CASE(EnforcesLimits) {
+    CHECK_EQ(ErrorStatus("POST / HTTP/1.1\r\nContent-Length: 11\r\n\r\n", 10), 413);
+    CHECK_EQ(ErrorStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n8\r\n12345678\r\n8\r\n", 10), 413);
+    CHECK_EQ(ParseAll("POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\n0123456789", 64, 10).size(), 1u);
+    // Many short header lines, and one line that never ends.
+    std::string many = "GET / HTTP/1.1\r\n";
+    while (many.size() <= HttpContext::kMaxHeaderBytes) {
+        many += "X-Filler: " + std::string(100, 'x') + "\r\n";
+    }
+    CHECK_EQ(ErrorStatus(many + "\r\n"), 431);
+    CHECK_EQ(ErrorStatus("GET / HTTP/1.1\r\nX-Long: " + std::string(HttpContext::kMaxHeaderBytes, 'x')), 431);
+    // Empty lines ahead of a request can't pile up in the buffer either.
+    std::string empty_lines;
+    for (size_t i = 0; i <= HttpContext::kMaxHeaderBytes / 2; i++) {
+        empty_lines += "\r\n";
+    }
+    CHECK_EQ(ErrorStatus(empty_lines + "GET / HTTP/1.1\r\n\r\n"), 400);
+    CHECK_EQ(ParseAll(empty_lines.substr(1000) + "GET / HTTP/1.1\r\n\r\n", 4096).size(), 1u);
+}
+
+// Requests written back to back get their responses in order, HEAD and
+// 304 without a body, the large one queued by reference in its place.
+TEST_CASE(ServesPipelinedRequests) {
+    EventLoop loop;
+    HttpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "http"};
+    std::string big(HttpResponse::kMinReferenceBody + 1000, 'b');
+    server.set_http_callback([&](const HttpRequest& req, HttpResponse* resp){
+        if (req.path() == "/big") {
+            resp->set_body(std::string{big});
+        }
+        else if (req.path() == "/cached") {
+            resp->set_status(HttpResponse::k304NotModified);
+            resp->set_body(std::string_view{"dropped"});
+        }
+        else if (req.path() == "/chunked") {
+            resp->AppendChunk("ab");
+            resp->AppendChunk("");
+            resp->AppendChunk("cde");
+        }
+        else {
+            resp->set_content_type("text/plain");
+            resp->set_body(req.path());
+        }
+    });
+    server.Start();
+    auto response = Exchange(&loop,
+        "GET /a HTTP/1.1\r\n\r\n"
+        "GET /big HTTP/1.1\r\n\r\n"
+        "HEAD /b HTTP/1.1\r\n\r\n"
+        "GET /cached HTTP/1.1\r\n\r\n"
+        "GET /chunked HTTP/1.1\r\n\r\n"
+        "GET /last HTTP/1.1\r\nConnection: close\r\n\r\n"
+        "GET /dropped HTTP/1.1\r\n\r\n");
+    CHECK(response ==
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\n/a"
+        "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(big.size()) + "\r\n\r\n" + big +
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\n"
+        "HTTP/1.1 304 Not Modified\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "2\r\nab\r\n3\r\ncde\r\n0\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\nContent-Length: 5\r\n\r\n/last");
+}
+
+// The error status, then the connection closes.
+TEST_CASE(AnswersBadRequestAndCloses) {
+    EventLoop loop;
+    HttpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "http"};
+    server.Start();
+    auto response = Exchange(&loop, "GET / HTTP/3\r\n\r\nGET / HTTP/1.1\r\n\r\n");
+    CHECK_EQ(response, "HTTP/1.1 505 HTTP Version Not Supported\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+}
+
+// HTTP/1.0 has no chunked encoding: the chunks go out as they are and the
+// connection closes to end the body, keep-alive or not.
+TEST_CASE(StreamsToHttp10UntilClose) {
+    EventLoop loop;
+    HttpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "http"};
+    server.set_http_callback([](const HttpRequest&, HttpResponse* resp){
+        resp->AppendChunk("ab");
+        resp->AppendChunk("cde");
+    });
+    server.Start();
+    auto response = Exchange(&loop,
+        "GET /stream HTTP/1.0\r\nConnection: keep-alive\r\n\r\n"
+        "GET /dropped HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+    CHECK_EQ(response, "HTTP/1.0 200 OK\r\n\r\nabcde");
+}
+
+int main(int argc, char* argv[]) {
+    return test::RunAll(argc, argv);
+}
@@ -0,0 +1,110 @@
+// LengthHeaderCodec over a socketpair: what both Send() overloads write
+// frames back whole and in order however the stream is cut, the header
+// too, and a length above the limit shuts the connection down.
+#include "test_common.hpp"
+#include "length_header_codec.hpp"
+#include <sys/socket.h>
+#include <array>
+
+using namespace muduo_study;
+
+namespace {
+
+struct Pair {
+    explicit Pair(EventLoop* loop) {
+        if (!CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0)) return;
+        conn = std::make_shared<TcpConnection>(loop, "codec", fds[0], InetAddress{}, InetAddress{});
+        conn->set_connection_callback([](const TcpConnectionPtr){});
+        conn->set_close_callback([](const TcpConnectionPtr){});
+        conn->ConnectEstablished();
+    }
+    ~Pair() {
+        if (conn) conn->ConnectDestroyed();
+        ::close(fds[1]);
+    }
+    int fds[2] = {-1, -1};
+    TcpConnectionPtr conn;
+};
+
+std::string Frame(std::string_view payload) {
+    Buffer buf;
+    buf.AppendInt(static_cast<LengthHeaderCodec::Header>(payload.size()));
+    buf.Append(payload);
+    return buf.RetrieveAllAsString();
+}
+
+} // namespace
+
+// Sent in the loop thread, both overloads write at once, so the peer reads
+// the stream right away. Fed back in steps of every size, headers split
+// across reads included, it decodes to the same frames.
+TEST_CASE(FramesRoundTrip) {
+    EventLoop loop;
+    Pair pair{&loop};
+    if (!pair.conn) return;
+    std::vector<std::string> frames;
+    LengthHeaderCodec codec{[&](const TcpConnectionPtr, std::string_view frame, time_point){
+        frames.emplace_back(frame);
+    }};
+    std::string large(100000, 'l');
+    codec.Send(pair.conn, "first");
+    codec.Send(pair.conn, "");
+    Buffer message;
+    message.Append(std::string_view{"built in a buffer"});
+    codec.Send(pair.conn, &message);
+    CHECK_EQ(message.readable_bytes(), 0u);
+    codec.Send(pair.conn, large);
+    std::vector<std::string> expected{"first", "", "built in a buffer", large};
+
+    std::string stream;
+    for (auto& frame : expected) {
+        stream += Frame(frame);
+    }
+    CHECK(test::Read(pair.fds[1], stream.size()) == stream);
+
+    auto now = std::chrono::system_clock::now();
+    for (size_t step : std::array<size_t, 6>{1, 2, 3, 5, 4096, stream.size()}) {
+        frames.clear();
+        Buffer buf;
+        for (size_t offset = 0; offset < stream.size(); offset += step) {
+            buf.Append(std::string_view{stream}.substr(offset, step));
+            codec.OnMessage(pair.conn, &buf, now);
+        }
+        CHECK(frames == expected);
+        CHECK_EQ(buf.readable_bytes(), 0u);
+    }
+    CHECK(pair.conn->connected());
+}
+
+// A frame of exactly the limit passes. One byte more can't be skipped, the
+// connection shuts down and what follows is dropped.
+TEST_CASE(RejectsOversizeLength) {
+    EventLoop loop;
+    Pair pair{&loop};
+    if (!pair.conn) return;
+    std::vector<std::string> frames;
+    LengthHeaderCodec codec{[&](const TcpConnectionPtr, std::string_view frame, time_point){
+        frames.emplace_back(frame);
+    }, 16};
+    auto now = std::chrono::system_clock::now();
+    Buffer buf;
+    buf.Append(Frame(std::string(16, 'x')));
+    // Only the header of the next frame, it is rejected before its body.
+    buf.AppendInt<LengthHeaderCodec::Header>(17);
+    codec.OnMessage(pair.conn, &buf, now);
+    CHECK((frames == std::vector<std::string>{std::string(16, 'x')}));
+    CHECK(!pair.conn->connected());
+    CHECK_EQ(buf.readable_bytes(), 0u);
+    buf.Append(Frame("dropped"));
+    codec.OnMessage(pair.conn, &buf, now);
+    CHECK_EQ(frames.size(), 1u);
+    CHECK_EQ(buf.readable_bytes(), 0u);
+    // The shutdown reaches the peer as EOF.
+    loop.RunAfter(10ms, [&]{ loop.Quit(); });
+    loop.Loop();
+    CHECK_EQ(test::Read(pair.fds[1]), "");
+}
+
+int main(int argc, char* argv[]) {
+    return test::RunAll(argc, argv);
+}
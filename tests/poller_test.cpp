@@ -0,0 +1,604 @@
+// What every Poller must get right, run once per backend:
+// MUDUO_STUDY_POLLER=epoll and =io_uring, see tests/CMakeLists.txt. On
+// io_uring the connection cases also run in completion mode. Exits with 77,
+// skipped, when io_uring was asked for and the kernel has none.
+#include "test_common.hpp"
+#include "tcp_server.hpp"
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <cstdlib>
+#include <numeric>
+
+using namespace muduo_study;
+
+// Stands in for the libc sendfile(2), refusing it as older kernels and
+// some files do while refuse_sendfile is set, so the splice(2) fallback
+// runs.
+static std::atomic_bool refuse_sendfile{false};
+extern "C" ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) noexcept {
+    if (refuse_sendfile) {
+        errno = EINVAL;
+        return -1;
+    }
+    return ::syscall(SYS_sendfile, out_fd, in_fd, offset, count);
+}
+// Likewise sendmsg(2) answers MSG_ZEROCOPY with ENOBUFS, as when the
+// socket is out of optmem for pinning, while refuse_zerocopy is set.
+// Otherwise zero-copy sends and their notifications are recorded: where
+// in the stream each send started, its index is the kernel's id, and the
+// highest id reported done. Loop thread only.
+static std::atomic_bool refuse_zerocopy{false};
+static std::vector<size_t> zerocopy_starts;
+static size_t zerocopy_sent = 0;
+static int64_t zerocopy_notified = -1;
+extern "C" ssize_t sendmsg(int fd, const msghdr* msg, int flags) {
+    if (refuse_zerocopy && (flags & MSG_ZEROCOPY)) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    auto n = ::syscall(SYS_sendmsg, fd, msg, flags);
+    if (n > 0 && (flags & MSG_ZEROCOPY)) {
+        zerocopy_starts.push_back(zerocopy_sent);
+        zerocopy_sent += n;
+    }
+    return n;
+}
+extern "C" ssize_t recvmsg(int fd, msghdr* msg, int flags) {
+    auto n = ::syscall(SYS_recvmsg, fd, msg, flags);
+    if (n != -1 && (flags & MSG_ERRQUEUE)) {
+        for (auto cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+            auto err = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+            if (err->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                zerocopy_notified = std::max<int64_t>(zerocopy_notified, err->ee_data);
+            }
+        }
+    }
+    return n;
+}
+
+namespace {
+
+constexpr uint16_t kPort = 19870;
+using Clock = std::chrono::steady_clock;
+
+std::vector<TcpConnection::IoMode> IoModes(EventLoop* loop) {
+    std::vector modes{TcpConnection::kReadiness};
+    if (loop->io_uring_poller()) {
+        modes.push_back(TcpConnection::kCompletion);
+    }
+    return modes;
+}
+
+// Position dependent, so lost, repeated or reordered chunks show.
+std::string Pattern(size_t size) {
+    std::string data(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<char>(i % 251);
+    }
+    return data;
+}
+
+// Serves in this thread while client runs on another, until the client
+// returned and done() holds, or 30s passed.
+template<typename Client, typename Done>
+void Serve(EventLoop* loop, Client client, Done done) {
+    std::atomic_bool client_done{false};
+    auto deadline = Clock::now() + 30s;
+    auto poll = loop->RunEvery(1ms, [&]{
+        if ((client_done && done()) || Clock::now() > deadline) {
+            loop->Quit();
+        }
+    });
+    std::jthread thread{[&]{
+        client();
+        client_done = true;
+    }};
+    loop->Loop();
+    loop->Cancel(poll);
+    CHECK(client_done && done());
+}
+template<typename Client>
+void Serve(EventLoop* loop, Client client) {
+    Serve(loop, std::move(client), []{ return true; });
+}
+
+// An unlinked file holding data.
+int TempFile(std::string_view data) {
+    char path[] = "/tmp/poller_test_XXXXXX";
+    int fd = ::mkstemp(path);
+    if (fd != -1) {
+        ::unlink(path);
+        CHECK(test::WriteAll(fd, data));
+    }
+    return fd;
+}
+
+} // namespace
+
+TEST_CASE(Echo) {
+    EventLoop loop;
+    for (auto mode : IoModes(&loop)) {
+        for (size_t threads : {0, 2}) {
+            TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "echo"};
+            server.set_io_mode(mode);
+            server.set_thread_num(threads);
+            server.set_message_callback([](const TcpConnectionPtr conn, Buffer* buf, auto){
+                conn->Send(buf->RetrieveAllAsString());
+            });
+            server.Start();
+            Serve(&loop, []{
+                auto fd = test::Connect(kPort);
+                if (!CHECK(fd != -1)) return;
+                auto data = Pattern(1 << 20);
+                // Small writes first, then one the socket can't take at once.
+                for (size_t offset = 0; offset < 4096; offset += 16) {
+                    CHECK(test::WriteAll(fd, std::string_view{data}.substr(offset, 16)));
+                }
+                CHECK(test::WriteAll(fd, std::string_view{data}.substr(4096)));
+                CHECK(test::Read(fd, data.size()) == data);
+                ::close(fd);
+            });
+        }
+    }
+}
+
+// Shutdown() waits for the output to go out, then only the write side
+// closes: the peer reads everything up to EOF and can still send.
+TEST_CASE(ServerShutdownHalfCloses) {
+    EventLoop loop;
+    for (auto mode : IoModes(&loop)) {
+        constexpr size_t kSize = 4 << 20;
+        std::string received;
+        bool down = false;
+        TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "shutdown"};
+        server.set_io_mode(mode);
+        server.set_connection_callback([&](const TcpConnectionPtr conn){
+            if (conn->connected()) {
+                conn->Send(Pattern(kSize));
+                conn->Shutdown();
+            }
+            else {
+                down = true;
+            }
+        });
+        server.set_message_callback([&](const TcpConnectionPtr, Buffer* buf, auto){
+            received += buf->RetrieveAllAsString();
+        });
+        server.Start();
+        Serve(&loop, []{
+            auto fd = test::Connect(kPort);
+            if (!CHECK(fd != -1)) return;
+            CHECK(test::Read(fd) == Pattern(kSize));
+            CHECK(test::WriteAll(fd, "after EOF"));
+            ::close(fd);
+        }, [&]{ return down; });
+        CHECK_EQ(received, "after EOF");
+    }
+}
+
+// The peer's FIN comes after its data, which is still handled and
+// answered before the connection goes down.
+TEST_CASE(PeerShutdownCloses) {
+    EventLoop loop;
+    for (auto mode : IoModes(&loop)) {
+        int ups = 0;
+        int downs = 0;
+        TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "peer_shutdown"};
+        server.set_io_mode(mode);
+        server.set_connection_callback([&](const TcpConnectionPtr conn){
+            ++(conn->connected() ? ups : downs);
+        });
+        server.set_message_callback([](const TcpConnectionPtr conn, Buffer* buf, auto){
+            conn->Send(buf->RetrieveAllAsString());
+        });
+        server.Start();
+        Serve(&loop, []{
+            auto fd = test::Connect(kPort);
+            if (!CHECK(fd != -1)) return;
+            CHECK(test::WriteAll(fd, "ping"));
+            ::shutdown(fd, SHUT_WR);
+            CHECK_EQ(test::Read(fd), "ping");
+            ::close(fd);
+        }, [&]{ return downs == 1; });
+        CHECK_EQ(ups, 1);
+    }
+}
+
+// A peer that doesn't read: the rest of a large send waits in the output
+// buffer, and the write complete callback runs once, when it is all out.
+TEST_CASE(LargeWriteBackpressure) {
+    EventLoop loop;
+    for (auto mode : IoModes(&loop)) {
+        constexpr size_t kSize = 32 << 20;
+        size_t queued = 0;
+        int completes = 0;
+        size_t left_at_complete = 1;
+        TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "large"};
+        server.set_io_mode(mode);
+        server.set_connection_callback([&](const TcpConnectionPtr conn){
+            if (conn->connected()) {
+                conn->Send(Pattern(kSize));
+                queued = conn->output_buffer()->readable_bytes();
+            }
+        });
+        server.set_write_complete_callback([&](const TcpConnectionPtr conn){
+            ++completes;
+            left_at_complete = conn->output_buffer()->readable_bytes();
+        });
+        server.Start();
+        Serve(&loop, []{
+            auto fd = test::Connect(kPort);
+            if (!CHECK(fd != -1)) return;
+            std::this_thread::sleep_for(100ms);
+            CHECK(test::Read(fd, kSize) == Pattern(kSize));
+            ::close(fd);
+        }, [&]{ return completes > 0; });
+        CHECK(queued > 0);
+        CHECK_EQ(completes, 1);
+        CHECK_EQ(left_at_complete, 0u);
+    }
+}
+
+// Forced closed with a send stuck on a peer that doesn't read. Nothing in
+// flight may keep the connection alive, or its socket open, afterwards.
+TEST_CASE(ForceCloseWithSendInFlight) {
+    EventLoop loop;
+    for (auto mode : IoModes(&loop)) {
+        constexpr size_t kSize = 32 << 20;
+        std::weak_ptr<TcpConnection> weak;
+        bool up = false;
+        std::atomic_bool gone{false};
+        TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "force_close"};
+        server.set_io_mode(mode);
+        server.set_connection_callback([&](const TcpConnectionPtr conn){
+            if (conn->connected()) {
+                weak = conn;
+                up = true;
+                conn->Send(Pattern(kSize));
+                loop.RunAfter(50ms, [conn]{ conn->ForceClose(); });
+            }
+        });
+        server.Start();
+        auto watch = loop.RunEvery(1ms, [&]{
+            if (up && weak.expired()) gone = true;
+        });
+        Serve(&loop, [&]{
+            auto fd = test::Connect(kPort);
+            if (!CHECK(fd != -1)) return;
+            auto deadline = Clock::now() + 10s;
+            while (!gone && Clock::now() < deadline) {
+                std::this_thread::sleep_for(1ms);
+            }
+            // Closing releases a stuck send, so only before that counts.
+            CHECK(gone);
+            ::close(fd);
+        }, [&]{ return gone.load(); });
+        loop.Cancel(watch);
+    }
+}
+
+// A file region larger than the socket takes at once, between memory
+// slices, goes out with sendfile and through the splice fallback alike.
+TEST_CASE(SendFile) {
+    EventLoop loop;
+    auto data = Pattern(8 << 20);
+    int file = TempFile(data);
+    if (!CHECK(file != -1)) return;
+    constexpr size_t kOffset = 1000;
+    auto expected = "head" + data.substr(kOffset, data.size() - 2 * kOffset) + "tail";
+    for (auto mode : IoModes(&loop)) {
+        for (bool splice : {false, true}) {
+            refuse_sendfile = splice;
+            TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "send_file"};
+            server.set_io_mode(mode);
+            server.set_connection_callback([&](const TcpConnectionPtr conn){
+                if (conn->connected()) {
+                    conn->Send(std::string_view{"head"});
+                    conn->SendFile(file, kOffset, data.size() - 2 * kOffset);
+                    conn->Send(std::string_view{"tail"});
+                    conn->Shutdown();
+                }
+            });
+            server.Start();
+            Serve(&loop, [&]{
+                auto fd = test::Connect(kPort);
+                if (!CHECK(fd != -1)) return;
+                CHECK(test::Read(fd) == expected);
+                ::close(fd);
+            });
+        }
+    }
+    refuse_sendfile = false;
+    ::close(file);
+}
+
+// The file shrinks while its region waits behind output the peer hasn't
+// read yet: what is left of it goes out, the rest of the region is
+// dropped and the output after it follows.
+TEST_CASE(SendFileShrunkAfterQueueing) {
+    EventLoop loop;
+    constexpr size_t kAhead = 8 << 20;
+    constexpr size_t kKept = 1000;
+    auto data = Pattern(1 << 20);
+    for (auto mode : IoModes(&loop)) {
+        for (bool splice : {false, true}) {
+            refuse_sendfile = splice;
+            int file = TempFile(data);
+            if (!CHECK(file != -1)) return;
+            TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "send_file_shrunk"};
+            server.set_io_mode(mode);
+            server.set_connection_callback([&](const TcpConnectionPtr conn){
+                if (conn->connected()) {
+                    conn->Send(Pattern(kAhead));
+                    conn->SendFile(file, 0, data.size());
+                    CHECK(::ftruncate(file, kKept) == 0);
+                    conn->Send(std::string_view{"tail"});
+                    conn->Shutdown();
+                }
+            });
+            server.Start();
+            Serve(&loop, [&]{
+                auto fd = test::Connect(kPort);
+                if (!CHECK(fd != -1)) return;
+                CHECK(test::Read(fd) == Pattern(kAhead) + data.substr(0, kKept) + "tail");
+                ::close(fd);
+            });
+            ::close(file);
+        }
+    }
+    refuse_sendfile = false;
+}
+
+// Blocks sent with MSG_ZEROCOPY stay owned until the kernel reported done
+// every send that took bytes of them, then each is released once and in
+// order. Loopback copies anyway, which the notifications report.
+TEST_CASE(ZerocopyKeepsOwnersUntilNotified) {
+    EventLoop loop;
+    constexpr int kBlocks = 16;
+    constexpr size_t kBlockSize = 1 << 20;
+    std::vector<std::string> blocks;
+    std::string expected;
+    for (int i = 0; i < kBlocks; i++) {
+        blocks.push_back(Pattern(kBlockSize + i));
+        expected += blocks.back();
+    }
+    zerocopy_starts.clear();
+    zerocopy_sent = 0;
+    zerocopy_notified = -1;
+    std::weak_ptr<TcpConnection> weak;
+    std::vector<int> released;
+    int early = 0;
+    TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "zerocopy"};
+    server.set_zerocopy_threshold(kBlockSize / 2);
+    server.set_connection_callback([&](const TcpConnectionPtr conn){
+        if (!conn->connected()) return;
+        weak = conn;
+        CHECK(conn->zerocopy_threshold() > 0);
+        size_t end = 0;
+        for (int i = 0; i < kBlocks; i++) {
+            end += blocks[i].size();
+            conn->Send(blocks[i], [&, i, end]{
+                released.push_back(i);
+                auto sends = std::ranges::lower_bound(zerocopy_starts, end) - zerocopy_starts.begin();
+                early += zerocopy_notified + 1 < sends;
+                // Scribbled over right away, as reused memory would be.
+                std::ranges::fill(blocks[i], '!');
+            });
+        }
+    });
+    server.Start();
+    Serve(&loop, [&]{
+        auto fd = test::Connect(kPort);
+        if (!CHECK(fd != -1)) return;
+        std::this_thread::sleep_for(50ms);
+        CHECK(test::Read(fd, expected.size()) == expected);
+        ::close(fd);
+    }, [&]{ return std::ssize(released) == kBlocks; });
+    std::vector<int> order(kBlocks);
+    std::iota(order.begin(), order.end(), 0);
+    CHECK(released == order);
+    CHECK_EQ(early, 0);
+    if (auto conn = weak.lock()) {
+        auto stats = conn->zerocopy_stats();
+        CHECK(stats.sends > 0);
+        CHECK_EQ(stats.sends, zerocopy_starts.size());
+        CHECK_EQ(stats.completed, stats.sends);
+        CHECK_EQ(stats.copied, stats.completed);
+    }
+}
+
+// Zero-copy refused: a socket without SO_ZEROCOPY keeps threshold 0, and
+// sends the kernel can't pin are copied instead, in order, their owners
+// released as soon as they are out.
+TEST_CASE(ZerocopyFallsBackWhenRefused) {
+    EventLoop loop;
+    int fds[2];
+    if (CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0)) {
+        auto conn = std::make_shared<TcpConnection>(&loop, "unix", fds[0], InetAddress{}, InetAddress{});
+        conn->set_zerocopy_threshold(1);
+        CHECK_EQ(conn->zerocopy_threshold(), 0u);
+        conn->set_connection_callback([](const TcpConnectionPtr){});
+        conn->set_close_callback([](const TcpConnectionPtr){});
+        conn->ConnectEstablished();
+        conn->ConnectDestroyed();
+        ::close(fds[1]);
+    }
+
+    constexpr int kBlocks = 4;
+    constexpr size_t kBlockSize = 1 << 20;
+    std::string expected;
+    int released = 0;
+    std::weak_ptr<TcpConnection> weak;
+    refuse_zerocopy = true;
+    TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "zerocopy_refused"};
+    server.set_zerocopy_threshold(kBlockSize / 2);
+    server.set_connection_callback([&](const TcpConnectionPtr conn){
+        if (!conn->connected()) return;
+        weak = conn;
+        for (int i = 0; i < kBlocks; i++) {
+            auto block = std::make_shared<std::string>(Pattern(kBlockSize + i));
+            conn->Send(*block, [&, block]{ ++released; });
+        }
+    });
+    for (int i = 0; i < kBlocks; i++) {
+        expected += Pattern(kBlockSize + i);
+    }
+    server.Start();
+    Serve(&loop, [&]{
+        auto fd = test::Connect(kPort);
+        if (!CHECK(fd != -1)) return;
+        std::this_thread::sleep_for(50ms);
+        CHECK(test::Read(fd, expected.size()) == expected);
+        ::close(fd);
+    }, [&]{ return released == kBlocks; });
+    refuse_zerocopy = false;
+    if (auto conn = weak.lock()) {
+        CHECK_EQ(conn->zerocopy_stats().sends, 0u);
+    }
+}
+
+// Edge triggered reads go on to EAGAIN, so a large echo must not stall
+// on data left behind by a wakeup.
+TEST_CASE(EdgeTriggeredEcho) {
+    EventLoop loop;
+    for (size_t threads : {0, 2}) {
+        TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "echo_et"};
+        server.set_edge_triggered(true);
+        server.set_thread_num(threads);
+        server.set_message_callback([](const TcpConnectionPtr conn, Buffer* buf, auto){
+            conn->Send(buf->RetrieveAllAsString());
+        });
+        server.Start();
+        Serve(&loop, []{
+            auto fd = test::Connect(kPort);
+            if (!CHECK(fd != -1)) return;
+            auto data = Pattern(16 << 20);
+            std::jthread writer{[&]{ CHECK(test::WriteAll(fd, data)); }};
+            CHECK(test::Read(fd, data.size()) == data);
+            writer.join();
+            ::close(fd);
+        });
+    }
+}
+
+// Every read of a SOCK_SEQPACKET socket returns one message, so messages
+// queued before the connection is established take more reads than
+// kMaxReadsPerWakeup. No new edge comes for them, only the queued
+// continuation reads the rest.
+TEST_CASE(EdgeTriggeredReadCapRequeues) {
+    EventLoop loop;
+    int fds[2];
+    if (!CHECK(::socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == 0)) return;
+    ::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    constexpr int kMessages = TcpConnection::kMaxReadsPerWakeup * 6 + 3;
+    std::string expected;
+    for (int i = 0; i < kMessages; i++) {
+        auto message = std::format("message {}\n", i);
+        CHECK(::write(fds[1], message.data(), message.size()) == static_cast<ssize_t>(message.size()));
+        expected += message;
+    }
+    auto conn = std::make_shared<TcpConnection>(&loop, "seqpacket", fds[0], InetAddress{}, InetAddress{});
+    conn->set_edge_triggered(true);
+    std::string received;
+    int callbacks = 0;
+    conn->set_connection_callback([](const TcpConnectionPtr){});
+    conn->set_close_callback([](const TcpConnectionPtr){});
+    conn->set_message_callback([&](const TcpConnectionPtr, Buffer* buf, auto){
+        ++callbacks;
+        received += buf->RetrieveAllAsString();
+    });
+    conn->ConnectEstablished();
+    auto deadline = Clock::now() + 10s;
+    auto poll = loop.RunEvery(1ms, [&]{
+        if (received.size() == expected.size() || Clock::now() > deadline) loop.Quit();
+    });
+    loop.Loop();
+    loop.Cancel(poll);
+    CHECK(received == expected);
+    CHECK(callbacks > kMessages / TcpConnection::kMaxReadsPerWakeup);
+    conn->ConnectDestroyed();
+    ::close(fds[1]);
+}
+
+TEST_CASE(Timers) {
+    EventLoop loop;
+    auto start = std::chrono::system_clock::now();
+    std::vector<int> order;
+    for (int ms : {30, 10, 20}) {
+        loop.RunAfter(ms * 1ms, [&, ms]{
+            order.push_back(ms);
+            CHECK(std::chrono::system_clock::now() - start >= ms * 1ms);
+        });
+    }
+    auto canceled = loop.RunAfter(15ms, []{ CHECK(!"a canceled timer fired"); });
+    loop.Cancel(canceled);
+    int ticks = 0;
+    int ticks_at_cancel = -1;
+    auto every = loop.RunEvery(5ms, [&]{ ++ticks; });
+    loop.RunAfter(40ms, [&]{
+        loop.Cancel(every);
+        ticks_at_cancel = ticks;
+    });
+    bool remote = false;
+    std::jthread other{[&]{ loop.RunAfter(5ms, [&]{ remote = true; }); }};
+    loop.RunAfter(80ms, [&]{ loop.Quit(); });
+    loop.Loop();
+    CHECK((order == std::vector{10, 20, 30}));
+    CHECK(ticks_at_cancel >= 3);
+    CHECK_EQ(ticks, ticks_at_cancel);
+    CHECK(remote);
+}
+
+// Per producer in order, none lost.
+TEST_CASE(CrossThreadPosts) {
+    EventLoop loop;
+    constexpr int kThreads = 4;
+    constexpr int kPosts = 20000;
+    // Loop thread only.
+    std::vector<int> next(kThreads, 0);
+    int out_of_order = 0;
+    int finished = 0;
+    std::vector<std::jthread> producers;
+    for (int t = 0; t < kThreads; t++) {
+        producers.emplace_back([&, t]{
+            for (int i = 0; i < kPosts; i++) {
+                loop.QueueInLoop([&, t, i]{
+                    out_of_order += next[t] != i;
+                    next[t] = i + 1;
+                });
+            }
+            loop.QueueInLoop([&]{
+                if (++finished == kThreads) loop.Quit();
+            });
+        });
+    }
+    loop.Loop();
+    CHECK_EQ(out_of_order, 0);
+    for (int t = 0; t < kThreads; t++) {
+        CHECK_EQ(next[t], kPosts);
+    }
+}
+
+// Nothing else is due, so the loop sits in Poll() for its full timeout
+// unless the post wakes it. So must a post made by the loop itself.
+TEST_CASE(PostWakesBlockedLoop) {
+    EventLoop loop;
+    auto start = Clock::now();
+    std::jthread other{[&]{
+        std::this_thread::sleep_for(50ms);
+        loop.QueueInLoop([&]{
+            loop.QueueInLoop([&]{ loop.Quit(); });
+        });
+    }};
+    loop.Loop();
+    CHECK(Clock::now() - start < 2s);
+}
+
+int main(int argc, char* argv[]) {
+    auto poller = ::getenv("MUDUO_STUDY_POLLER");
+    if (poller && std::string_view{poller} == "io_uring" && !IoUring::Create().has_value()) {
+        printf("io_uring unavailable, skipped\n");
+        return 77;
+    }
+    return test::RunAll(argc, argv);
+}
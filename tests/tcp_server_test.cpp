@@ -0,0 +1,125 @@
+// TcpServer with an acceptor per loop, SO_REUSEPORT sockets and one
+// shared EPOLLEXCLUSIVE socket: connections are served on the pool's
+// loops, and the server can go while connections are still arriving.
+#include "test_common.hpp"
+#include "tcp_server.hpp"
+#include <mutex>
+#include <set>
+
+using namespace muduo_study;
+
+namespace {
+
+constexpr uint16_t kPort = 19873;
+constexpr TcpServer::Option kPerLoopOptions[] = {TcpServer::kReusePortPerLoop, TcpServer::kExclusivePerLoop};
+
+// Runs the loop until done() holds or the timeout passed.
+template<typename Done>
+bool RunUntil(EventLoop* loop, Done done, std::chrono::milliseconds timeout = 10s) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    auto poll = loop->RunEvery(1ms, [&]{
+        if (done() || std::chrono::steady_clock::now() > deadline) {
+            loop->Quit();
+        }
+    });
+    loop->Loop();
+    loop->Cancel(poll);
+    return done();
+}
+
+} // namespace
+
+// Every connection is echoed and goes up and down on one of the pool's
+// loops, never the base loop. SO_REUSEPORT spreads them by the peer's
+// port, so more than one loop gets some.
+TEST_CASE(PerLoopAcceptorsServe) {
+    EventLoop loop;
+    for (auto option : kPerLoopOptions) {
+        constexpr int kClients = 30;
+        std::mutex mutex;
+        std::set<EventLoop*> loops;
+        std::atomic_int downs{0};
+        TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "per_loop", option};
+        server.set_thread_num(3);
+        server.set_connection_callback([&](const TcpConnectionPtr conn){
+            CHECK(conn->loop() != &loop);
+            if (conn->connected()) {
+                std::lock_guard lock{mutex};
+                loops.insert(conn->loop());
+            }
+            else {
+                ++downs;
+            }
+        });
+        server.set_message_callback([](const TcpConnectionPtr conn, Buffer* buf, auto){
+            conn->Send(buf->RetrieveAllAsString());
+        });
+        server.Start();
+        std::atomic_bool clients_done{false};
+        std::jthread clients{[&]{
+            for (int i = 0; i < kClients; i++) {
+                auto fd = test::Connect(kPort);
+                if (!CHECK(fd != -1)) break;
+                CHECK(test::WriteAll(fd, "ping"));
+                CHECK_EQ(test::Read(fd, 4), "ping");
+                ::close(fd);
+            }
+            clients_done = true;
+        }};
+        CHECK(RunUntil(&loop, [&]{ return clients_done && downs == kClients; }));
+        std::lock_guard lock{mutex};
+        auto pool = server.thread_pool()->all_loops();
+        for (auto used : loops) {
+            CHECK(std::ranges::find(pool, used) != pool.end());
+        }
+        if (option == TcpServer::kReusePortPerLoop) {
+            CHECK(loops.size() > 1);
+        }
+    }
+}
+
+// Clients keep connecting while the server is destroyed. Every
+// connection that came up goes down with it, nothing is accepted into a
+// server that is gone.
+TEST_CASE(DestroyedWhileConnecting) {
+    EventLoop loop;
+    for (auto option : kPerLoopOptions) {
+        for (int round = 0; round < 20; round++) {
+            std::atomic_int ups{0};
+            std::atomic_int downs{0};
+            std::atomic_bool stop{false};
+            std::vector<std::jthread> clients;
+            {
+                TcpServer server{&loop, InetAddress{"127.0.0.1", kPort}, "teardown_while_connecting", option};
+                server.set_thread_num(3);
+                // Too big for std::function to store inline, so ASan sees a
+                // copy made after the server is gone.
+                server.set_connection_callback([&ups, &downs, name = server.name()](const TcpConnectionPtr conn){
+                    CHECK(conn->name().starts_with(name));
+                    ++(conn->connected() ? ups : downs);
+                });
+                server.Start();
+                for (int c = 0; c < 2; c++) {
+                    clients.emplace_back([&]{
+                        while (!stop) {
+                            auto fd = test::Connect(kPort);
+                            if (fd != -1) {
+                                test::WriteAll(fd, "x");
+                                ::close(fd);
+                            }
+                        }
+                    });
+                }
+                RunUntil(&loop, [&]{ return ups > 10; }, 2s);
+            }
+            CHECK_EQ(ups.load(), downs.load());
+            stop = true;
+            clients.clear();
+            CHECK(ups > 0);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    return test::RunAll(argc, argv);
+}
@@ -0,0 +1,137 @@
+// Shared by the tests: a registry of cases, checks that report and carry
+// on, a main() runner and blocking loopback clients. No dependencies.
+//
+//   TEST_CASE(BufferWraps) {
+//       CHECK(...);
+//       CHECK_EQ(a, b);
+//   }
+//   int main(int argc, char* argv[]) { return test::RunAll(argc, argv); }
+//
+// Each case runs on a thread of its own, a thread only ever gets one
+// EventLoop. An argument runs the cases whose name contains it. The log
+// is discarded unless TEST_LOG is set.
+#pragma once
+#include "logger.hpp"
+#include "inet_address.hpp"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace test {
+
+struct Case {
+    std::string_view name;
+    void (*func)();
+};
+
+inline std::vector<Case>& Cases() {
+    static std::vector<Case> cases;
+    return cases;
+}
+// Client threads check too.
+inline std::atomic_int failures{0};
+
+struct Register {
+    Register(std::string_view name, void (*func)()) { Cases().push_back({name, func}); }
+};
+
+inline bool Check(bool ok, const char* expr, const char* file, int line) {
+    if (!ok) {
+        ++failures;
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expr);
+    }
+    return ok;
+}
+template<typename A, typename B>
+bool CheckEq(const A& a, const B& b, const char* expr_a, const char* expr_b, const char* file, int line) {
+    if (a == b) return true;
+    ++failures;
+    fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed", file, line, expr_a, expr_b);
+    if constexpr (requires { std::cerr << a << b; }) {
+        std::cerr << ": " << a << " != " << b;
+    }
+    fprintf(stderr, "\n");
+    return false;
+}
+
+// Discards the log, the statements of the code under test stay cheap and
+// quiet. Stateless, so any thread may write.
+class DiscardBuf : public std::streambuf
+{
+protected:
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+};
+
+inline int RunAll(int argc, char* argv[]) {
+    static DiscardBuf discard_buf;
+    static std::ostream discard{&discard_buf};
+    if (!::getenv("TEST_LOG")) {
+        muduo_study::Logger::set_ostream(discard);
+    }
+    std::string_view filter = argc > 1 ? argv[1] : "";
+    int failed = 0;
+    for (auto& c : Cases()) {
+        if (c.name.find(filter) == c.name.npos) continue;
+        printf("[ RUN      ] %.*s\n", static_cast<int>(c.name.size()), c.name.data());
+        fflush(stdout);
+        auto before = failures.load();
+        std::thread{c.func}.join();
+        bool ok = failures.load() == before;
+        failed += !ok;
+        printf("[ %s ] %.*s\n", ok ? "      OK" : "  FAILED", static_cast<int>(c.name.size()), c.name.data());
+    }
+    printf("%d of %zu cases failed\n", failed, Cases().size());
+    return failed == 0 ? 0 : 1;
+}
+
+// Blocking, reads give up after 10s so a broken server fails the case
+// rather than hanging it.
+inline int Connect(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    timeval timeout{10, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    muduo_study::InetAddress addr{"127.0.0.1", port};
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(addr.sockaddr()), sizeof(sockaddr_in)) == -1) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+inline bool WriteAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        auto n = ::write(fd, data.data(), data.size());
+        if (n <= 0) return false;
+        data.remove_prefix(n);
+    }
+    return true;
+}
+// Until EOF, an error or max bytes.
+inline std::string Read(int fd, size_t max = static_cast<size_t>(-1)) {
+    std::string data;
+    char buf[65536];
+    while (data.size() < max) {
+        auto n = ::read(fd, buf, std::min(sizeof(buf), max - data.size()));
+        if (n <= 0) break;
+        data.append(buf, n);
+    }
+    return data;
+}
+
+} // namespace test
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static test::Register name##_register{#name, name}; \
+    static void name()
+
+#define CHECK(cond) test::Check(static_cast<bool>(cond), #cond, __FILE__, __LINE__)
+#define CHECK_EQ(a, b) test::CheckEq((a), (b), #a, #b, __FILE__, __LINE__)
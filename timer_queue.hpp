@@ -0,0 +1,272 @@
+#pragma once
+#include "core.hpp"
+#include "callbacks.hpp"
+#include "channel.hpp"
+#include "logger.hpp"
+#include <sys/timerfd.h>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <vector>
+
+MUDUO_STUDY_BEGIN_NAMESPACE
+
+int CreateTimerfd() {
+    auto fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        MUDUO_STUDY_LOG_SYSFATAL("timerfd_create failed!");
+    }
+    return fd;
+}
+
+class TimerId
+{
+public:
+    TimerId() :
+        index_{0},
+        sequence_{0} {}
+
+    auto sequence() const noexcept { return sequence_; }
+    bool valid() const noexcept { return sequence_ != 0; }
+
+private:
+    template<typename> friend class TimerQueueImpl;
+
+    TimerId(uint32_t index, uint64_t sequence) :
+        index_{index},
+        sequence_{sequence} {}
+
+    uint32_t index_;
+    uint64_t sequence_;
+};
+
+// Timers live in a slab indexed by TimerId::index_ and are ordered by an
+// indexed binary min-heap, so insert/cancel are O(log n) and a repeating
+// timer is re-armed in place. Expiry reuses expired_, nothing is allocated
+// per tick once the slab and heap have grown to their working size. The slab
+// is a deque so a callback adding timers never moves the running one.
+template<typename EventLoop/*=EventLoop*/>
+class TimerQueueImpl
+{
+public:
+    MUDUO_STUDY_NONCOPYABLE(TimerQueueImpl)
+
+    explicit TimerQueueImpl(EventLoop* loop) :
+        loop_{loop},
+        timerfd_channel_{loop, CreateTimerfd()},
+        next_sequence_{1},
+        slot_count_{0},
+        calling_expired_timers_{false}
+    {
+        timerfd_channel_.set_read_callback([this](auto){ HandleRead(); });
+        timerfd_channel_.EnableReading();
+    }
+    ~TimerQueueImpl() {
+        timerfd_channel_.DisableAll();
+        timerfd_channel_.Remove();
+        ::close(timerfd_channel_.fd());
+    }
+
+    // Thread safe. interval == 0 means a one-shot timer.
+    TimerId AddTimer(TimerCallback cb, time_point when, std::chrono::nanoseconds interval) {
+        uint32_t index;
+        {
+            std::scoped_lock lock{slot_mutex_};
+            if (free_slots_.empty()) {
+                index = slot_count_++;
+            }
+            else {
+                index = free_slots_.back();
+                free_slots_.pop_back();
+            }
+        }
+        TimerId id{index, next_sequence_.fetch_add(1, std::memory_order_relaxed)};
+        loop_->RunInLoop([=, this, cb=std::move(cb)]() mutable {
+            AddTimerInLoop(id, std::move(cb), when, interval);
+        });
+        return id;
+    }
+    // Thread safe. Canceling an expired or already canceled timer is a no-op.
+    void Cancel(TimerId id) {
+        if (!id.valid()) return;
+        loop_->RunInLoop([=, this](){ CancelInLoop(id); });
+    }
+
+    auto size() const noexcept { return heap_.size(); }
+
+private:
+    static constexpr size_t kNotInHeap = static_cast<size_t>(-1);
+    static constexpr auto kMinTimeout = std::chrono::microseconds{100};
+
+    struct Timer {
+        TimerCallback callback;
+        time_point expiration;
+        std::chrono::nanoseconds interval;
+        uint64_t sequence = 0;
+        size_t heap_index = kNotInHeap;
+        bool canceled = false;
+    };
+
+    void AddTimerInLoop(TimerId id, TimerCallback cb, time_point when, std::chrono::nanoseconds interval) {
+        loop_->AssertInLoopThread();
+        if (id.index_ >= timers_.size()) {
+            timers_.resize(id.index_ + 1);
+        }
+        auto& timer = timers_[id.index_];
+        assert(timer.sequence == 0);
+        timer.callback = std::move(cb);
+        timer.expiration = when;
+        timer.interval = interval;
+        timer.sequence = id.sequence_;
+        timer.canceled = false;
+        if (HeapPush(id.index_) == 0) {
+            ResetTimerfd(when);
+        }
+    }
+    void CancelInLoop(TimerId id) {
+        loop_->AssertInLoopThread();
+        if (id.index_ >= timers_.size()) return;
+        auto& timer = timers_[id.index_];
+        if (timer.sequence != id.sequence_) return;
+        if (timer.heap_index != kNotInHeap) {
+            HeapErase(timer.heap_index);
+            FreeSlot(id.index_);
+        }
+        else {
+            // Canceled from inside a callback of the current expiry batch,
+            // the slot is released once the batch finishes.
+            assert(calling_expired_timers_);
+            timer.canceled = true;
+        }
+    }
+
+    void HandleRead() {
+        loop_->AssertInLoopThread();
+        uint64_t howmany;
+        auto n = ::read(timerfd_channel_.fd(), &howmany, sizeof(howmany));
+        if (n != sizeof(howmany) && errno != EAGAIN) {
+            MUDUO_STUDY_LOG_ERROR("TimerQueue::HandleRead() reads {} bytes instead of 8", n);
+        }
+        auto now = std::chrono::system_clock::now();
+        while (!heap_.empty() && timers_[heap_.front()].expiration <= now) {
+            expired_.push_back(heap_.front());
+            HeapErase(0);
+        }
+
+        calling_expired_timers_ = true;
+        for (auto index : expired_) {
+            auto& timer = timers_[index];
+            if (!timer.canceled) {
+                timer.callback();
+            }
+        }
+        calling_expired_timers_ = false;
+
+        for (auto index : expired_) {
+            auto& timer = timers_[index];
+            if (timer.interval.count() > 0 && !timer.canceled) {
+                timer.expiration = now + timer.interval;
+                HeapPush(index);
+            }
+            else {
+                FreeSlot(index);
+            }
+        }
+        expired_.clear();
+
+        if (!heap_.empty()) {
+            ResetTimerfd(timers_[heap_.front()].expiration);
+        }
+    }
+
+    void ResetTimerfd(time_point expiration) {
+        auto delay = std::max<std::chrono::nanoseconds>(expiration - std::chrono::system_clock::now(), kMinTimeout);
+        auto secs = std::chrono::duration_cast<std::chrono::seconds>(delay);
+        itimerspec new_value;
+        ZeroMemory(new_value);
+        new_value.it_value.tv_sec = secs.count();
+        new_value.it_value.tv_nsec = (delay - secs).count();
+        if (::timerfd_settime(timerfd_channel_.fd(), 0, &new_value, nullptr) == -1) {
+            MUDUO_STUDY_LOG_SYSERR("timerfd_settime failed!");
+        }
+    }
+
+    void FreeSlot(uint32_t index) {
+        auto& timer = timers_[index];
+        timer.callback = nullptr;
+        timer.sequence = 0;
+        timer.heap_index = kNotInHeap;
+        std::scoped_lock lock{slot_mutex_};
+        free_slots_.push_back(index);
+    }
+
+    bool Earlier(uint32_t lhs, uint32_t rhs) const {
+        auto& a = timers_[lhs];
+        auto& b = timers_[rhs];
+        return a.expiration < b.expiration ||
+            (a.expiration == b.expiration && a.sequence < b.sequence);
+    }
+    void HeapSet(size_t pos, uint32_t index) {
+        heap_[pos] = index;
+        timers_[index].heap_index = pos;
+    }
+    size_t HeapPush(uint32_t index) {
+        heap_.push_back(index);
+        return SiftUp(heap_.size() - 1);
+    }
+    void HeapErase(size_t pos) {
+        assert(pos < heap_.size());
+        timers_[heap_[pos]].heap_index = kNotInHeap;
+        auto last = heap_.back();
+        heap_.pop_back();
+        if (pos < heap_.size()) {
+            HeapSet(pos, last);
+            SiftDown(SiftUp(pos));
+        }
+    }
+    size_t SiftUp(size_t pos) {
+        auto index = heap_[pos];
+        while (pos > 0) {
+            auto parent = (pos - 1) / 2;
+            if (!Earlier(index, heap_[parent])) break;
+            HeapSet(pos, heap_[parent]);
+            pos = parent;
+        }
+        HeapSet(pos, index);
+        return pos;
+    }
+    size_t SiftDown(size_t pos) {
+        auto index = heap_[pos];
+        auto size = heap_.size();
+        while (true) {
+            auto child = pos * 2 + 1;
+            if (child >= size) break;
+            if (child + 1 < size && Earlier(heap_[child + 1], heap_[child])) {
+                ++child;
+            }
+            if (!Earlier(heap_[child], index)) break;
+            HeapSet(pos, heap_[child]);
+            pos = child;
+        }
+        HeapSet(pos, index);
+        return pos;
+    }
+
+    EventLoop* loop_;
+    Channel timerfd_channel_;
+    std::atomic_uint64_t next_sequence_;
+
+    std::mutex slot_mutex_;
+    std::vector<uint32_t> free_slots_;
+    uint32_t slot_count_;
+
+    std::deque<Timer> timers_;
+    std::vector<uint32_t> heap_;
+    std::vector<uint32_t> expired_;
+    bool calling_expired_timers_;
+};
+
+class EventLoop;
+using TimerQueue = TimerQueueImpl<EventLoop>;
+
+MUDUO_STUDY_END_NAMESPACE